@@ -62,6 +62,10 @@ typedef struct ctx_s {
 	faux_list_node_t *files_iter; // MODE_FILES
 	faux_file_t *files_fd; // MODE_FILES
 	faux_file_t *stdin_fd; // MODE_STDIN
+	bool_t eof; // No more commands
+	// Pipelining: max number of commands sent but not answered yet
+	size_t pipeline;
+	faux_list_t *echo_lines; // Verbose: lines sent but not echoed yet
 } ctx_t;
 
 
@@ -242,6 +246,15 @@ int main(int argc, char **argv)
 	ctx.tinyrl = tinyrl;
 	ctx.opts = opts;
 	ctx.pager_working = TRI_UNDEFINED;
+	ctx.eof = BOOL_FALSE;
+	// Pipelining is for batch modes only
+	ctx.pipeline = 1;
+	if ((ctx.mode == MODE_FILES) || (ctx.mode == MODE_STDIN))
+		ctx.pipeline = opts->pipeline;
+	ctx.echo_lines = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, (void (*)(void *))faux_str_free);
+	// Server skips commands that was sent after the failed one
+	ktp_session_set_stop_on_error(ktp, opts->stop_on_error);
 
 	ktp_session_set_cb(ktp, KTP_SESSION_CB_STDIN, async_stdin_sent_cb, &ctx);
 	ktp_session_set_cb(ktp, KTP_SESSION_CB_STDOUT, stdout_cb, &ctx);
@@ -304,6 +317,7 @@ err:
 		tinyrl_free(tinyrl);
 	}
 	ktp_session_free(ktp);
+	faux_list_free(ctx.echo_lines);
 	faux_eloop_free(eloop);
 	ktp_disconnect(unix_sock);
 	opts_free(opts);
@@ -315,15 +329,9 @@ err:
 }
 
 
-static bool_t send_next_command(ctx_t *ctx)
+static char *get_next_line(ctx_t *ctx)
 {
 	char *line = NULL;
-	faux_error_t *error = NULL;
-	bool_t rc = BOOL_FALSE;
-
-	// User must type next interactive command. So just return
-	if (ctx->mode == MODE_INTERACTIVE)
-		return BOOL_TRUE;
 
 	// Commands from cmdline
 	if (ctx->mode == MODE_CMDLINE) {
@@ -353,29 +361,69 @@ static bool_t send_next_command(ctx_t *ctx)
 			ctx->stdin_fd = faux_file_fdopen(STDIN_FILENO);
 		if (ctx->stdin_fd)
 			line = faux_file_getline(ctx->stdin_fd);
-		if (!line) // EOF
+		if (!line) { // EOF
 			faux_file_close(ctx->stdin_fd);
+			ctx->stdin_fd = NULL;
+		}
 	}
 
-	if (!line) {
-		ktp_session_set_done(ctx->ktp, BOOL_TRUE);
+	return line;
+}
+
+
+static void echo_line(ctx_t *ctx, const char *line)
+{
+	const char *prompt = tinyrl_prompt(ctx->tinyrl);
+
+	printf("%s%s\n", prompt ? prompt : "", line);
+	fflush(stdout);
+}
+
+
+static bool_t send_next_command(ctx_t *ctx)
+{
+	char *line = NULL;
+	faux_error_t *error = NULL;
+	bool_t rc = BOOL_FALSE;
+
+	// User must type next interactive command. So just return
+	if (ctx->mode == MODE_INTERACTIVE)
 		return BOOL_TRUE;
-	}
 
-	if (ctx->opts->verbose) {
-		const char *prompt = tinyrl_prompt(ctx->tinyrl);
-		printf("%s%s\n", prompt ? prompt : "", line);
-		fflush(stdout);
-	}
+	// Don't wait for ACK of previous command if pipelining is on. Server
+	// queues commands and executes them in order.
+	while (!ctx->eof &&
+		(ktp_session_cmd_outstanding(ctx->ktp) < ctx->pipeline)) {
 
-	error = faux_error_new();
-	rc = ktp_session_cmd(ctx->ktp, line, error, ctx->opts->dry_run);
-	faux_str_free(line);
-	if (!rc) {
-		faux_error_free(error);
-		return BOOL_FALSE;
+		line = get_next_line(ctx);
+		if (!line) {
+			ctx->eof = BOOL_TRUE;
+			break;
+		}
+
+		// Line is echoed when the command becomes current one. So
+		// echo and output of commands are not mixed.
+		if (ctx->opts->verbose) {
+			if (ktp_session_cmd_outstanding(ctx->ktp) == 0)
+				echo_line(ctx, line);
+			else
+				faux_list_add(ctx->echo_lines,
+					faux_str_dup(line));
+		}
+
+		error = faux_error_new();
+		rc = ktp_session_cmd(ctx->ktp, line, error, ctx->opts->dry_run);
+		faux_str_free(line);
+		if (!rc) {
+			faux_error_free(error);
+			return BOOL_FALSE;
+		}
 	}
 
+	// All commands are answered
+	if (ctx->eof && (ktp_session_cmd_outstanding(ctx->ktp) == 0))
+		ktp_session_set_done(ctx->ktp, BOOL_TRUE);
+
 	// Suppose non-interactive command by default
 //	tinyrl_enable_isig(ctx->tinyrl);
 
@@ -570,6 +618,14 @@ bool_t cmd_ack_cb(ktp_session_t *ktp, const faux_msg_t *msg, void *udata)
 	}
 	faux_error_free(error);
 
+	// Echo pipelined command that becomes current one
+	if (!faux_list_is_empty(ctx->echo_lines)) {
+		char *line = (char *)faux_list_takeaway(ctx->echo_lines,
+			faux_list_head(ctx->echo_lines));
+		echo_line(ctx, line);
+		faux_str_free(line);
+	}
+
 	if (ctx->mode == MODE_INTERACTIVE) {
 		tinyrl_set_busy(ctx->tinyrl, BOOL_FALSE);
 		if (!ktp_session_done(ktp))
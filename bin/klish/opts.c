@@ -33,6 +33,7 @@ struct options *opts_init(void)
 	// Initialize
 	opts->verbose = BOOL_FALSE;
 	opts->stop_on_error = BOOL_FALSE;
+	opts->pipeline = 1;
 	opts->dry_run = BOOL_FALSE;
 	opts->quiet = BOOL_FALSE;
 	opts->cfgfile = faux_str_dup(DEFAULT_CFGFILE);
@@ -74,7 +75,7 @@ void opts_free(struct options *opts)
  */
 int opts_parse(int argc, char *argv[], struct options *opts)
 {
-	static const char *shortopts = "hvf:c:erq";
+	static const char *shortopts = "hvf:c:erqp:";
 	static const struct option longopts[] = {
 		{"conf",		1, NULL, 'f'},
 		{"help",		0, NULL, 'h'},
@@ -83,6 +84,7 @@ int opts_parse(int argc, char *argv[], struct options *opts)
 		{"stop-on-error",	0, NULL, 'e'},
 		{"dry-run",		0, NULL, 'r'},
 		{"quiet",		0, NULL, 'q'},
+		{"pipeline",		1, NULL, 'p'},
 		{NULL,			0, NULL, 0}
 	};
 
@@ -106,6 +108,17 @@ int opts_parse(int argc, char *argv[], struct options *opts)
 		case 'q':
 			opts->quiet = BOOL_TRUE;
 			break;
+		case 'p': {
+			unsigned long pipeline = 0;
+			if (!faux_conv_atoul(optarg, &pipeline, 0) ||
+				(pipeline < 1)) {
+				fprintf(stderr, "Error: Illegal pipeline depth "
+					"\"%s\"\n", optarg);
+				_exit(-1);
+			}
+			opts->pipeline = pipeline;
+			break;
+		}
 		case 'h':
 			help(0, argv[0]);
 			_exit(0);
@@ -176,6 +189,9 @@ void help(int status, const char *argv0)
 		printf("\t-e, --stop-on-error Stop script execution on error.\n");
 		printf("\t-q, --quiet Disable echo while executing commands\n\t\tfrom the file stream.\n");
 		printf("\t-r, --dry-run Don't actually execute ACTION scripts.\n");
+		printf("\t-p <depth>, --pipeline=<depth> Max number of commands\n"
+			"\t\tsent to server without waiting for answer. It's\n"
+			"\t\tfor commands from files or stdin (1).\n");
 		printf("\t-f <path>, --conf=<path> Config file ("
 			DEFAULT_CFGFILE ").\n");
 	}
@@ -241,6 +257,13 @@ bool_t config_parse(const char *cfgfile, struct options *opts)
 			opts->hist_save_always = BOOL_FALSE;
 	}
 
+	// Pipeline: max number of outstanding commands (default: 1)
+	if ((tmp = faux_ini_find(ini, "Pipeline"))) {
+		unsigned long pipeline = 0;
+		if (faux_conv_atoul(tmp, &pipeline, 0) && (pipeline > 0))
+			opts->pipeline = pipeline;
+	}
+
 	faux_ini_free(ini);
 
 	return BOOL_TRUE;
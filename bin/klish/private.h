@@ -24,6 +24,7 @@ struct options {
 	bool_t hist_save_always;
 	size_t hist_size;
 	bool_t stop_on_error;
+	size_t pipeline;
 	bool_t dry_run;
 	bool_t quiet;
 	faux_list_t *commands;
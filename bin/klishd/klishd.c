@@ -16,6 +16,7 @@
 #include <sys/un.h>
 #include <sys/fsuid.h>
 #include <sys/wait.h>
+#include <sys/prctl.h>
 #include <poll.h>
 #include <time.h>
 
@@ -41,20 +42,69 @@
 #include <klish/kcontext.h>
 #include <klish/ksession.h>
 #include <klish/ksession_parse.h>
+#include <klish/klock.h>
 #include <klish/kdb.h>
 #include <klish/kpargv.h>
 
 #include "private.h"
 
 
+// Listen daemon state
+typedef struct {
+	int listen_fd;
+	bool_t listening; // Listen socket is within eloop
+	faux_eloop_t *eloop;
+	int client_fd; // Service process: connection to serve
+	bool_t warm; // Service process is pre-forked and waits for connection
+	// Pool of pre-forked service processes. Idle service processes wait
+	// for connection within accept() on shared listen socket.
+	size_t pool_size;
+	pid_t *pool; // PIDs of idle service processes
+	size_t pool_idle;
+	int notify_fd[2]; // Service process reports its PID after accept()
+	pid_t parent_pid;
+	bool_t multi; // Pool processes serve many sessions each
+	faux_ev_t *refill_ev; // Delayed replacement of lost processes
+	// Current scheme. It can be reloaded by SIGHUP. Service processes
+	// forked after reload get the new one.
+	kscheme_t *scheme;
+	faux_ini_t *config;
+	struct options *opts;
+} listener_t;
+
+
+// Service process serving many sessions within single eloop
+typedef struct {
+	faux_eloop_t *eloop;
+	kscheme_t *scheme;
+	const struct options *opts;
+	faux_list_t *sessions; // Active sessions
+	faux_list_t *closed; // Finished sessions. Will be freed later
+	faux_ev_t *gc_ev;
+	int listen_fd;
+	bool_t retired; // Scheme is reloaded. Don't accept new connections
+} service_t;
+
+
 // Local static functions
 bool_t daemonize(const char *pidfile);
 bool_t kentry_entrys_is_empty(const kentry_t *entry);
 static int create_listen_unix_sock(const char *path, const struct options *opts);
 static kscheme_t *load_all_dbs(const char *dbs,
 	faux_ini_t *global_config, faux_error_t *error);
+static bool_t check_shared_scheme(const kscheme_t *scheme,
+	faux_error_t *error);
 static bool_t clear_scheme(kscheme_t *scheme, faux_error_t *error);
 static void signal_handler_empty(int signo);
+static void listener_watch(listener_t *listener);
+static bool_t pool_fill(listener_t *listener);
+static int pool_accept(listener_t *listener);
+static void pool_restart(listener_t *listener);
+static ktpd_session_t *service_session_new(int fd, kscheme_t *scheme,
+	faux_eloop_t *eloop, const struct options *opts, service_t *service);
+static bool_t service_loop(int listen_fd, kscheme_t *scheme,
+	const struct options *opts, faux_eloop_t *eloop, pid_t parent_pid);
+static void service_close_cb(ktpd_session_t *ktpd, void *user_data);
 
 
 // Main loop events
@@ -66,6 +116,10 @@ static bool_t listen_socket_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data);
 static bool_t wait_for_child_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data);
+static bool_t pool_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data);
+static bool_t pool_refill_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data);
 
 
 /** @brief Main function
@@ -83,6 +137,8 @@ int main(int argc, char **argv)
 	faux_error_t *error = faux_error_new();
 	faux_ini_t *config = NULL;
 	int client_fd = -1;
+	listener_t listener = {
+		.listen_fd = -1, .client_fd = -1, .notify_fd = { -1, -1 } };
 	struct sigaction sig_act = {};
 	sigset_t sig_set = {};
 	char *log_service_name = NULL;
@@ -126,6 +182,11 @@ int main(int argc, char **argv)
 		fprintf(stderr, "Scheme errors:\n");
 		goto err;
 	}
+	if ((opts->service_processes > 0) &&
+		!check_shared_scheme(scheme, error)) {
+		fprintf(stderr, "Scheme can't be used with ServiceProcesses:\n");
+		goto err;
+	}
 
 	// Listen socket
 	syslog(LOG_DEBUG, "Create listen UNIX socket: %s", opts->unix_socket_path);
@@ -134,23 +195,62 @@ int main(int argc, char **argv)
 		goto err;
 	syslog(LOG_DEBUG, "Listen socket %d", listen_unix_sock);
 
+	// Lock file for named locks of ACTIONs. It's common for all service
+	// processes.
+	if (!klock_create(opts->lockfile)) {
+		syslog(LOG_ERR, "Can't create lock file %s or it's owned by "
+			"another user", opts->lockfile);
+		goto err;
+	}
+
 	// Event loop
 	eloop = faux_eloop_new(NULL);
+	listener.listen_fd = listen_unix_sock;
+	listener.eloop = eloop;
+	listener.parent_pid = getpid();
+	listener.scheme = scheme;
+	listener.config = config;
+	listener.opts = opts;
 	// Signals
 	faux_eloop_add_signal(eloop, SIGINT, stop_loop_ev, NULL);
 	faux_eloop_add_signal(eloop, SIGTERM, stop_loop_ev, NULL);
 	faux_eloop_add_signal(eloop, SIGQUIT, stop_loop_ev, NULL);
-	faux_eloop_add_signal(eloop, SIGHUP, refresh_config_ev, opts);
-	faux_eloop_add_signal(eloop, SIGCHLD, wait_for_child_ev, NULL);
-	// Listen socket. Waiting for new connections
-	faux_eloop_add_fd(eloop, listen_unix_sock, POLLIN,
-		listen_socket_ev, &client_fd);
+	faux_eloop_add_signal(eloop, SIGHUP, refresh_config_ev, &listener);
+	faux_eloop_add_signal(eloop, SIGCHLD, wait_for_child_ev, &listener);
+	// Service processes serving many sessions each. They accept
+	// connections concurrently so accept() must not block.
+	if (opts->service_processes > 0) {
+		listener.multi = BOOL_TRUE;
+		listener.pool_size = opts->service_processes;
+		fcntl(listen_unix_sock, F_SETFL,
+			fcntl(listen_unix_sock, F_GETFL) | O_NONBLOCK);
+	// Pool of pre-forked service processes
+	} else if (opts->service_pool > 0) {
+		if (pipe2(listener.notify_fd, O_CLOEXEC) < 0) {
+			syslog(LOG_ERR, "Can't create service pool: %s",
+				strerror(errno));
+		} else {
+			listener.pool_size = opts->service_pool;
+			faux_eloop_add_fd(eloop, listener.notify_fd[0], POLLIN,
+				pool_ev, &listener);
+		}
+	}
+	if (listener.pool_size > 0) {
+		listener.pool = faux_zmalloc(listener.pool_size *
+			sizeof(*listener.pool));
+		assert(listener.pool);
+	}
 	// Scheduled events
 //	faux_eloop_add_sched_once_delayed(eloop, &delayed, 1, sched_once, NULL);
 //	faux_eloop_add_sched_periodic_delayed(eloop, 2, sched_periodic, NULL, &period, FAUX_SCHED_INFINITE);
-	// Main loop
-	faux_eloop_loop(eloop);
+	// Main loop. Pre-forked service process doesn't run it.
+	if (pool_fill(&listener))
+		faux_eloop_loop(eloop);
 	faux_eloop_free(eloop);
+	client_fd = listener.client_fd;
+	// Scheme can be reloaded
+	scheme = listener.scheme;
+	config = listener.config;
 
 	retval = 0;
 
@@ -160,12 +260,20 @@ err: // For listen daemon
 		faux_error_show(error);
 	faux_error_free(error);
 
-	// Close listen socket
-	if (listen_unix_sock >= 0)
+	// Close listen socket. Pre-forked service process closes it later
+	// after accept().
+	if ((listen_unix_sock >= 0) && !listener.warm)
 		close(listen_unix_sock);
 
 	// Finish listen daemon if it's not forked service process.
-	if (client_fd < 0) {
+	if ((client_fd < 0) && !listener.warm) {
+
+		// Idle service processes get SIGTERM on parent's exit
+		faux_free(listener.pool);
+		if (listener.notify_fd[0] >= 0) {
+			close(listener.notify_fd[0]);
+			close(listener.notify_fd[1]);
+		}
 
 		// Free scheme
 		clear_scheme(scheme, error);
@@ -200,16 +308,6 @@ err: // For listen daemon
 	// Create event loop
 	eloop = faux_eloop_new(NULL);
 
-	// Create KTP session
-	// Function ktpd_session_new() will add new events to eloop itself.
-	ktpd_session = ktpd_session_new(client_fd, scheme, NULL, eloop);
-	if (!ktpd_session) {
-		syslog(LOG_ERR, "Can't create KTPd session");
-		goto err_client;
-	}
-
-	syslog(LOG_DEBUG, "New connection %d", client_fd);
-
 	// Signals
 	faux_eloop_add_signal(eloop, SIGINT, stop_loop_ev, NULL);
 	faux_eloop_add_signal(eloop, SIGTERM, stop_loop_ev, NULL);
@@ -223,6 +321,33 @@ err: // For listen daemon
 	sig_act.sa_handler = &signal_handler_empty;
 	sigaction(SIGPIPE, &sig_act, NULL);
 
+	faux_free(listener.pool);
+
+	// Service process serves many sessions
+	if (listener.warm && listener.multi) {
+		if (service_loop(listener.listen_fd, scheme, opts, eloop,
+			listener.parent_pid))
+			retval = 0;
+		close(listener.listen_fd);
+		goto err_client;
+	}
+
+	// Pre-forked service process is ready. Wait for the client.
+	if (listener.warm) {
+		client_fd = pool_accept(&listener);
+		if (client_fd < 0)
+			goto err_client;
+	} else if (listener.notify_fd[0] >= 0) {
+		close(listener.notify_fd[0]);
+		close(listener.notify_fd[1]);
+	}
+
+	// Create KTP session
+	// Function ktpd_session_new() will add new events to eloop itself.
+	ktpd_session = service_session_new(client_fd, scheme, eloop, opts, NULL);
+	if (!ktpd_session)
+		goto err_client;
+
 	// Main service loop
 	faux_eloop_loop(eloop);
 
@@ -231,8 +356,10 @@ err_client:
 
 	ktpd_session_free(ktpd_session);
 	faux_eloop_free(eloop);
-	syslog(LOG_DEBUG, "Close connection %d", client_fd);
-	close(client_fd);
+	if (client_fd >= 0) {
+		syslog(LOG_DEBUG, "Close connection %d", client_fd);
+		close(client_fd);
+	}
 
 	// Free scheme
 	clear_scheme(scheme, error);
@@ -440,6 +567,80 @@ static bool_t clear_scheme(kscheme_t *scheme, faux_error_t *error)
 }
 
 
+// Sync ACTIONs are executed within session process. Symbols those are sync
+// by their nature (navigation, PTYPEs of klish plugin etc.) return quickly.
+// But any symbol can be made sync by ACTION's "sync" attribute. Such ACTION
+// (a script for example) blocks the process while it's running. PROMPT and
+// LOG ACTIONs are waited by nested eloop so async ones block the process
+// too. Async PTYPE, COMPLETION and HELP ACTIONs suspend the request instead.
+static bool_t check_shared_entry(const kentry_t *entry, faux_error_t *error)
+{
+	kentry_actions_node_t *aiter = NULL;
+	kentry_entrys_node_t *eiter = NULL;
+	const kaction_t *action = NULL;
+	const kentry_t *nested = NULL;
+	bool_t retcode = BOOL_TRUE;
+	kentry_purpose_e purpose = kentry_purpose(entry);
+
+	// Link's nested ENTRYs are checked within original ENTRY
+	if (kentry_ref_str(entry))
+		return BOOL_TRUE;
+
+	aiter = kentry_actions_iter(entry);
+	while ((action = kentry_actions_each(&aiter))) {
+		const ksym_t *sym = kaction_sym(action);
+		if (!sym)
+			continue;
+		if ((ksym_sync(sym) == KSYM_USERDEFINED_SYNC) &&
+			kaction_is_sync(action)) {
+			faux_error_sprintf(error, "ENTRY \"%s\": Sync ACTION "
+				"\"%s\" blocks other sessions",
+				kentry_name(entry), kaction_sym_ref(action));
+			retcode = BOOL_FALSE;
+		}
+		if (((KENTRY_PURPOSE_PROMPT == purpose) ||
+			(KENTRY_PURPOSE_LOG == purpose)) &&
+			!kaction_is_sync(action)) {
+			faux_error_sprintf(error, "ENTRY \"%s\": Async ACTION "
+				"\"%s\" of PROMPT or LOG blocks other sessions",
+				kentry_name(entry), kaction_sym_ref(action));
+			retcode = BOOL_FALSE;
+		}
+	}
+
+	eiter = kentry_entrys_iter(entry);
+	while ((nested = kentry_entrys_each(&eiter))) {
+		if (!check_shared_entry(nested, error))
+			retcode = BOOL_FALSE;
+	}
+
+	return retcode;
+}
+
+
+/** @brief Checks that scheme doesn't block shared service process.
+ *
+ * Service process of ServiceProcesses mode serves many sessions within
+ * single eloop. ACTIONs those are executed within the process and can run
+ * long time are not allowed.
+ */
+static bool_t check_shared_scheme(const kscheme_t *scheme,
+	faux_error_t *error)
+{
+	kscheme_entrys_node_t *iter = NULL;
+	const kentry_t *entry = NULL;
+	bool_t retcode = BOOL_TRUE;
+
+	iter = kscheme_entrys_iter(scheme);
+	while ((entry = kscheme_entrys_each(&iter))) {
+		if (!check_shared_entry(entry, error))
+			retcode = BOOL_FALSE;
+	}
+
+	return retcode;
+}
+
+
 /** @brief Create listen socket
  *
  * Previously removes old socket's file from filesystem. Note daemon must check
@@ -458,7 +659,7 @@ static int create_listen_unix_sock(const char *path, const struct options *opts)
 	if (!path)
 		return -1;
 
-	if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+	if ((sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1) {
 		syslog(LOG_ERR, "Can't create socket: %s", strerror(errno));
 		goto err;
 	}
@@ -534,9 +735,29 @@ static bool_t wait_for_child_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 {
 	int wstatus = 0;
 	pid_t child_pid = -1;
+	listener_t *listener = (listener_t *)user_data;
 
 	// Wait for any child process. Doesn't block.
 	while ((child_pid = waitpid(-1, &wstatus, WNOHANG)) > 0) {
+		size_t i = 0;
+		// Pool process can't exit normally. Don't replace it
+		// immediately to don't fork broken processes in a loop. The
+		// listen daemon accepts connections itself while pool is empty.
+		for (i = 0; i < listener->pool_idle; i++) {
+			if (listener->pool[i] != child_pid)
+				continue;
+			listener->pool[i] = listener->pool[--listener->pool_idle];
+			syslog(LOG_WARNING, "Pool service process %d is lost",
+				child_pid);
+			if (!listener->refill_ev) {
+				struct timespec delay = { 1, 0 };
+				listener->refill_ev =
+					faux_eloop_add_sched_once_delayed(
+					eloop, &delay, 0, pool_refill_ev,
+					listener);
+			}
+			break;
+		}
 		if (WIFSIGNALED(wstatus)) {
 			syslog(LOG_ERR, "Service process %d was terminated "
 				"by signal: %d",
@@ -546,43 +767,102 @@ static bool_t wait_for_child_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 				child_pid, WEXITSTATUS(wstatus));
 		}
 	}
+	listener_watch(listener);
 
 	// Happy compiler
 	eloop = eloop;
 	type = type;
 	associated_data = associated_data;
-	user_data = user_data;
 
 	return BOOL_TRUE;
 }
 
 
-/** @brief Re-read config file.
+/** @brief Re-read config file and reload scheme.
  *
- * This function can refresh klishd options but plugins (dbs for example) are
- * already inited and there is no way to re-init them on-the-fly.
+ * New scheme is loaded and prepared while old one is still used. Then
+ * service processes forked after reload get the new scheme. Existing sessions
+ * keep the old one. The old scheme is kept if new one has errors.
  */
 static bool_t refresh_config_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data)
 {
-	struct options *opts = (struct options *)user_data;
+	listener_t *listener = (listener_t *)user_data;
+	struct options *opts = listener->opts;
 	faux_ini_t *ini = NULL;
+	kscheme_t *scheme = NULL;
+	faux_error_t *error = NULL;
+	struct timespec start = {};
+	struct timespec stop = {};
+	long int msec = 0;
+
+	// Happy compiler
+	eloop = eloop;
+	type = type;
+	associated_data = associated_data;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
 
 	if (access(opts->cfgfile, R_OK) == 0) {
 		syslog(LOG_DEBUG, "Re-reading config file \"%s\"", opts->cfgfile);
-		if (!(ini = config_parse(opts->cfgfile, opts)))
-			syslog(LOG_ERR, "Error while config file parsing");
+		if (!(ini = config_parse(opts->cfgfile, opts))) {
+			syslog(LOG_ERR, "Error while config file parsing. "
+				"Scheme is not reloaded");
+			return BOOL_TRUE;
+		}
 	} else if (opts->cfgfile_userdefined) {
-		syslog(LOG_ERR, "Can't find config file \"%s\"", opts->cfgfile);
+		syslog(LOG_ERR, "Can't find config file \"%s\". "
+			"Scheme is not reloaded", opts->cfgfile);
+		return BOOL_TRUE;
 	}
-	faux_ini_free(ini); // No way to use it later
 
-	// Happy compiler
-	eloop = eloop;
-	type = type;
-	associated_data = associated_data;
+	// Load new scheme
+	syslog(LOG_INFO, "Reload scheme");
+	error = faux_error_new();
+	scheme = load_all_dbs(opts->dbs, ini, error);
+	if (!scheme) {
+		faux_error_node_t *iter = faux_error_iter(error);
+		const char *err = NULL;
+		while ((err = faux_error_each(&iter)))
+			syslog(LOG_ERR, "Scheme: %s", err);
+		syslog(LOG_ERR, "Can't reload scheme. Old scheme is used");
+		faux_error_free(error);
+		faux_ini_free(ini);
+		return BOOL_TRUE;
+	}
 
-	return BOOL_TRUE;
+	if (listener->multi && !check_shared_scheme(scheme, error)) {
+		faux_error_node_t *iter = faux_error_iter(error);
+		const char *err = NULL;
+		while ((err = faux_error_each(&iter)))
+			syslog(LOG_ERR, "Scheme: %s", err);
+		syslog(LOG_ERR, "Scheme can't be used with ServiceProcesses. "
+			"Old scheme is used");
+		faux_error_reset(error);
+		clear_scheme(scheme, error);
+		faux_error_free(error);
+		faux_ini_free(ini);
+		return BOOL_TRUE;
+	}
+
+	// Switch to new scheme. Forked service processes have their own
+	// copies of old scheme so it can be freed.
+	faux_error_reset(error);
+	clear_scheme(listener->scheme, error);
+	faux_error_free(error);
+	listener->scheme = scheme;
+	faux_ini_free(listener->config);
+	listener->config = ini;
+
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	msec = (stop.tv_sec - start.tv_sec) * 1000 +
+		(stop.tv_nsec - start.tv_nsec) / 1000000;
+	syslog(LOG_INFO, "Scheme is reloaded in %ld ms", msec);
+
+	// Pre-forked service processes have old scheme
+	pool_restart(listener);
+
+	return pool_fill(listener);
 }
 
 
@@ -594,10 +874,11 @@ static bool_t listen_socket_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	int new_conn = -1;
 	faux_eloop_info_fd_t *info = (faux_eloop_info_fd_t *)associated_data;
 	pid_t child_pid = -1;
+	listener_t *listener = (listener_t *)user_data;
 
-	assert(user_data);
+	assert(listener);
 
-	new_conn = accept(info->fd, NULL, NULL);
+	new_conn = accept4(info->fd, NULL, NULL, SOCK_CLOEXEC);
 	if (new_conn < 0) {
 		syslog(LOG_ERR, "Can't accept() new connection");
 		return BOOL_TRUE;
@@ -616,13 +897,14 @@ static bool_t listen_socket_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 		close(new_conn); // It's needed by child but not for parent
 		syslog(LOG_INFO, "Service process for client was forked: %d",
 			child_pid);
-		return BOOL_TRUE;
+		// Pool is empty if listen daemon accepts connections itself
+		return pool_fill(listener);
 	}
 
 	// Child (forked service process)
 
 	// Pass new ktpd_session to main programm
-	*((int *)user_data) = new_conn;
+	listener->client_fd = new_conn;
 
 	type = type; // Happy compiler
 	eloop = eloop;
@@ -633,6 +915,414 @@ static bool_t listen_socket_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 }
 
 
+/** @brief Listen daemon accepts connections itself only when there are no
+ * idle pre-forked service processes.
+ *
+ * Both listen daemon and idle service processes can't wait on the same listen
+ * socket. Blocking accept() of listen daemon can hang else.
+ */
+static void listener_watch(listener_t *listener)
+{
+	bool_t listen = (listener->pool_idle == 0) ? BOOL_TRUE : BOOL_FALSE;
+
+	if (listen == listener->listening)
+		return;
+	if (listen)
+		faux_eloop_add_fd(listener->eloop, listener->listen_fd, POLLIN,
+			listen_socket_ev, listener);
+	else
+		faux_eloop_del_fd(listener->eloop, listener->listen_fd);
+	listener->listening = listen;
+}
+
+
+/** @brief Fork idle service processes to fill the pool.
+ *
+ * @return BOOL_FALSE within forked service process. So event handler can
+ * break the listen daemon's loop.
+ */
+static bool_t pool_fill(listener_t *listener)
+{
+	while (listener->pool_idle < listener->pool_size) {
+		pid_t child_pid = fork();
+
+		if (child_pid < 0) {
+			syslog(LOG_ERR, "Can't fork idle service process: %s",
+				strerror(errno));
+			break;
+		}
+
+		// Child (pre-forked service process)
+		if (0 == child_pid) {
+			listener->warm = BOOL_TRUE;
+			return BOOL_FALSE;
+		}
+
+		// Parent
+		listener->pool[listener->pool_idle++] = child_pid;
+		syslog(LOG_DEBUG, "Idle service process was forked: %d",
+			child_pid);
+	}
+
+	listener_watch(listener);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Pre-forked service process waits for new connection.
+ *
+ * The listen daemon is notified to fork replacement process.
+ */
+static int pool_accept(listener_t *listener)
+{
+	int fd = -1;
+	pid_t pid = getpid();
+	struct sigaction sig_act = {};
+
+	// Listen daemon sends SIGHUP when scheme is reloaded. Then process
+	// with old scheme stops waiting. The accept() is not restarted.
+	// Already accepted connection is served with old scheme.
+	sigemptyset(&sig_act.sa_mask);
+	sig_act.sa_flags = 0;
+	sig_act.sa_handler = &signal_handler_empty;
+	sigaction(SIGHUP, &sig_act, NULL);
+
+	// Don't outlive listen daemon while waiting
+	prctl(PR_SET_PDEATHSIG, SIGTERM);
+	if (getppid() == listener->parent_pid) {
+		fd = accept4(listener->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (EINTR == errno)
+				syslog(LOG_DEBUG, "Scheme is reloaded. "
+					"Idle service process exits");
+			else
+				syslog(LOG_ERR, "Can't accept() new "
+					"connection: %s", strerror(errno));
+		}
+	}
+	prctl(PR_SET_PDEATHSIG, 0);
+
+	// Report even on error. Else listen daemon will not replace process.
+	if (write(listener->notify_fd[1], &pid, sizeof(pid)) < 0)
+		syslog(LOG_WARNING, "Can't notify listen daemon: %s",
+			strerror(errno));
+	close(listener->notify_fd[0]);
+	close(listener->notify_fd[1]);
+	close(listener->listen_fd);
+
+	return fd;
+}
+
+
+/** @brief Retires pool processes those have old scheme.
+ *
+ * Idle service processes stop waiting for connection and exit. Multi-session
+ * service processes stop accepting connections and exit when their sessions
+ * are finished. Listen daemon forgets them and fills the pool again.
+ */
+static void pool_restart(listener_t *listener)
+{
+	size_t i = 0;
+
+	for (i = 0; i < listener->pool_idle; i++)
+		kill(listener->pool[i], SIGHUP);
+	listener->pool_idle = 0;
+}
+
+
+/** @brief Idle service processes report accepted connections.
+ */
+static bool_t pool_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	faux_eloop_info_fd_t *info = (faux_eloop_info_fd_t *)associated_data;
+	listener_t *listener = (listener_t *)user_data;
+	pid_t pids[16] = {};
+	ssize_t r = 0;
+	size_t n = 0;
+
+	assert(listener);
+
+	// PID is less than PIPE_BUF so it's atomic
+	r = read(info->fd, pids, sizeof(pids));
+	if (r < 0)
+		return BOOL_TRUE;
+	for (n = 0; n < (size_t)r / sizeof(pids[0]); n++) {
+		size_t i = 0;
+		for (i = 0; i < listener->pool_idle; i++) {
+			if (listener->pool[i] != pids[n])
+				continue;
+			listener->pool[i] = listener->pool[--listener->pool_idle];
+			break;
+		}
+	}
+
+	// Happy compiler
+	eloop = eloop;
+	type = type;
+
+	// Fork replacements
+	return pool_fill(listener);
+}
+
+
+/** @brief Replaces lost pool processes.
+ */
+static bool_t pool_refill_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	listener_t *listener = (listener_t *)user_data;
+
+	// Event is freed by eloop after execution
+	listener->refill_ev = NULL;
+
+	// Happy compiler
+	eloop = eloop;
+	type = type;
+	associated_data = associated_data;
+
+	return pool_fill(listener);
+}
+
+
+/** @brief Creates KTP session for new connection.
+ *
+ * Session of multi-session service process shares eloop with other sessions.
+ */
+static ktpd_session_t *service_session_new(int fd, kscheme_t *scheme,
+	faux_eloop_t *eloop, const struct options *opts, service_t *service)
+{
+	ktpd_session_t *ktpd = NULL;
+
+	// Function ktpd_session_new() will add new events to eloop itself.
+	if (service)
+		ktpd = ktpd_session_new_shared(fd, scheme, NULL, eloop,
+			service_close_cb, service);
+	else
+		ktpd = ktpd_session_new(fd, scheme, NULL, eloop);
+	if (!ktpd) {
+		syslog(LOG_ERR, "Can't create KTPd session");
+		return NULL;
+	}
+
+	syslog(LOG_DEBUG, "New connection %d", fd);
+
+	// Pool of pre-forked action workers
+	if (opts->action_workers > 0) {
+		if (!ktpd_session_set_workers(ktpd,
+			opts->action_workers,
+			opts->action_workers_idle_timeout))
+			syslog(LOG_WARNING, "Can't create action workers");
+	}
+
+	// Named locks
+	ktpd_session_set_lockfile(ktpd, opts->lockfile);
+
+	// Output coalescing
+	ktpd_session_set_coalesce(ktpd, opts->output_coalesce_bytes,
+		opts->output_coalesce_delay);
+
+	return ktpd;
+}
+
+
+/** @brief Frees session of multi-session service process and its connection.
+ */
+static void service_session_free(void *data)
+{
+	ktpd_session_t *ktpd = (ktpd_session_t *)data;
+	int fd = ktpd_session_fd(ktpd);
+
+	ktpd_session_free(ktpd);
+	syslog(LOG_DEBUG, "Close connection %d", fd);
+	close(fd);
+}
+
+
+/** @brief Multi-session service process gets new connection.
+ *
+ * Another service process can get the same connection first so EAGAIN is
+ * not an error.
+ */
+static bool_t service_accept_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	faux_eloop_info_fd_t *info = (faux_eloop_info_fd_t *)associated_data;
+	service_t *service = (service_t *)user_data;
+	ktpd_session_t *ktpd = NULL;
+	int fd = -1;
+
+	fd = accept4(info->fd, NULL, NULL, SOCK_CLOEXEC);
+	if (fd < 0) {
+		if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+			syslog(LOG_ERR, "Can't accept() new connection: %s",
+				strerror(errno));
+		return BOOL_TRUE;
+	}
+
+	ktpd = service_session_new(fd, service->scheme, service->eloop,
+		service->opts, service);
+	if (!ktpd) {
+		close(fd);
+		return BOOL_TRUE;
+	}
+	faux_list_add(service->sessions, ktpd);
+
+	// Happy compiler
+	eloop = eloop;
+	type = type;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Frees finished sessions.
+ */
+static bool_t service_gc_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	service_t *service = (service_t *)user_data;
+
+	// Event is freed by eloop after execution
+	service->gc_ev = NULL;
+	faux_list_del_all(service->closed);
+
+	// Happy compiler
+	eloop = eloop;
+	type = type;
+	associated_data = associated_data;
+
+	// Retired process exits after the last session
+	if (service->retired && (faux_list_len(service->sessions) == 0))
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Listen daemon has reloaded scheme or exited.
+ *
+ * Process with old scheme doesn't accept new connections. It exits when its
+ * sessions are finished.
+ */
+static bool_t service_retire_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	service_t *service = (service_t *)user_data;
+
+	if (!service->retired) {
+		faux_eloop_del_fd(eloop, service->listen_fd);
+		service->retired = BOOL_TRUE;
+		syslog(LOG_DEBUG, "Service process doesn't accept new "
+			"connections");
+	}
+
+	// Happy compiler
+	type = type;
+	associated_data = associated_data;
+
+	return (faux_list_len(service->sessions) > 0) ? BOOL_TRUE : BOOL_FALSE;
+}
+
+
+/** @brief Session is finished.
+ *
+ * Session's eloop handler is in progress now so free session later.
+ */
+static void service_close_cb(ktpd_session_t *ktpd, void *user_data)
+{
+	service_t *service = (service_t *)user_data;
+	faux_list_node_t *iter = NULL;
+	faux_list_node_t *node = NULL;
+
+	iter = faux_list_head(service->sessions);
+	while ((node = faux_list_each_node(&iter))) {
+		if (faux_list_data(node) != ktpd)
+			continue;
+		faux_list_takeaway(service->sessions, node);
+		faux_list_add(service->closed, ktpd);
+		break;
+	}
+
+	if (!service->gc_ev) {
+		struct timespec now = {};
+		service->gc_ev = faux_eloop_add_sched_once_delayed(
+			service->eloop, &now, 0, service_gc_ev, service);
+	}
+}
+
+
+/** @brief Multi-session service process waits for ACTION processes.
+ *
+ * Terminated process can belong to any session.
+ */
+static bool_t service_child_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	service_t *service = (service_t *)user_data;
+	int wstatus = 0;
+	pid_t child_pid = -1;
+
+	// Wait for any child process. Doesn't block.
+	while ((child_pid = waitpid(-1, &wstatus, WNOHANG)) > 0) {
+		faux_list_node_t *iter = faux_list_head(service->sessions);
+		ktpd_session_t *ktpd = NULL;
+		while ((ktpd = (ktpd_session_t *)faux_list_each(&iter)))
+			ktpd_session_child_exited(ktpd, child_pid, wstatus);
+	}
+
+	// Happy compiler
+	eloop = eloop;
+	type = type;
+	associated_data = associated_data;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Main loop of multi-session service process.
+ *
+ * Sessions are isolated within their own ksession_t objects but share scheme
+ * and eloop. Only ACTIONs are forked.
+ */
+static bool_t service_loop(int listen_fd, kscheme_t *scheme,
+	const struct options *opts, faux_eloop_t *eloop, pid_t parent_pid)
+{
+	service_t service = {};
+
+	service.eloop = eloop;
+	service.scheme = scheme;
+	service.opts = opts;
+	service.sessions = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, service_session_free);
+	service.closed = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, service_session_free);
+	service.gc_ev = NULL;
+	service.listen_fd = listen_fd;
+	service.retired = BOOL_FALSE;
+
+	faux_eloop_add_signal(eloop, SIGCHLD, service_child_ev, &service);
+	faux_eloop_add_signal(eloop, SIGHUP, service_retire_ev, &service);
+	faux_eloop_add_fd(eloop, listen_fd, POLLIN, service_accept_ev,
+		&service);
+	syslog(LOG_DEBUG, "Multi-session service process is started");
+
+	// Retire like on scheme reload when listen daemon exits
+	prctl(PR_SET_PDEATHSIG, SIGHUP);
+	if (getppid() == parent_pid)
+		faux_eloop_loop(eloop);
+
+	faux_eloop_del_fd(eloop, listen_fd);
+	if (service.gc_ev)
+		faux_eloop_del_sched(eloop, service.gc_ev);
+	faux_list_free(service.closed);
+	faux_list_free(service.sessions);
+
+	return BOOL_TRUE;
+}
+
+
 static void signal_handler_empty(int signo)
 {
 	signo = signo; // Happy compiler
@@ -20,6 +20,8 @@
 #include <faux/conv.h>
 
 #include <klish/ktp_session.h>
+#include <klish/kworkers.h>
+#include <klish/klock.h>
 
 #include "private.h"
 
@@ -43,6 +45,13 @@ struct options *opts_init(void)
 	opts->verbose = BOOL_FALSE;
 	opts->log_facility = LOG_DAEMON;
 	opts->dbs = faux_str_dup(DEFAULT_DBS);
+	opts->lockfile = faux_str_dup(KLOCK_DEFAULT_PATH);
+	opts->action_workers = 0; // Fork per ACTION by default
+	opts->action_workers_idle_timeout = KWORKERS_DEFAULT_IDLE_TIMEOUT;
+	opts->output_coalesce_bytes = KTPD_COALESCE_DEFAULT_BYTES;
+	opts->output_coalesce_delay = KTPD_COALESCE_DEFAULT_DELAY;
+	opts->service_pool = 0; // Fork service process on connect by default
+	opts->service_processes = 0; // Process per session by default
 
 	return opts;
 }
@@ -57,6 +66,7 @@ void opts_free(struct options *opts)
 	faux_str_free(opts->unix_socket_path);
 	faux_str_free(opts->socket_group);
 	faux_str_free(opts->dbs);
+	faux_str_free(opts->lockfile);
 	faux_free(opts);
 }
 
@@ -195,6 +205,53 @@ faux_ini_t *config_parse(const char *cfgfile, struct options *opts)
 		opts->dbs = faux_str_dup(tmp);
 	}
 
+	// LockFile
+	if ((tmp = faux_ini_find(ini, "LockFile"))) {
+		faux_str_free(opts->lockfile);
+		opts->lockfile = faux_str_dup(tmp);
+	}
+
+	// ActionWorkers
+	if ((tmp = faux_ini_find(ini, "ActionWorkers"))) {
+		if (!faux_conv_atoui(tmp, &opts->action_workers, 0))
+			syslog(LOG_ERR, "Illegal ActionWorkers value: %s", tmp);
+	}
+
+	// ActionWorkersIdleTimeout
+	if ((tmp = faux_ini_find(ini, "ActionWorkersIdleTimeout"))) {
+		if (!faux_conv_atoui(tmp,
+			&opts->action_workers_idle_timeout, 0))
+			syslog(LOG_ERR, "Illegal ActionWorkersIdleTimeout value: %s",
+				tmp);
+	}
+
+	// OutputCoalesceBytes
+	if ((tmp = faux_ini_find(ini, "OutputCoalesceBytes"))) {
+		if (!faux_conv_atoui(tmp, &opts->output_coalesce_bytes, 0))
+			syslog(LOG_ERR, "Illegal OutputCoalesceBytes value: %s",
+				tmp);
+	}
+
+	// OutputCoalesceDelay
+	if ((tmp = faux_ini_find(ini, "OutputCoalesceDelay"))) {
+		if (!faux_conv_atoui(tmp, &opts->output_coalesce_delay, 0))
+			syslog(LOG_ERR, "Illegal OutputCoalesceDelay value: %s",
+				tmp);
+	}
+
+	// ServicePool
+	if ((tmp = faux_ini_find(ini, "ServicePool"))) {
+		if (!faux_conv_atoui(tmp, &opts->service_pool, 0))
+			syslog(LOG_ERR, "Illegal ServicePool value: %s", tmp);
+	}
+
+	// ServiceProcesses
+	if ((tmp = faux_ini_find(ini, "ServiceProcesses"))) {
+		if (!faux_conv_atoui(tmp, &opts->service_processes, 0))
+			syslog(LOG_ERR, "Illegal ServiceProcesses value: %s",
+				tmp);
+	}
+
 	return ini;
 }
 
@@ -215,6 +272,17 @@ int opts_show(struct options *opts)
 	syslog(LOG_DEBUG, "opts: UnixSocketPath = %s\n", opts->unix_socket_path);
 	syslog(LOG_DEBUG, "opts: SocketGroup = %s\n", opts->socket_group);
 	syslog(LOG_DEBUG, "opts: DBs = %s\n", opts->dbs);
+	syslog(LOG_DEBUG, "opts: LockFile = %s\n", opts->lockfile);
+	syslog(LOG_DEBUG, "opts: ActionWorkers = %u\n", opts->action_workers);
+	syslog(LOG_DEBUG, "opts: ActionWorkersIdleTimeout = %u\n",
+		opts->action_workers_idle_timeout);
+	syslog(LOG_DEBUG, "opts: OutputCoalesceBytes = %u\n",
+		opts->output_coalesce_bytes);
+	syslog(LOG_DEBUG, "opts: OutputCoalesceDelay = %u\n",
+		opts->output_coalesce_delay);
+	syslog(LOG_DEBUG, "opts: ServicePool = %u\n", opts->service_pool);
+	syslog(LOG_DEBUG, "opts: ServiceProcesses = %u\n",
+		opts->service_processes);
 
 	return 0;
 }
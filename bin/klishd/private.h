@@ -20,6 +20,13 @@ struct options {
 	char *unix_socket_path;
 	char *socket_group;
 	char *dbs;
+	char *lockfile; // File for named locks
+	unsigned int action_workers; // Pre-forked workers per session
+	unsigned int action_workers_idle_timeout; // Seconds
+	unsigned int output_coalesce_bytes; // 0 - no coalescing
+	unsigned int output_coalesce_delay; // Milliseconds
+	unsigned int service_pool; // Pre-forked idle service processes
+	unsigned int service_processes; // Processes serving many sessions each
 	bool_t foreground; // Don't daemonize
 	bool_t verbose;
 	int log_facility;
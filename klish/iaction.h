@@ -12,6 +12,8 @@
 typedef struct iaction_s {
 	char *sym;
 	char *lock;
+	char *lock_shared;
+	char *lock_wait;
 	char *interrupt;
 	char *in;
 	char *out;
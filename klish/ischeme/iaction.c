@@ -75,6 +75,26 @@ bool_t iaction_parse(const iaction_t *info, kaction_t *action, faux_error_t *err
 		}
 	}
 
+	// Lock_shared
+	if (!faux_str_is_empty(info->lock_shared)) {
+		bool_t b = BOOL_FALSE;
+		if (!faux_conv_str2bool(info->lock_shared, &b) ||
+			!kaction_set_lock_shared(action, b)) {
+			faux_error_add(error, TAG": Illegal 'lock_shared' attribute");
+			retcode = BOOL_FALSE;
+		}
+	}
+
+	// Lock_wait
+	if (!faux_str_is_empty(info->lock_wait)) {
+		bool_t b = BOOL_FALSE;
+		if (!faux_conv_str2bool(info->lock_wait, &b) ||
+			!kaction_set_lock_wait(action, b)) {
+			faux_error_add(error, TAG": Illegal 'lock_wait' attribute");
+			retcode = BOOL_FALSE;
+		}
+	}
+
 	// Interrupt
 	if (!faux_str_is_empty(info->interrupt)) {
 		bool_t b = BOOL_FALSE;
@@ -197,6 +217,8 @@ char *iaction_deploy(const kaction_t *kaction, int level)
 
 	attr2ctext(&str, "sym", kaction_sym_ref(kaction), level + 1);
 	attr2ctext(&str, "lock", kaction_lock(kaction), level + 1);
+	attr2ctext(&str, "lock_shared", faux_conv_bool2str(kaction_lock_shared(kaction)), level + 1);
+	attr2ctext(&str, "lock_wait", faux_conv_bool2str(kaction_lock_wait(kaction)), level + 1);
 	attr2ctext(&str, "interrupt", faux_conv_bool2str(kaction_interrupt(kaction)), level + 1);
 	attr2ctext(&str, "in", kaction_io_e_enum2str(kaction_in(kaction)), level + 1);
 	attr2ctext(&str, "out", kaction_io_e_enum2str(kaction_out(kaction)), level + 1);
@@ -40,6 +40,10 @@ bool_t kaction_set_sym_ref(kaction_t *action, const char *sym_ref);
 
 const char *kaction_lock(const kaction_t *action);
 bool_t kaction_set_lock(kaction_t *action, const char *lock);
+bool_t kaction_lock_shared(const kaction_t *action);
+bool_t kaction_set_lock_shared(kaction_t *action, bool_t lock_shared);
+bool_t kaction_lock_wait(const kaction_t *action);
+bool_t kaction_set_lock_wait(kaction_t *action, bool_t lock_wait);
 
 bool_t kaction_interrupt(const kaction_t *action);
 bool_t kaction_set_interrupt(kaction_t *action, bool_t interrupt);
@@ -59,6 +63,9 @@ bool_t kaction_set_update_retcode(kaction_t *action, bool_t update_retcode);
 
 const char *kaction_script(const kaction_t *action);
 bool_t kaction_set_script(kaction_t *action, const char *script);
+const void *kaction_prepared(const kaction_t *action);
+bool_t kaction_set_prepared(kaction_t *action, void *prepared,
+	ksym_prepared_free_fn prepared_free);
 
 ksym_t *kaction_sym(const kaction_t *action);
 bool_t kaction_set_sym(kaction_t *action, ksym_t *sym);
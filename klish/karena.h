@@ -0,0 +1,27 @@
+/** @file karena.h
+ *
+ * @brief Klish arena. Bump allocator for short-lived objects. All objects
+ * are freed at once with arena itself.
+ */
+
+#ifndef _klish_karena_h
+#define _klish_karena_h
+
+#include <faux/faux.h>
+
+#define KARENA_DEFAULT_CHUNK_SIZE 4096
+
+
+typedef struct karena_s karena_t;
+
+C_DECL_BEGIN
+
+karena_t *karena_new(size_t chunk_size);
+void karena_free(karena_t *arena);
+
+void *karena_alloc(karena_t *arena, size_t size);
+char *karena_strdup(karena_t *arena, const char *str);
+
+C_DECL_END
+
+#endif // _klish_karena_h
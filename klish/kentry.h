@@ -11,6 +11,8 @@
 #include <klish/khotkey.h>
 
 typedef struct kentry_s kentry_t;
+typedef struct kentry_index_s kentry_index_t;
+typedef struct kentry_map_s kentry_map_t;
 
 typedef faux_list_node_t kentry_entrys_node_t;
 typedef faux_list_node_t kentry_actions_node_t;
@@ -53,6 +55,14 @@ typedef enum {
 
 typedef bool_t (*kentry_udata_free_fn)(void *data);
 
+// Iterator of nested ENTRYs that are candidates to match argument
+typedef struct {
+	const char *arg;
+	size_t keyword; // Next slot within keyword chain
+	size_t fallback; // Next slot within non-keyword chain
+	size_t current; // Position of last candidate within COMMON ENTRYs
+} kentry_index_iter_t;
+
 
 C_DECL_BEGIN
 
@@ -99,6 +109,10 @@ bool_t kentry_set_order(kentry_t *entry, bool_t order);
 // Filter
 kentry_filter_e kentry_filter(const kentry_t *entry);
 bool_t kentry_set_filter(kentry_t *entry, kentry_filter_e filter);
+// Keyword
+ksym_keyword_e kentry_keyword(const kentry_t *entry);
+bool_t kentry_set_keyword(kentry_t *entry, ksym_keyword_e keyword);
+bool_t kentry_keyword_match(const kentry_t *entry, const char *arg);
 // User data
 void *kentry_udata(const kentry_t *entry);
 bool_t kentry_set_udata(kentry_t *entry, void *data, kentry_udata_free_fn udata_free_fn);
@@ -107,6 +121,8 @@ bool_t kentry_set_udata(kentry_t *entry, void *data, kentry_udata_free_fn udata_
 faux_list_t *kentry_entrys(const kentry_t *entry);
 bool_t kentry_add_entrys(kentry_t *entry, kentry_t *nested_entry);
 kentry_t *kentry_find_entry(const kentry_t *entry, const char *name);
+kentry_t *kentry_find_entry_by_len(const kentry_t *entry, const char *name,
+	size_t len);
 ssize_t kentry_entrys_len(const kentry_t *entry);
 bool_t kentry_entrys_is_empty(const kentry_t *entry);
 kentry_entrys_node_t *kentry_entrys_iter(const kentry_t *entry);
@@ -134,6 +150,20 @@ kentry_t *kentry_nested_by_purpose(const kentry_t *entry, kentry_purpose_e purpo
 bool_t kentry_set_nested_by_purpose(kentry_t *entry, kentry_purpose_e purpose,
 	kentry_t *nested);
 
+// Keyword index of nested ENTRYs
+bool_t kentry_build_index(kentry_t *entry);
+bool_t kentry_index_iter(const kentry_t *entry, const char *arg,
+	kentry_index_iter_t *iter);
+const kentry_t *kentry_index_each(const kentry_t *entry,
+	kentry_index_iter_t *iter);
+
+// ENTRY map (string key -> ENTRY)
+kentry_map_t *kentry_map_new(bool_t own_keys);
+void kentry_map_free(kentry_map_t *map);
+bool_t kentry_map_add(kentry_map_t *map, const char *key, kentry_t *entry);
+kentry_t *kentry_map_find(const kentry_map_t *map, const char *key, size_t len);
+ssize_t kentry_map_len(const kentry_map_t *map);
+
 C_DECL_END
 
 #endif // _klish_kentry_h
@@ -59,10 +59,15 @@ kexec_contexts_node_t *kexec_contexts_iter(const kexec_t *exec);
 kcontext_t *kexec_contexts_each(kexec_contexts_node_t **iter);
 
 bool_t kexec_continue_command_execution(kexec_t *exec, pid_t pid, int wstatus);
+int kexec_feed_fd(const kexec_t *exec);
+bool_t kexec_feed(kexec_t *exec);
 bool_t kexec_exec(kexec_t *exec);
 bool_t kexec_need_stdin(const kexec_t *exec);
 bool_t kexec_interactive(const kexec_t *exec);
 bool_t kexec_set_winsize(kexec_t *exec);
+bool_t kexec_filter_stdout(kexec_t *exec, bool_t final);
+bool_t kexec_filtered(const kexec_t *exec);
+faux_buf_t *kexec_bufraw(const kexec_t *exec);
 const kaction_t *kexec_current_action(const kexec_t *exec);
 
 C_DECL_END
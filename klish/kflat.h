@@ -0,0 +1,49 @@
+/** @file kflat.h
+ *
+ * @brief Compiled (flattened) read-only form of prepared scheme's ENTRYs.
+ * It's used by parser instead of ENTRY tree.
+ */
+
+#ifndef _klish_kflat_h
+#define _klish_kflat_h
+
+#include <faux/list.h>
+#include <klish/kentry.h>
+
+
+typedef struct kflat_s kflat_t;
+typedef struct kflat_node_s kflat_node_t;
+
+// Compiled ENTRY. All nodes are stored within single array. Fields are
+// read-only copies of ENTRY's fields with all references resolved.
+struct kflat_node_s {
+	const kentry_t *entry; // Original ENTRY
+	const char *name; // Interned name
+	const kflat_node_t **children; // Nested COMMON ENTRYs in declaration order
+	size_t children_num;
+	const kflat_node_t *ptype; // Nested PTYPE ENTRY
+	size_t min;
+	size_t max;
+	kentry_mode_e mode;
+	kentry_purpose_e purpose;
+	kentry_filter_e filter;
+	ksym_keyword_e keyword;
+	bool_t container;
+	bool_t order;
+	bool_t has_actions; // ENTRY is a command
+	bool_t pure_ptype; // PTYPE result depends on value only (see ksym_pure)
+};
+
+
+C_DECL_BEGIN
+
+kflat_t *kflat_new(faux_list_t *entrys);
+void kflat_free(kflat_t *flat);
+
+size_t kflat_nodes_num(const kflat_t *flat);
+const kflat_node_t *kflat_find_node(const kflat_t *flat,
+	const kentry_t *entry);
+
+C_DECL_END
+
+#endif // _klish_kflat_h
@@ -0,0 +1,49 @@
+/** @file kjournal.h
+ *
+ * @brief Klish journal of service ACTIONs. Request (parsing, completion,
+ * help) that executes service ACTIONs can be suspended while ACTION is
+ * executed and then processed again from the beginning. The journal keeps
+ * results of already executed service ACTIONs so the next attempt gets them
+ * without execution.
+ *
+ * Each attempt replays all previous records so request with N suspensions
+ * costs O(N^2) replayed records. The number of suspensions is limited by
+ * KJOURNAL_MAX_SUSPENDS. The rest of service ACTIONs of request are waited
+ * for without suspension.
+ */
+
+#ifndef _klish_kjournal_h
+#define _klish_kjournal_h
+
+#include <faux/faux.h>
+#include <klish/kcontext_base.h>
+
+// Maximum number of suspensions of single request
+#define KJOURNAL_MAX_SUSPENDS 16
+
+typedef struct kjournal_s kjournal_t;
+
+C_DECL_BEGIN
+
+kjournal_t *kjournal_new(void);
+void kjournal_free(kjournal_t *journal);
+
+bool_t kjournal_active(const kjournal_t *journal);
+void kjournal_begin(kjournal_t *journal);
+bool_t kjournal_end(kjournal_t *journal);
+void kjournal_clear(kjournal_t *journal);
+size_t kjournal_len(const kjournal_t *journal);
+bool_t kjournal_exhausted(const kjournal_t *journal);
+
+bool_t kjournal_next(kjournal_t *journal, size_t *index,
+	bool_t *ok, int *retcode, const char **out);
+bool_t kjournal_set(kjournal_t *journal, size_t index,
+	bool_t ok, int retcode, const char *out);
+
+kexec_t *kjournal_pending(const kjournal_t *journal);
+bool_t kjournal_set_pending(kjournal_t *journal, size_t index, kexec_t *exec);
+bool_t kjournal_complete(kjournal_t *journal, int retcode, const char *out);
+
+C_DECL_END
+
+#endif // _klish_kjournal_h
@@ -0,0 +1,29 @@
+/** @file klock.h
+ *
+ * @brief Klish named locks. ACTION can acquire named lock before execution.
+ * Locks are shared across all klishd service processes.
+ */
+
+#ifndef _klish_klock_h
+#define _klish_klock_h
+
+#include <sys/types.h>
+#include <faux/faux.h>
+#include <klish/kcontext_base.h>
+
+#define KLOCK_DEFAULT_PATH "/run/klish/lock"
+
+
+C_DECL_BEGIN
+
+off_t klock_offset(const char *name);
+bool_t klock_create(const char *path);
+int klock_acquire(const char *path, const char *name,
+	bool_t shared, bool_t wait);
+void klock_release(int fd);
+bool_t klock_action(const kcontext_t *context, bool_t may_wait,
+	int *lock_fd);
+
+C_DECL_END
+
+#endif // _klish_klock_h
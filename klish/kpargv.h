@@ -9,6 +9,7 @@
 #include <faux/list.h>
 #include <faux/argv.h>
 #include <klish/kentry.h>
+#include <klish/karena.h>
 
 
 typedef enum {
@@ -44,6 +45,8 @@ C_DECL_BEGIN
 // Parg
 
 kparg_t *kparg_new(const kentry_t *entry, const char *value);
+kparg_t *kparg_new_in_arena(karena_t *arena, const kentry_t *entry,
+	const char *value);
 void kparg_free(kparg_t *parg);
 
 const kentry_t *kparg_entry(const kparg_t *parg);
@@ -55,6 +58,8 @@ const char *kparg_value(const kparg_t *parg);
 kpargv_t *kpargv_new();
 void kpargv_free(kpargv_t *pargv);
 
+// Arena for pargs and parsing temporaries. Freed with pargv.
+karena_t *kpargv_arena(const kpargv_t *pargv);
 // Status
 kpargv_status_e kpargv_status(const kpargv_t *pargv);
 bool_t kpargv_set_status(kpargv_t *pargv, kpargv_status_e status);
@@ -103,6 +108,15 @@ bool_t kpargv_completions_is_empty(const kpargv_t *pargv);
 kpargv_completions_node_t *kpargv_completions_iter(const kpargv_t *pargv);
 const kentry_t *kpargv_completions_each(kpargv_completions_node_t **iter);
 
+// Packrat memo
+bool_t kpargv_memo_get(kpargv_t *pargv, const void *entry,
+	const void *pos, kpargv_status_e *status);
+bool_t kpargv_memo_set(kpargv_t *pargv, const void *entry,
+	const void *pos, kpargv_status_e status);
+size_t kpargv_memo_len(const kpargv_t *pargv);
+size_t kpargv_memo_hits(const kpargv_t *pargv);
+size_t kpargv_memo_misses(const kpargv_t *pargv);
+
 // Debug
 bool_t kpargv_debug(const kpargv_t *pargv);
 
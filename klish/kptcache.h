@@ -0,0 +1,36 @@
+/** @file kptcache.h
+ *
+ * @brief Klish PTYPE validation cache. Bounded cache of PTYPE execution
+ * results for pure PTYPEs.
+ */
+
+#ifndef _klish_kptcache_h
+#define _klish_kptcache_h
+
+#include <klish/kentry.h>
+
+#define KPTCACHE_DEFAULT_SIZE 256
+
+
+typedef struct kptcache_s kptcache_t;
+
+C_DECL_BEGIN
+
+kptcache_t *kptcache_new(size_t size);
+void kptcache_free(kptcache_t *cache);
+
+bool_t kptcache_get(kptcache_t *cache, const kentry_t *ptype,
+	const kentry_t *entry, const char *value,
+	int *retcode, const char **out);
+bool_t kptcache_set(kptcache_t *cache, const kentry_t *ptype,
+	const kentry_t *entry, const char *value,
+	int retcode, const char *out);
+void kptcache_clear(kptcache_t *cache);
+
+size_t kptcache_hits(const kptcache_t *cache);
+size_t kptcache_misses(const kptcache_t *cache);
+char *kptcache_stats(const kptcache_t *cache);
+
+C_DECL_END
+
+#endif // _klish_kptcache_h
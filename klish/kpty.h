@@ -0,0 +1,28 @@
+/** @file kpty.h
+ *
+ * @brief Klish pseudo terminal. Session keeps pseudo terminal pair alive
+ * and lends it to each command that needs terminal.
+ */
+
+#ifndef _klish_kpty_h
+#define _klish_kpty_h
+
+#include <faux/faux.h>
+
+
+typedef struct kpty_s kpty_t;
+
+C_DECL_BEGIN
+
+kpty_t *kpty_new(void);
+void kpty_free(kpty_t *pty);
+
+int kpty_ptm(const kpty_t *pty);
+int kpty_pts(const kpty_t *pty);
+const char *kpty_pts_fname(const kpty_t *pty);
+
+bool_t kpty_reset(kpty_t *pty);
+
+C_DECL_END
+
+#endif // _klish_kpty_h
@@ -9,6 +9,7 @@
 #include <faux/list.h>
 #include <klish/kplugin.h>
 #include <klish/kentry.h>
+#include <klish/kflat.h>
 #include <klish/kcontext_base.h>
 #include <klish/kudata.h>
 
@@ -48,6 +49,9 @@ ssize_t kscheme_entrys_len(const kscheme_t *scheme);
 kscheme_entrys_node_t *kscheme_entrys_iter(const kscheme_t *scheme);
 kentry_t *kscheme_entrys_each(kscheme_entrys_node_t **iter);
 
+// Compiled ENTRYs
+kflat_t *kscheme_flat(const kscheme_t *scheme);
+
 // User data store
 bool_t kscheme_named_udata_new(kscheme_t *scheme,
 	const char *name, void *data, kudata_data_free_fn free_fn);
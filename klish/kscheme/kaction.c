@@ -17,6 +17,8 @@ struct kaction_s {
 	ksym_t *sym; // Symbol itself
 	kplugin_t *plugin; // Source of symbol
 	char *lock; // Named lock
+	bool_t lock_shared; // Reader's lock
+	bool_t lock_wait; // Wait for lock or fail immediately
 	bool_t interrupt;
 	kaction_io_e in;
 	kaction_io_e out;
@@ -25,6 +27,8 @@ struct kaction_s {
 	tri_t permanent;
 	tri_t sync;
 	char *script;
+	void *prepared; // Script compiled by sym's prepare function
+	ksym_prepared_free_fn prepared_free;
 };
 
 
@@ -37,6 +41,10 @@ KSET_STR_ONCE(action, sym_ref);
 // Lock
 KGET_STR(action, lock);
 KSET_STR(action, lock);
+KGET_BOOL(action, lock_shared);
+KSET_BOOL(action, lock_shared);
+KGET_BOOL(action, lock_wait);
+KSET_BOOL(action, lock_wait);
 
 // Interrupt
 KGET_BOOL(action, interrupt);
@@ -68,6 +76,9 @@ KSET(action, tri_t, sync);
 KGET_STR(action, script);
 KSET_STR(action, script);
 
+// Prepared script
+KGET(action, const void *, prepared);
+
 // Symbol
 KGET(action, ksym_t *, sym);
 KSET(action, ksym_t *, sym);
@@ -89,12 +100,16 @@ kaction_t *kaction_new(void)
 	// Initialize
 	action->sym_ref = NULL;
 	action->lock = NULL;
+	action->lock_shared = BOOL_FALSE;
+	action->lock_wait = BOOL_TRUE;
 	action->interrupt = BOOL_FALSE;
 	action->in = KACTION_IO_FALSE;
 	action->out = KACTION_IO_TRUE;
 	action->exec_on = KACTION_COND_SUCCESS;
 	action->update_retcode = BOOL_TRUE;
 	action->script = NULL;
+	action->prepared = NULL;
+	action->prepared_free = NULL;
 	action->sym = NULL;
 	action->plugin = NULL;
 
@@ -110,11 +125,34 @@ void kaction_free(kaction_t *action)
 	faux_str_free(action->sym_ref);
 	faux_str_free(action->lock);
 	faux_str_free(action->script);
+	kaction_set_prepared(action, NULL, NULL);
 
 	faux_free(action);
 }
 
 
+// Prepared script is immutable. Old value will be freed by its own free
+// function or by faux_free() if function is not specified.
+bool_t kaction_set_prepared(kaction_t *action, void *prepared,
+	ksym_prepared_free_fn prepared_free)
+{
+	assert(action);
+	if (!action)
+		return BOOL_FALSE;
+
+	if (action->prepared) {
+		if (action->prepared_free)
+			action->prepared_free(action->prepared);
+		else
+			faux_free(action->prepared);
+	}
+	action->prepared = prepared;
+	action->prepared_free = prepared_free;
+
+	return BOOL_TRUE;
+}
+
+
 bool_t kaction_meet_exec_conditions(const kaction_t *action, int current_retcode)
 {
 	bool_t r = BOOL_FALSE; // Default is pessimistic
@@ -13,6 +13,27 @@
 #include <klish/khotkey.h>
 
 
+#define KENTRY_INDEX_NONE ((size_t)(-1))
+
+// Slot of keyword index. Slot corresponds to nested ENTRY.
+typedef struct {
+	const kentry_t *entry;
+	size_t next; // Next slot within the same hash chain or fallback chain
+} kentry_slot_t;
+
+// Keyword index of nested ENTRYs. All slots are stored in order of
+// nested ENTRYs declaration. Keyword ENTRYs are linked into hash chains
+// and all other ENTRYs are linked into fallback chain. So parser can
+// merge two short chains instead of walking through the whole list.
+struct kentry_index_s {
+	size_t slots_num;
+	kentry_slot_t *slots;
+	size_t buckets_num; // Power of 2
+	size_t *buckets; // First slot of hash chain
+	size_t fallback; // First slot of fallback chain
+};
+
+
 // WARNING: Changing this structure don't forget to update kentry_link()
 struct kentry_s {
 	char *name; // Mandatory name (identifier within entries tree)
@@ -29,10 +50,13 @@ struct kentry_s {
 	bool_t order; // Is entry ordered
 	kentry_filter_e filter; // Is entry filter. Filter can't have inline actions.
 	faux_list_t *entrys; // Nested ENTRYs
+	kentry_map_t *entrys_map; // Nested ENTRYs by name
 	faux_list_t *actions; // Nested ACTIONs
 	faux_list_t *hotkeys; // Hotkeys
 	// Fast links to nested entries with special purposes.
 	kentry_t** nested_by_purpose;
+	ksym_keyword_e keyword; // Is ENTRY a keyword (has keyword PTYPE)
+	kentry_index_t *index; // Keyword index of nested ENTRYs
 	void *udata;
 	kentry_udata_free_fn udata_free_fn;
 };
@@ -91,12 +115,12 @@ KSET_BOOL(entry, order);
 KGET(entry, kentry_filter_e, filter);
 KSET(entry, kentry_filter_e, filter);
 
+// Keyword
+KGET(entry, ksym_keyword_e, keyword);
+KSET(entry, ksym_keyword_e, keyword);
+
 // Nested ENTRYs list
 KGET(entry, faux_list_t *, entrys);
-static KCMP_NESTED(entry, entry, name);
-static KCMP_NESTED_BY_KEY(entry, entry, name);
-KADD_NESTED(entry, kentry_t *, entrys);
-KFIND_NESTED(entry, entry);
 KNESTED_LEN(entry, entrys);
 KNESTED_IS_EMPTY(entry, entrys);
 KNESTED_ITER(entry, entrys);
@@ -144,14 +168,18 @@ kentry_t *kentry_new(const char *name)
 	entry->restore = BOOL_FALSE;
 	entry->order = BOOL_FALSE;
 	entry->filter = KENTRY_FILTER_FALSE;
+	entry->keyword = KSYM_KEYWORD_NONE;
 	entry->udata = NULL;
 	entry->udata_free_fn = NULL;
 
 	// ENTRY list
-	entry->entrys = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_UNIQUE,
-		kentry_entry_compare, kentry_entry_kcompare,
-		(void (*)(void *))kentry_free);
+	// Uniqueness of names is checked by map so list itself is
+	// non-unique. It makes adding not dependent on list length.
+	entry->entrys = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, (void (*)(void *))kentry_free);
 	assert(entry->entrys);
+	entry->entrys_map = kentry_map_new(BOOL_FALSE);
+	assert(entry->entrys_map);
 
 	// ACTION list
 	entry->actions = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
@@ -166,19 +194,37 @@ kentry_t *kentry_new(const char *name)
 	entry->nested_by_purpose = faux_zmalloc(
 		KENTRY_PURPOSE_MAX * sizeof(*(entry->nested_by_purpose)));
 
+	// Index will be filled later by kentry_build_index()
+	entry->index = faux_zmalloc(sizeof(*(entry->index)));
+	assert(entry->index);
+
 	return entry;
 }
 
 
+static void kentry_index_free_content(kentry_index_t *index)
+{
+	if (!index)
+		return;
+
+	faux_free(index->slots);
+	faux_free(index->buckets);
+	memset(index, 0, sizeof(*index));
+}
+
+
 static void kentry_free_non_link(kentry_t *entry)
 {
 	if (!entry)
 		return;
 
+	kentry_map_free(entry->entrys_map);
 	faux_list_free(entry->entrys);
 	faux_list_free(entry->actions);
 	faux_list_free(entry->hotkeys);
 	faux_free(entry->nested_by_purpose);
+	kentry_index_free_content(entry->index);
+	faux_free(entry->index);
 }
 
 
@@ -252,12 +298,17 @@ bool_t kentry_link(kentry_t *dst, const kentry_t *src)
 	dst->filter = src->filter;
 	// entrys - ref
 	dst->entrys = src->entrys;
+	// entrys_map - ref
+	dst->entrys_map = src->entrys_map;
 	// actions - ref
 	dst->actions = src->actions;
 	// hotkeys - ref
 	dst->hotkeys = src->hotkeys;
 	// nested_by_purpose - ref
 	dst->nested_by_purpose = src->nested_by_purpose;
+	// keyword - orig
+	// index - ref
+	dst->index = src->index;
 	// udata - orig
 	// udata_free_fn - orig
 
@@ -265,6 +316,58 @@ bool_t kentry_link(kentry_t *dst, const kentry_t *src)
 }
 
 
+bool_t kentry_add_entrys(kentry_t *entry, kentry_t *nested_entry)
+{
+	faux_list_node_t *node = NULL;
+
+	assert(entry);
+	if (!entry)
+		return BOOL_FALSE;
+	assert(nested_entry);
+	if (!nested_entry)
+		return BOOL_FALSE;
+
+	// Map and list must stay consistent. So check for duplicate first and
+	// take ENTRY back from list if map can't store it.
+	if (kentry_find_entry(entry, kentry_name(nested_entry)))
+		return BOOL_FALSE;
+	node = faux_list_add(entry->entrys, nested_entry);
+	if (!node)
+		return BOOL_FALSE;
+	if (!kentry_map_add(entry->entrys_map, kentry_name(nested_entry),
+		nested_entry)) {
+		faux_list_takeaway(entry->entrys, node);
+		return BOOL_FALSE;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+kentry_t *kentry_find_entry_by_len(const kentry_t *entry, const char *name,
+	size_t len)
+{
+	assert(entry);
+	if (!entry)
+		return NULL;
+	assert(name);
+	if (!name)
+		return NULL;
+
+	return kentry_map_find(entry->entrys_map, name, len);
+}
+
+
+kentry_t *kentry_find_entry(const kentry_t *entry, const char *name)
+{
+	assert(name);
+	if (!name)
+		return NULL;
+
+	return kentry_find_entry_by_len(entry, name, strlen(name));
+}
+
+
 kentry_t *kentry_nested_by_purpose(const kentry_t *entry, kentry_purpose_e purpose)
 {
 	assert(entry);
@@ -359,3 +462,221 @@ kaction_io_e kentry_out(const kentry_t *entry)
 
 	return io;
 }
+
+
+// Keyword of ENTRY is a value or name if value is not defined
+static const char *kentry_keyword_str(const kentry_t *entry)
+{
+	const char *str = kentry_value(entry);
+
+	if (!str)
+		str = kentry_name(entry);
+
+	return str;
+}
+
+
+// Hash is case insensitive for all keywords. Case sensitive keywords are
+// compared exactly later. Non-ASCII chars are not folded but affect the
+// hash equally to be independent of locale.
+static size_t kentry_index_hash(const char *str)
+{
+	size_t hash = 5381;
+	const unsigned char *p = (const unsigned char *)str;
+
+	for (; *p; p++) {
+		unsigned char c = *p;
+		if ((c >= 'A') && (c <= 'Z'))
+			c = c - 'A' + 'a';
+		else if (c > 0x7f)
+			c = 0x80;
+		hash = (hash << 5) + hash + c;
+	}
+
+	return hash;
+}
+
+
+/** @brief Fast check if argument matches keyword ENTRY.
+ *
+ * The result is the same as keyword PTYPE gives but without PTYPE
+ * execution. Makes sense for keyword ENTRYs only.
+ */
+bool_t kentry_keyword_match(const kentry_t *entry, const char *arg)
+{
+	const char *keyword = NULL;
+
+	assert(entry);
+	if (!entry)
+		return BOOL_FALSE;
+	if (!arg)
+		return BOOL_FALSE;
+
+	keyword = kentry_keyword_str(entry);
+	if (!keyword)
+		return BOOL_FALSE;
+
+	if (KSYM_KEYWORD_NOCASE == entry->keyword)
+		return (faux_str_casecmp(arg, keyword) == 0) ? BOOL_TRUE : BOOL_FALSE;
+	if (KSYM_KEYWORD_CASE == entry->keyword)
+		return (strcmp(arg, keyword) == 0) ? BOOL_TRUE : BOOL_FALSE;
+
+	return BOOL_FALSE;
+}
+
+
+/** @brief Builds keyword index of nested ENTRYs.
+ *
+ * Nested ENTRYs must have 'keyword' field already set. Only COMMON
+ * nested ENTRYs are indexed because parser ignores all other ENTRYs.
+ * Index is not built if there are no nested keyword ENTRYs at all.
+ */
+bool_t kentry_build_index(kentry_t *entry)
+{
+	kentry_index_t *index = NULL;
+	kentry_entrys_node_t *iter = NULL;
+	kentry_t *nested = NULL;
+	size_t keywords_num = 0;
+	size_t slots_num = 0;
+	size_t i = 0;
+	size_t *fallback_tail = NULL;
+	size_t **bucket_tails = NULL;
+
+	assert(entry);
+	if (!entry)
+		return BOOL_FALSE;
+	index = entry->index;
+	kentry_index_free_content(index);
+
+	iter = kentry_entrys_iter(entry);
+	while ((nested = kentry_entrys_each(&iter))) {
+		if (kentry_purpose(nested) != KENTRY_PURPOSE_COMMON)
+			continue;
+		slots_num++;
+		if (nested->keyword != KSYM_KEYWORD_NONE)
+			keywords_num++;
+	}
+	if (0 == keywords_num)
+		return BOOL_TRUE;
+
+	index->slots_num = slots_num;
+	index->slots = faux_zmalloc(slots_num * sizeof(*index->slots));
+	assert(index->slots);
+	index->buckets_num = 8;
+	while (index->buckets_num < (keywords_num * 2))
+		index->buckets_num <<= 1;
+	index->buckets = faux_zmalloc(index->buckets_num *
+		sizeof(*index->buckets));
+	assert(index->buckets);
+	for (i = 0; i < index->buckets_num; i++)
+		index->buckets[i] = KENTRY_INDEX_NONE;
+	index->fallback = KENTRY_INDEX_NONE;
+
+	// Temporary tails of chains to keep slots in declaration order
+	bucket_tails = faux_zmalloc(index->buckets_num * sizeof(*bucket_tails));
+	assert(bucket_tails);
+	fallback_tail = &index->fallback;
+	for (i = 0; i < index->buckets_num; i++)
+		bucket_tails[i] = &index->buckets[i];
+
+	i = 0;
+	iter = kentry_entrys_iter(entry);
+	while ((nested = kentry_entrys_each(&iter))) {
+		kentry_slot_t *slot = NULL;
+		if (kentry_purpose(nested) != KENTRY_PURPOSE_COMMON)
+			continue;
+		slot = &index->slots[i];
+		slot->entry = nested;
+		slot->next = KENTRY_INDEX_NONE;
+		if (nested->keyword != KSYM_KEYWORD_NONE) {
+			size_t b = kentry_index_hash(kentry_keyword_str(nested)) &
+				(index->buckets_num - 1);
+			*bucket_tails[b] = i;
+			bucket_tails[b] = &slot->next;
+		} else {
+			*fallback_tail = i;
+			fallback_tail = &slot->next;
+		}
+		i++;
+	}
+	faux_free(bucket_tails);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Initializes iterator of candidates to match specified argument.
+ *
+ * Returns BOOL_FALSE if ENTRY has no keyword index. Then the caller must
+ * walk through all nested ENTRYs.
+ */
+bool_t kentry_index_iter(const kentry_t *entry, const char *arg,
+	kentry_index_iter_t *iter)
+{
+	const kentry_index_t *index = NULL;
+
+	assert(entry);
+	if (!entry)
+		return BOOL_FALSE;
+	assert(iter);
+	if (!iter)
+		return BOOL_FALSE;
+	if (!arg)
+		return BOOL_FALSE;
+	index = entry->index;
+	if (!index || !index->slots)
+		return BOOL_FALSE;
+
+	iter->arg = arg;
+	iter->keyword = index->buckets[kentry_index_hash(arg) &
+		(index->buckets_num - 1)];
+	iter->fallback = index->fallback;
+	iter->current = KENTRY_INDEX_NONE;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Gets next candidate to match argument.
+ *
+ * Candidates are keyword ENTRYs that match argument and all non-keyword
+ * ENTRYs. The order of candidates is the order of nested ENTRYs
+ * declaration. The iterator's 'current' field is a position of returned
+ * candidate among nested COMMON ENTRYs.
+ */
+const kentry_t *kentry_index_each(const kentry_t *entry,
+	kentry_index_iter_t *iter)
+{
+	const kentry_index_t *index = NULL;
+	size_t cur = KENTRY_INDEX_NONE;
+
+	assert(entry);
+	if (!entry)
+		return NULL;
+	assert(iter);
+	if (!iter)
+		return NULL;
+	index = entry->index;
+
+	// Skip keywords that don't match argument
+	while ((iter->keyword != KENTRY_INDEX_NONE) &&
+		!kentry_keyword_match(index->slots[iter->keyword].entry,
+		iter->arg))
+		iter->keyword = index->slots[iter->keyword].next;
+
+	// Both chains are ordered so get the nearest slot
+	if ((iter->keyword != KENTRY_INDEX_NONE) &&
+		((iter->fallback == KENTRY_INDEX_NONE) ||
+		(iter->keyword < iter->fallback))) {
+		cur = iter->keyword;
+		iter->keyword = index->slots[cur].next;
+	} else if (iter->fallback != KENTRY_INDEX_NONE) {
+		cur = iter->fallback;
+		iter->fallback = index->slots[cur].next;
+	} else {
+		return NULL;
+	}
+	iter->current = cur;
+
+	return index->slots[cur].entry;
+}
@@ -0,0 +1,194 @@
+/** @file kentry_map.c
+ *
+ * Hash map from string key to ENTRY. It's used to find nested ENTRYs by
+ * name and to find ENTRYs by full path. Key is specified by pointer and
+ * length so it's not necessary to allocate NUL-terminated copy of path's
+ * component to search for it. Map uses open addressing with linear
+ * probing. Map can't remove items because ENTRYs are never removed from
+ * scheme.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <faux/faux.h>
+#include <faux/str.h>
+#include <klish/khelper.h>
+#include <klish/kentry.h>
+
+
+#define KENTRY_MAP_MIN_SIZE 8
+
+typedef struct {
+	const char *key;
+	size_t len;
+	kentry_t *entry;
+} kentry_map_slot_t;
+
+struct kentry_map_s {
+	bool_t own_keys; // Map stores its own copies of keys
+	size_t size; // Power of 2
+	size_t num;
+	kentry_map_slot_t *slots;
+};
+
+
+static size_t kentry_map_hash(const char *key, size_t len)
+{
+	size_t hash = 2166136261UL;
+	size_t i = 0;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char)key[i];
+		hash *= 16777619UL;
+	}
+
+	return hash;
+}
+
+
+static kentry_map_slot_t *kentry_map_slot(const kentry_map_t *map,
+	const char *key, size_t len)
+{
+	size_t i = kentry_map_hash(key, len) & (map->size - 1);
+
+	while (map->slots[i].key) {
+		kentry_map_slot_t *slot = &map->slots[i];
+		if ((slot->len == len) && (memcmp(slot->key, key, len) == 0))
+			break;
+		i = (i + 1) & (map->size - 1);
+	}
+
+	return &map->slots[i];
+}
+
+
+kentry_map_t *kentry_map_new(bool_t own_keys)
+{
+	kentry_map_t *map = NULL;
+
+	map = faux_zmalloc(sizeof(*map));
+	assert(map);
+	if (!map)
+		return NULL;
+
+	// Initialize
+	map->own_keys = own_keys;
+	map->size = KENTRY_MAP_MIN_SIZE;
+	map->num = 0;
+	map->slots = faux_zmalloc(map->size * sizeof(*map->slots));
+	assert(map->slots);
+
+	return map;
+}
+
+
+void kentry_map_free(kentry_map_t *map)
+{
+	if (!map)
+		return;
+
+	if (map->own_keys) {
+		size_t i = 0;
+		for (i = 0; i < map->size; i++)
+			faux_free((char *)map->slots[i].key);
+	}
+	faux_free(map->slots);
+
+	faux_free(map);
+}
+
+
+static bool_t kentry_map_grow(kentry_map_t *map)
+{
+	kentry_map_slot_t *old_slots = map->slots;
+	size_t old_size = map->size;
+	size_t i = 0;
+
+	map->size = old_size * 2;
+	map->slots = faux_zmalloc(map->size * sizeof(*map->slots));
+	assert(map->slots);
+	if (!map->slots) {
+		map->slots = old_slots;
+		map->size = old_size;
+		return BOOL_FALSE;
+	}
+
+	for (i = 0; i < old_size; i++) {
+		if (!old_slots[i].key)
+			continue;
+		*kentry_map_slot(map, old_slots[i].key, old_slots[i].len) =
+			old_slots[i];
+	}
+	faux_free(old_slots);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Adds ENTRY to map.
+ *
+ * If map doesn't own keys then key must live as long as map. Usually
+ * key is a name of ENTRY. Returns BOOL_FALSE if key is already in map.
+ */
+bool_t kentry_map_add(kentry_map_t *map, const char *key, kentry_t *entry)
+{
+	kentry_map_slot_t *slot = NULL;
+	size_t len = 0;
+
+	assert(map);
+	if (!map)
+		return BOOL_FALSE;
+	assert(key);
+	if (!key)
+		return BOOL_FALSE;
+	assert(entry);
+	if (!entry)
+		return BOOL_FALSE;
+
+	// Load factor is 1/2 max
+	if (((map->num + 1) * 2) > map->size) {
+		if (!kentry_map_grow(map))
+			return BOOL_FALSE;
+	}
+
+	len = strlen(key);
+	slot = kentry_map_slot(map, key, len);
+	if (slot->key)
+		return BOOL_FALSE;
+	slot->key = map->own_keys ? faux_str_dup(key) : key;
+	slot->len = len;
+	slot->entry = entry;
+	map->num++;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Finds ENTRY by key.
+ *
+ * Key is not NUL-terminated necessarily. The length of key is specified
+ * explicitly.
+ */
+kentry_t *kentry_map_find(const kentry_map_t *map, const char *key, size_t len)
+{
+	assert(map);
+	if (!map)
+		return NULL;
+	assert(key);
+	if (!key)
+		return NULL;
+
+	return kentry_map_slot(map, key, len)->entry;
+}
+
+
+ssize_t kentry_map_len(const kentry_map_t *map)
+{
+	assert(map);
+	if (!map)
+		return -1;
+
+	return map->num;
+}
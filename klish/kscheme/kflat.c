@@ -0,0 +1,360 @@
+/** @file kflat.c
+ *
+ * Compiled form of scheme's ENTRYs. ENTRY tree uses linked lists and
+ * shared (linked) fields so parser jumps over the memory a lot. Compiled
+ * form is a single array of nodes. Each node has a contiguous array of
+ * pointers to nested COMMON nodes and pre-resolved link to PTYPE node.
+ * Names are interned within single string pool. COMPLETION and HELP
+ * ENTRYs are not used by parser. They are got by kentry_nested_by_purpose()
+ * once per request so they don't need compiled links.
+ *
+ * Each ENTRY object (including link ENTRYs) gets exactly one node so
+ * the node can be found by ENTRY. The compiled form is read-only and it
+ * must be rebuilt if ENTRY tree is changed.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <faux/faux.h>
+#include <faux/str.h>
+#include <faux/list.h>
+#include <klish/khelper.h>
+#include <klish/kaction.h>
+#include <klish/ksym.h>
+#include <klish/kentry.h>
+#include <klish/kflat.h>
+
+
+#define KFLAT_NONE ((size_t)(-1))
+
+struct kflat_s {
+	size_t nodes_num;
+	kflat_node_t *nodes;
+	const kflat_node_t **children; // Pool for all nodes' children
+	char *names; // Pool of interned names
+	size_t map_size; // Power of 2
+	size_t *map; // ENTRY -> node index (open addressing)
+};
+
+
+// Number of nodes
+KGET(flat, size_t, nodes_num);
+
+
+static size_t kflat_ptr_hash(const void *ptr)
+{
+	size_t hash = (size_t)ptr;
+
+	hash ^= hash >> 17;
+	hash *= 0x9e3779b1UL;
+	hash ^= hash >> 15;
+
+	return hash;
+}
+
+
+static size_t kflat_str_hash(const char *str)
+{
+	size_t hash = 5381;
+	const unsigned char *p = (const unsigned char *)str;
+
+	for (; *p; p++)
+		hash = (hash << 5) + hash + *p;
+
+	return hash;
+}
+
+
+// Returns slot within map. Slot is empty or contains specified ENTRY.
+static size_t kflat_map_slot(const size_t *map, size_t map_size,
+	const kentry_t **entrys, const kentry_t *entry)
+{
+	size_t slot = kflat_ptr_hash(entry) & (map_size - 1);
+
+	while ((map[slot] != KFLAT_NONE) && (entrys[map[slot]] != entry))
+		slot = (slot + 1) & (map_size - 1);
+
+	return slot;
+}
+
+
+static size_t *kflat_map_new(size_t map_size)
+{
+	size_t *map = NULL;
+	size_t i = 0;
+
+	map = faux_zmalloc(map_size * sizeof(*map));
+	assert(map);
+	if (!map)
+		return NULL;
+	for (i = 0; i < map_size; i++)
+		map[i] = KFLAT_NONE;
+
+	return map;
+}
+
+
+// ENTRY is pure if all its ACTIONs have pure symbols
+static bool_t kflat_entry_is_pure(const kentry_t *entry)
+{
+	kentry_actions_node_t *iter = NULL;
+	kaction_t *action = NULL;
+
+	iter = kentry_actions_iter(entry);
+	while ((action = kentry_actions_each(&iter))) {
+		const ksym_t *sym = kaction_sym(action);
+		if (!sym || !ksym_pure(sym))
+			return BOOL_FALSE;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+// Collects all ENTRYs reachable from the list. Each ENTRY is stored once.
+// ENTRY's position within resulting array is an index of its node.
+static const kentry_t **kflat_collect(faux_list_t *entrys, size_t *entrys_num,
+	size_t **map_out, size_t *map_size_out)
+{
+	const kentry_t **queue = NULL;
+	size_t queue_size = 64;
+	size_t num = 0;
+	size_t cur = 0;
+	size_t *map = NULL;
+	size_t map_size = 128;
+	faux_list_node_t *iter = NULL;
+	const kentry_t *entry = NULL;
+
+	queue = faux_zmalloc(queue_size * sizeof(*queue));
+	assert(queue);
+	map = kflat_map_new(map_size);
+
+	iter = faux_list_head(entrys);
+	entry = iter ? (const kentry_t *)faux_list_data(iter) : NULL;
+	while (entry) {
+		size_t slot = 0;
+
+		slot = kflat_map_slot(map, map_size, queue, entry);
+		if (map[slot] == KFLAT_NONE) {
+			// Grow queue
+			if (num == queue_size) {
+				queue_size *= 2;
+				queue = realloc(queue, queue_size * sizeof(*queue));
+				assert(queue);
+			}
+			queue[num] = entry;
+			map[slot] = num;
+			num++;
+			// Grow map. Load factor is 1/2 max.
+			if ((num * 2) > map_size) {
+				size_t i = 0;
+				faux_free(map);
+				map_size *= 2;
+				map = kflat_map_new(map_size);
+				for (i = 0; i < num; i++)
+					map[kflat_map_slot(map, map_size,
+						queue, queue[i])] = i;
+			}
+		}
+
+		// Next ENTRY: the next one within current list or the first
+		// nested ENTRY of not processed queue element.
+		iter = iter ? faux_list_next_node(iter) : NULL;
+		while (!iter && (cur < num))
+			iter = kentry_entrys_iter(queue[cur++]);
+		entry = iter ? (const kentry_t *)faux_list_data(iter) : NULL;
+	}
+
+	*entrys_num = num;
+	*map_out = map;
+	*map_size_out = map_size;
+
+	return queue;
+}
+
+
+static const kflat_node_t *kflat_node_by_entry(const kflat_t *flat,
+	const kentry_t **entrys, const kentry_t *entry)
+{
+	size_t slot = 0;
+
+	if (!entry)
+		return NULL;
+	slot = kflat_map_slot(flat->map, flat->map_size, entrys, entry);
+	if (flat->map[slot] == KFLAT_NONE)
+		return NULL;
+
+	return &flat->nodes[flat->map[slot]];
+}
+
+
+// Interns names. The pool is allocated with final size so pointers to
+// interned strings are stable.
+static bool_t kflat_intern_names(kflat_t *flat)
+{
+	size_t pool_size = 0;
+	size_t pool_len = 0;
+	size_t table_size = 16;
+	const char **table = NULL;
+	size_t i = 0;
+
+	for (i = 0; i < flat->nodes_num; i++)
+		pool_size += strlen(kentry_name(flat->nodes[i].entry)) + 1;
+	while (table_size < (flat->nodes_num * 2))
+		table_size <<= 1;
+
+	flat->names = faux_zmalloc(pool_size ? pool_size : 1);
+	assert(flat->names);
+	table = faux_zmalloc(table_size * sizeof(*table));
+	assert(table);
+
+	for (i = 0; i < flat->nodes_num; i++) {
+		kflat_node_t *node = &flat->nodes[i];
+		const char *name = kentry_name(node->entry);
+		size_t slot = kflat_str_hash(name) & (table_size - 1);
+
+		while (table[slot] && (strcmp(table[slot], name) != 0))
+			slot = (slot + 1) & (table_size - 1);
+		if (!table[slot]) {
+			char *str = flat->names + pool_len;
+			size_t len = strlen(name) + 1;
+			memcpy(str, name, len);
+			pool_len += len;
+			table[slot] = str;
+		}
+		node->name = table[slot];
+	}
+	faux_free(table);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Compiles ENTRYs tree.
+ *
+ * ENTRYs must be prepared i.e. links and symbols must be resolved and
+ * keyword indexes must be built.
+ */
+kflat_t *kflat_new(faux_list_t *entrys)
+{
+	kflat_t *flat = NULL;
+	const kentry_t **queue = NULL;
+	size_t children_num = 0;
+	size_t children_len = 0;
+	size_t i = 0;
+
+	assert(entrys);
+	if (!entrys)
+		return NULL;
+
+	flat = faux_zmalloc(sizeof(*flat));
+	assert(flat);
+	if (!flat)
+		return NULL;
+
+	queue = kflat_collect(entrys, &flat->nodes_num,
+		&flat->map, &flat->map_size);
+
+	// Number of all children to allocate single pool
+	for (i = 0; i < flat->nodes_num; i++) {
+		kentry_entrys_node_t *iter = kentry_entrys_iter(queue[i]);
+		kentry_t *nested = NULL;
+		while ((nested = kentry_entrys_each(&iter))) {
+			if (kentry_purpose(nested) == KENTRY_PURPOSE_COMMON)
+				children_num++;
+		}
+	}
+
+	flat->nodes = faux_zmalloc((flat->nodes_num ? flat->nodes_num : 1) *
+		sizeof(*flat->nodes));
+	assert(flat->nodes);
+	flat->children = faux_zmalloc((children_num ? children_num : 1) *
+		sizeof(*flat->children));
+	assert(flat->children);
+
+	for (i = 0; i < flat->nodes_num; i++) {
+		const kentry_t *entry = queue[i];
+		kflat_node_t *node = &flat->nodes[i];
+		kentry_entrys_node_t *iter = NULL;
+		kentry_t *nested = NULL;
+		const kentry_t *ptype = NULL;
+
+		node->entry = entry;
+		node->min = kentry_min(entry);
+		node->max = kentry_max(entry);
+		node->mode = kentry_mode(entry);
+		node->purpose = kentry_purpose(entry);
+		node->filter = kentry_filter(entry);
+		node->keyword = kentry_keyword(entry);
+		node->container = kentry_container(entry);
+		node->order = kentry_order(entry);
+		node->has_actions = (kentry_actions_len(entry) > 0) ?
+			BOOL_TRUE : BOOL_FALSE;
+		ptype = kentry_nested_by_purpose(entry, KENTRY_PURPOSE_PTYPE);
+		node->ptype = kflat_node_by_entry(flat, queue, ptype);
+		// PTYPE node can be not filled yet so use ENTRY
+		if (ptype)
+			node->pure_ptype = kflat_entry_is_pure(ptype);
+
+		node->children = &flat->children[children_len];
+		iter = kentry_entrys_iter(entry);
+		while ((nested = kentry_entrys_each(&iter))) {
+			if (kentry_purpose(nested) != KENTRY_PURPOSE_COMMON)
+				continue;
+			flat->children[children_len++] =
+				kflat_node_by_entry(flat, queue, nested);
+			node->children_num++;
+		}
+	}
+
+	kflat_intern_names(flat);
+
+	// Nodes have ENTRY pointers so map doesn't need the queue anymore
+	faux_free(queue);
+
+	return flat;
+}
+
+
+void kflat_free(kflat_t *flat)
+{
+	if (!flat)
+		return;
+
+	faux_free(flat->nodes);
+	faux_free(flat->children);
+	faux_free(flat->names);
+	faux_free(flat->map);
+
+	faux_free(flat);
+}
+
+
+/** @brief Finds compiled node of ENTRY.
+ *
+ * Returns NULL if ENTRY was not compiled.
+ */
+const kflat_node_t *kflat_find_node(const kflat_t *flat,
+	const kentry_t *entry)
+{
+	size_t slot = 0;
+
+	assert(flat);
+	if (!flat)
+		return NULL;
+	assert(entry);
+	if (!entry)
+		return NULL;
+
+	slot = kflat_ptr_hash(entry) & (flat->map_size - 1);
+	while (flat->map[slot] != KFLAT_NONE) {
+		const kflat_node_t *node = &flat->nodes[flat->map[slot]];
+		if (node->entry == entry)
+			return node;
+		slot = (slot + 1) & (flat->map_size - 1);
+	}
+
+	return NULL;
+}
@@ -9,17 +9,28 @@
 #include <klish/khelper.h>
 #include <klish/kplugin.h>
 #include <klish/kentry.h>
+#include <klish/kflat.h>
 #include <klish/kscheme.h>
 #include <klish/kcontext.h>
 #include <klish/kustore.h>
+#include <klish/klock.h>
 
 
 struct kscheme_s {
 	faux_list_t *plugins;
 	faux_list_t *entrys;
+	kentry_map_t *entrys_map; // Top level ENTRYs by name
+	kentry_map_t *paths; // All ENTRYs by full path. Built by kscheme_prepare()
 	kustore_t *ustore;
+	kflat_t *flat; // Compiled ENTRYs. Built by kscheme_prepare()
+	faux_list_t *locks; // Lock names by offset within lock file
 };
 
+typedef struct {
+	off_t offset;
+	const char *name; // Link to ACTION's lock name
+} kscheme_lock_t;
+
 // Simple methods
 
 // PLUGIN list
@@ -34,14 +45,37 @@ KNESTED_EACH(scheme, kplugin_t *, plugins);
 
 // ENTRY list
 KGET(scheme, faux_list_t *, entrys);
-KCMP_NESTED(scheme, entry, name);
-KCMP_NESTED_BY_KEY(scheme, entry, name);
-KADD_NESTED(scheme, kentry_t *, entrys);
-KFIND_NESTED(scheme, entry);
 KNESTED_LEN(scheme, entrys);
 KNESTED_ITER(scheme, entrys);
 KNESTED_EACH(scheme, kentry_t *, entrys);
 
+// Compiled ENTRYs
+KGET(scheme, kflat_t *, flat);
+
+
+static int kscheme_lock_compare(const void *first, const void *second)
+{
+	const kscheme_lock_t *f = (const kscheme_lock_t *)first;
+	const kscheme_lock_t *s = (const kscheme_lock_t *)second;
+
+	if (f->offset == s->offset)
+		return 0;
+
+	return (f->offset < s->offset) ? -1 : 1;
+}
+
+
+static int kscheme_lock_kcompare(const void *key, const void *list_item)
+{
+	const off_t *f = (const off_t *)key;
+	const kscheme_lock_t *s = (const kscheme_lock_t *)list_item;
+
+	if (*f == s->offset)
+		return 0;
+
+	return (*f < s->offset) ? -1 : 1;
+}
+
 
 kscheme_t *kscheme_new(void)
 {
@@ -59,16 +93,23 @@ kscheme_t *kscheme_new(void)
 	assert(scheme->plugins);
 
 	// ENTRY list
-	// Must be unsorted because order is important
-	scheme->entrys = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_UNIQUE,
-		kscheme_entry_compare, kscheme_entry_kcompare,
-		(void (*)(void *))kentry_free);
+	// Must be unsorted because order is important. Uniqueness of names
+	// is checked by map.
+	scheme->entrys = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, (void (*)(void *))kentry_free);
 	assert(scheme->entrys);
+	scheme->entrys_map = kentry_map_new(BOOL_FALSE);
+	assert(scheme->entrys_map);
+	scheme->paths = NULL;
 
 	// User store
 	scheme->ustore = kustore_new();
 	assert(scheme->ustore);
 
+	// Compiled ENTRYs
+	scheme->flat = NULL;
+	scheme->locks = NULL;
+
 	return scheme;
 }
 
@@ -78,13 +119,58 @@ void kscheme_free(kscheme_t *scheme)
 	if (!scheme)
 		return;
 
-	faux_list_free(scheme->plugins);
+	kflat_free(scheme->flat);
+	faux_list_free(scheme->locks);
+	kentry_map_free(scheme->paths);
+	kentry_map_free(scheme->entrys_map);
+	// ENTRYs are freed before PLUGINs because ENTRYs can contain data
+	// with free functions implemented by plugins.
 	faux_list_free(scheme->entrys);
+	faux_list_free(scheme->plugins);
 	kustore_free(scheme->ustore);
 
 	faux_free(scheme);
 }
 
+
+bool_t kscheme_add_entrys(kscheme_t *scheme, kentry_t *entry)
+{
+	faux_list_node_t *node = NULL;
+
+	assert(scheme);
+	if (!scheme)
+		return BOOL_FALSE;
+	assert(entry);
+	if (!entry)
+		return BOOL_FALSE;
+
+	// See kentry_add_entrys()
+	if (kscheme_find_entry(scheme, kentry_name(entry)))
+		return BOOL_FALSE;
+	node = faux_list_add(scheme->entrys, entry);
+	if (!node)
+		return BOOL_FALSE;
+	if (!kentry_map_add(scheme->entrys_map, kentry_name(entry), entry)) {
+		faux_list_takeaway(scheme->entrys, node);
+		return BOOL_FALSE;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+kentry_t *kscheme_find_entry(const kscheme_t *scheme, const char *name)
+{
+	assert(scheme);
+	if (!scheme)
+		return NULL;
+	assert(name);
+	if (!name)
+		return NULL;
+
+	return kentry_map_find(scheme->entrys_map, name, strlen(name));
+}
+
 #define TAG "PLUGIN"
 
 static bool_t kscheme_load_plugins(kscheme_t *scheme, kcontext_t *context,
@@ -227,6 +313,35 @@ static ksym_t *kscheme_find_sym(const kscheme_t *scheme, const char *name,
 }
 
 
+// Different lock names must have different offsets within lock file. Else
+// they are the same lock actually.
+static bool_t kscheme_prepare_lock(kscheme_t *scheme, const char *name,
+	faux_error_t *error)
+{
+	off_t offset = klock_offset(name);
+	kscheme_lock_t *lock = NULL;
+
+	lock = (kscheme_lock_t *)faux_list_kfind(scheme->locks, &offset);
+	if (lock) {
+		if (strcmp(lock->name, name) == 0)
+			return BOOL_TRUE;
+		faux_error_sprintf(error, "Lock names \"%s\" and \"%s\" "
+			"collide. Rename one of them", lock->name, name);
+		return BOOL_FALSE;
+	}
+
+	lock = faux_zmalloc(sizeof(*lock));
+	assert(lock);
+	if (!lock)
+		return BOOL_FALSE;
+	lock->offset = offset;
+	lock->name = name;
+	faux_list_add(scheme->locks, lock);
+
+	return BOOL_TRUE;
+}
+
+
 bool_t kscheme_prepare_action_list(kscheme_t *scheme, kentry_t *entry,
 	faux_error_t *error)
 {
@@ -263,6 +378,12 @@ bool_t kscheme_prepare_action_list(kscheme_t *scheme, kentry_t *entry,
 		}
 		kaction_set_sym(action, sym);
 		kaction_set_plugin(action, plugin);
+		if (kaction_lock(action) &&
+			!kscheme_prepare_lock(scheme, kaction_lock(action),
+			error)) {
+			retcode = BOOL_FALSE;
+			continue;
+		}
 		// Filter can't contain sync symbols
 		if ((kentry_filter(entry) != KENTRY_FILTER_FALSE) &&
 			kaction_is_sync(action)) {
@@ -272,18 +393,51 @@ bool_t kscheme_prepare_action_list(kscheme_t *scheme, kentry_t *entry,
 			retcode = BOOL_FALSE;
 			continue;
 		}
+		// Compile script if sym wants it
+		if (ksym_prepare(sym)) {
+			void *prepared = ksym_prepare(sym)(
+				kaction_script(action), error);
+			if (!prepared) {
+				faux_error_sprintf(error, "Can't prepare script "
+					"for symbol \"%s\" within \"%s\"",
+					sym_ref, kentry_name(entry));
+				retcode = BOOL_FALSE;
+				continue;
+			}
+			kaction_set_prepared(action, prepared,
+				ksym_prepared_free(sym));
+		}
 	}
 
 	return retcode;
 }
 
 
+// Path is normalized if it has no empty components
+static bool_t kscheme_path_is_normalized(const char *path)
+{
+	const char *p = path;
+
+	if (('\0' == *p) || ('/' == *p))
+		return BOOL_FALSE;
+	for (; *p; p++) {
+		if (('/' == p[0]) && (('/' == p[1]) || ('\0' == p[1])))
+			return BOOL_FALSE;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Finds ENTRY by path like "view/command/param".
+ *
+ * Full path index is used if it's available. Else (or if path contains
+ * links) the path components are searched within nested ENTRYs one by
+ * one. Function doesn't allocate memory.
+ */
 kentry_t *kscheme_find_entry_by_path(const kscheme_t *scheme, const char *name)
 {
-	char *saveptr = NULL;
-	const char *delim = "/";
-	char *entry_name = NULL;
-	char *full_name = NULL;
+	const char *p = NULL;
 	kentry_t *entry = NULL;
 
 	assert(scheme);
@@ -293,33 +447,63 @@ kentry_t *kscheme_find_entry_by_path(const kscheme_t *scheme, const char *name)
 	if (!name)
 		return NULL;
 
-	// Get first component of ENTRY path. It will be searched for
-	// within scheme.
-	full_name = faux_str_dup(name);
-	entry_name = strtok_r(full_name, delim, &saveptr);
-	if (!entry_name) {
-		faux_str_free(full_name);
-		return NULL;
-	}
-	entry = kscheme_find_entry(scheme, entry_name);
-	if (!entry) {
-		faux_str_free(full_name);
-		return NULL;
+	// Full path index
+	if (scheme->paths && kscheme_path_is_normalized(name)) {
+		entry = kentry_map_find(scheme->paths, name, strlen(name));
+		if (entry)
+			return entry;
 	}
 
-	// Search nested ENTRYs
-	while ((entry_name = strtok_r(NULL, delim, &saveptr))) {
-		entry = kentry_find_entry(entry, entry_name);
+	// The first component is searched for within scheme. Then search
+	// nested ENTRYs. Empty components are ignored.
+	p = name;
+	while (*p) {
+		size_t len = 0;
+
+		if ('/' == *p) {
+			p++;
+			continue;
+		}
+		len = strcspn(p, "/");
 		if (!entry)
-			break;
+			entry = kentry_map_find(scheme->entrys_map, p, len);
+		else
+			entry = kentry_find_entry_by_len(entry, p, len);
+		if (!entry)
+			return NULL;
+		p += len;
 	}
 
-	faux_str_free(full_name);
-
 	return entry;
 }
 
 
+// Adds ENTRY and all its nested ENTRYs to the full path index. Link's
+// nested ENTRYs are not indexed because they belong to another path.
+static bool_t kscheme_index_path(kentry_map_t *paths, const char *prefix,
+	kentry_t *entry)
+{
+	char *path = NULL;
+	kentry_entrys_node_t *iter = NULL;
+	kentry_t *nested_entry = NULL;
+
+	if (prefix)
+		path = faux_str_sprintf("%s/%s", prefix, kentry_name(entry));
+	else
+		path = faux_str_dup(kentry_name(entry));
+	kentry_map_add(paths, path, entry);
+
+	if (!kentry_ref_str(entry)) {
+		iter = kentry_entrys_iter(entry);
+		while ((nested_entry = kentry_entrys_each(&iter)))
+			kscheme_index_path(paths, path, nested_entry);
+	}
+	faux_str_free(path);
+
+	return BOOL_TRUE;
+}
+
+
 bool_t kscheme_prepare_entry(kscheme_t *scheme, kentry_t *entry,
 	faux_error_t *error) {
 	kentry_entrys_node_t *iter = NULL;
@@ -394,6 +578,64 @@ bool_t kscheme_prepare_entry(kscheme_t *scheme, kentry_t *entry,
 }
 
 
+// ENTRY is a keyword if its PTYPE consists of single keyword symbol. So
+// the result of PTYPE execution is known without execution.
+static ksym_keyword_e kscheme_entry_keyword(const kentry_t *entry)
+{
+	const kentry_t *ptype = NULL;
+	const kaction_t *action = NULL;
+	const ksym_t *sym = NULL;
+	kaction_cond_e exec_on = KACTION_COND_NONE;
+
+	if (kentry_purpose(entry) != KENTRY_PURPOSE_COMMON)
+		return KSYM_KEYWORD_NONE;
+	if (kentry_container(entry))
+		return KSYM_KEYWORD_NONE;
+	ptype = kentry_nested_by_purpose(entry, KENTRY_PURPOSE_PTYPE);
+	if (!ptype)
+		return KSYM_KEYWORD_NONE;
+	if (kentry_actions_len(ptype) != 1)
+		return KSYM_KEYWORD_NONE;
+	action = (const kaction_t *)faux_list_data(
+		faux_list_head(kentry_actions(ptype)));
+	exec_on = kaction_exec_on(action);
+	if ((exec_on != KACTION_COND_SUCCESS) &&
+		(exec_on != KACTION_COND_ALWAYS))
+		return KSYM_KEYWORD_NONE;
+	if (!kaction_update_retcode(action))
+		return KSYM_KEYWORD_NONE;
+	sym = kaction_sym(action);
+	if (!sym)
+		return KSYM_KEYWORD_NONE;
+
+	return ksym_keyword(sym);
+}
+
+
+// Build keyword indexes. It must be done when all ENTRYs are prepared
+// because links and PTYPE symbols must be resolved for all nested ENTRYs.
+// Linked ENTRYs share index with original ENTRY so index is built for
+// original ENTRY only.
+static bool_t kscheme_index_entry(kentry_t *entry)
+{
+	kentry_entrys_node_t *iter = NULL;
+	kentry_t *nested_entry = NULL;
+
+	kentry_set_keyword(entry, kscheme_entry_keyword(entry));
+	if (kentry_ref_str(entry))
+		return BOOL_TRUE;
+
+	iter = kentry_entrys_iter(entry);
+	while ((nested_entry = kentry_entrys_each(&iter)))
+		kscheme_index_entry(nested_entry);
+
+	if (kentry_mode(entry) == KENTRY_MODE_SWITCH)
+		kentry_build_index(entry);
+
+	return BOOL_TRUE;
+}
+
+
 /** @brief Prepares schema for execution.
  *
  * It loads plugins, link unresolved symbols, then iterates all the
@@ -414,6 +656,20 @@ bool_t kscheme_prepare(kscheme_t *scheme, kcontext_t *context, faux_error_t *err
 	if (!kscheme_load_plugins(scheme, context, error))
 		return BOOL_FALSE;
 
+	// Full path index. Links are resolved by path so index must be built
+	// before ENTRYs preparing.
+	kentry_map_free(scheme->paths);
+	scheme->paths = kentry_map_new(BOOL_TRUE);
+	entrys_iter = kscheme_entrys_iter(scheme);
+	while ((entry = kscheme_entrys_each(&entrys_iter)))
+		kscheme_index_path(scheme->paths, NULL, entry);
+
+	// Lock names are collected while ACTIONs preparing
+	faux_list_free(scheme->locks);
+	scheme->locks = faux_list_new(FAUX_LIST_SORTED, FAUX_LIST_UNIQUE,
+		kscheme_lock_compare, kscheme_lock_kcompare, faux_free);
+	assert(scheme->locks);
+
 	// Iterate ENTRYs
 	entrys_iter = kscheme_entrys_iter(scheme);
 	while ((entry = kscheme_entrys_each(&entrys_iter))) {
@@ -421,6 +677,19 @@ bool_t kscheme_prepare(kscheme_t *scheme, kcontext_t *context, faux_error_t *err
 			return BOOL_FALSE;
 	}
 
+	// Keyword indexes
+	entrys_iter = kscheme_entrys_iter(scheme);
+	while ((entry = kscheme_entrys_each(&entrys_iter)))
+		kscheme_index_entry(entry);
+
+	// Compiled form of ENTRYs for parser
+	kflat_free(scheme->flat);
+	scheme->flat = kflat_new(scheme->entrys);
+	if (!scheme->flat) {
+		faux_error_add(error, "Can't compile scheme");
+		return BOOL_FALSE;
+	}
+
 	return BOOL_TRUE;
 }
 
@@ -16,6 +16,12 @@ struct ksym_s {
 	ksym_fn function;
 	tri_t permanent;
 	tri_t sync;
+	ksym_keyword_e keyword;
+	ksym_prepare_fn prepare;
+	ksym_prepared_free_fn prepared_free;
+	ksym_spawn_fn spawn;
+	const ksym_filter_t *filter; // Line filter functions
+	bool_t pure; // Result depends on script, candidate ENTRY and value only
 };
 
 
@@ -37,6 +43,30 @@ KSET(sym, tri_t, permanent);
 KGET(sym, tri_t, sync);
 KSET(sym, tri_t, sync);
 
+// Keyword
+KGET(sym, ksym_keyword_e, keyword);
+KSET(sym, ksym_keyword_e, keyword);
+
+// Pure
+KGET_BOOL(sym, pure);
+KSET_BOOL(sym, pure);
+
+// Prepare function
+KGET(sym, ksym_prepare_fn, prepare);
+KSET(sym, ksym_prepare_fn, prepare);
+
+// Free function for prepared script
+KGET(sym, ksym_prepared_free_fn, prepared_free);
+KSET(sym, ksym_prepared_free_fn, prepared_free);
+
+// Spawn function
+KGET(sym, ksym_spawn_fn, spawn);
+KSET(sym, ksym_spawn_fn, spawn);
+
+// Line filter functions
+KGET(sym, const ksym_filter_t *, filter);
+KSET(sym, const ksym_filter_t *, filter);
+
 
 ksym_t *ksym_new(const char *name, ksym_fn function)
 {
@@ -55,6 +85,12 @@ ksym_t *ksym_new(const char *name, ksym_fn function)
 	sym->function = function;
 	sym->permanent = TRI_UNDEFINED;
 	sym->sync = TRI_UNDEFINED;
+	sym->keyword = KSYM_KEYWORD_NONE;
+	sym->prepare = NULL;
+	sym->prepared_free = NULL;
+	sym->spawn = NULL;
+	sym->filter = NULL;
+	sym->pure = BOOL_FALSE;
 
 	return sym;
 }
@@ -8,6 +8,10 @@
 
 #include <klish/kscheme.h>
 #include <klish/kpath.h>
+#include <klish/kptcache.h>
+#include <klish/kjournal.h>
+#include <klish/kworkers.h>
+#include <klish/kpty.h>
 
 #define KSESSION_STARTING_ENTRY "main"
 
@@ -22,6 +26,23 @@ void ksession_free(ksession_t *session);
 kscheme_t *ksession_scheme(const ksession_t *session);
 kpath_t *ksession_path(const ksession_t *session);
 
+// PTYPE validation cache
+kptcache_t *ksession_ptcache(const ksession_t *session);
+
+// Journal of service ACTIONs executed by resumable request
+kjournal_t *ksession_journal(const ksession_t *session);
+
+// Action workers
+kworkers_t *ksession_workers(const ksession_t *session);
+bool_t ksession_set_workers(ksession_t *session, kworkers_t *workers);
+
+// Pseudo terminal for interactive commands
+kpty_t *ksession_lend_pty(ksession_t *session);
+
+// File for named locks
+const char *ksession_lockfile(const ksession_t *session);
+bool_t ksession_set_lockfile(ksession_t *session, const char *lockfile);
+
 // Done
 bool_t ksession_done(const ksession_t *session);
 bool_t ksession_set_done(ksession_t *session, bool_t done);
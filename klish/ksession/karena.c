@@ -0,0 +1,130 @@
+/** @file karena.c
+ *
+ * Arena consists of chunks. New object is allocated within current chunk
+ * by moving its "used" border. New chunk is allocated when current one
+ * has no space. Objects larger than chunk get their own chunk.
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include <faux/faux.h>
+#include <klish/khelper.h>
+#include <klish/karena.h>
+
+
+// Alignment suitable for any object
+#define KARENA_ALIGN (sizeof(max_align_t))
+#define KARENA_ALIGN_SIZE(size) \
+	(((size) + KARENA_ALIGN - 1) & ~(KARENA_ALIGN - 1))
+
+typedef struct karena_chunk_s karena_chunk_t;
+
+struct karena_chunk_s {
+	karena_chunk_t *next;
+	size_t size;
+	size_t used;
+	max_align_t data[];
+};
+
+struct karena_s {
+	karena_chunk_t *chunks; // Current chunk is the first one
+	size_t chunk_size;
+};
+
+
+karena_t *karena_new(size_t chunk_size)
+{
+	karena_t *arena = NULL;
+
+	arena = faux_zmalloc(sizeof(*arena));
+	assert(arena);
+	if (!arena)
+		return NULL;
+
+	// Initialize
+	arena->chunks = NULL; // Chunk will be allocated on demand
+	arena->chunk_size = chunk_size ? chunk_size : KARENA_DEFAULT_CHUNK_SIZE;
+
+	return arena;
+}
+
+
+void karena_free(karena_t *arena)
+{
+	karena_chunk_t *chunk = NULL;
+
+	if (!arena)
+		return;
+
+	chunk = arena->chunks;
+	while (chunk) {
+		karena_chunk_t *next = chunk->next;
+		faux_free(chunk);
+		chunk = next;
+	}
+
+	faux_free(arena);
+}
+
+
+/** @brief Allocates zeroed memory within arena.
+ */
+void *karena_alloc(karena_t *arena, size_t size)
+{
+	karena_chunk_t *chunk = NULL;
+	void *ptr = NULL;
+
+	assert(arena);
+	if (!arena)
+		return NULL;
+
+	size = KARENA_ALIGN_SIZE(size ? size : 1);
+	chunk = arena->chunks;
+	if (!chunk || ((chunk->size - chunk->used) < size)) {
+		size_t chunk_size = arena->chunk_size;
+		if (size > chunk_size)
+			chunk_size = size;
+		chunk = faux_zmalloc(sizeof(*chunk) + chunk_size);
+		assert(chunk);
+		if (!chunk)
+			return NULL;
+		chunk->size = chunk_size;
+		chunk->used = 0;
+		// Big chunk is not a current chunk. Don't waste space of
+		// current chunk.
+		if (arena->chunks && (size > arena->chunk_size)) {
+			chunk->next = arena->chunks->next;
+			arena->chunks->next = chunk;
+		} else {
+			chunk->next = arena->chunks;
+			arena->chunks = chunk;
+		}
+	}
+
+	ptr = (char *)chunk->data + chunk->used;
+	chunk->used += size;
+	memset(ptr, 0, size);
+
+	return ptr;
+}
+
+
+char *karena_strdup(karena_t *arena, const char *str)
+{
+	char *dup = NULL;
+	size_t len = 0;
+
+	if (!str)
+		return NULL;
+
+	len = strlen(str);
+	dup = karena_alloc(arena, len + 1);
+	if (!dup)
+		return NULL;
+	memcpy(dup, str, len + 1);
+
+	return dup;
+}
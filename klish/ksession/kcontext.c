@@ -244,6 +244,22 @@ const char *kcontext_script(const kcontext_t *context)
 }
 
 
+const void *kcontext_prepared(const kcontext_t *context)
+{
+	const kaction_t *action = NULL;
+
+	assert(context);
+	if (!context)
+		return NULL;
+
+	action = kcontext_action(context);
+	if (!action)
+		return NULL;
+
+	return kaction_prepared(action);
+}
+
+
 bool_t kcontext_named_udata_new(kcontext_t *context,
 	const char *name, void *data, kudata_data_free_fn free_fn)
 {
@@ -1,5 +1,6 @@
 /** @file kexec.c
  */
+#define _GNU_SOURCE
 #define _XOPEN_SOURCE
 #define _XOPEN_SOURCE_EXTENDED
 #include <stdlib.h>
@@ -11,6 +12,7 @@
 #include <fcntl.h>
 #include <syslog.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <termios.h>
 #include <signal.h>
 #include <errno.h>
@@ -22,13 +24,29 @@
 #include <klish/kcontext.h>
 #include <klish/kpath.h>
 #include <klish/kexec.h>
+#include <klish/kspawn.h>
+#include <klish/klock.h>
 
 
-#define PTMX_PATH "/dev/ptmx"
+typedef struct {
+	const ksym_filter_t *ops;
+	void *state;
+} kexec_filter_t;
 
+typedef struct {
+	kcontext_t *context;
+	int sink; // Captured output, offset is the first unwritten byte
+	int dest; // Destination descriptor of context
+	int fd; // Non-blocking duplicate of destination
+	int flags; // Original file status flags of destination
+} kexec_feed_t;
 
-// Declaration of grabber. Implementation is in the grabber.c
-void grabber(int fds[][2]);
+// Pseudo PID of sync ACTION those output is not written yet
+#define KEXEC_FEED_PID 0
+
+static void kexec_feed_free(void *data);
+static bool_t exec_action_sequence(const kexec_t *exec, kcontext_t *context,
+	pid_t pid, int wstatus);
 
 struct kexec_s {
 	kcontext_type_e type; // Common ACTIONs or service ACTIONs
@@ -45,6 +63,15 @@ struct kexec_s {
 	char *pts_fname; // Pseudoterminal slave file name
 	int pts; // Pseudoterminal slave handler
 	char *line; // Full command to execute (text)
+	bool_t inplace; // Sync service ACTIONs are executed within process
+	int local_stdout; // Write end of stdout pipe read by kexec owner
+	int local_stderr; // Write end of stderr pipe read by kexec owner
+	kexec_filter_t *filters; // Trailing filters executed within process
+	size_t filters_num;
+	faux_buf_t *bufraw; // Stdout to pass through filters
+	char *filter_pending; // Incomplete line of output
+	size_t filter_pending_len;
+	faux_list_t *feeds; // Queued output of sync ACTIONs
 };
 
 // Dry-run
@@ -114,6 +141,7 @@ kexec_t *kexec_new(ksession_t *session, kcontext_type_e type)
 	exec->dry_run = BOOL_FALSE;
 	exec->saved_path = NULL;
 	exec->line = NULL;
+	exec->inplace = BOOL_FALSE;
 
 	// List of execute contexts
 	exec->contexts = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
@@ -124,6 +152,16 @@ kexec_t *kexec_new(ksession_t *session, kcontext_type_e type)
 	exec->stdin = -1;
 	exec->stdout = -1;
 	exec->stderr = -1;
+	exec->local_stdout = -1;
+	exec->local_stderr = -1;
+	exec->filters = NULL;
+	exec->filters_num = 0;
+	exec->bufraw = NULL;
+	exec->filter_pending = NULL;
+	exec->filter_pending_len = 0;
+	exec->feeds = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, kexec_feed_free);
+	assert(exec->feeds);
 
 	exec->bufin = faux_buf_new(0);
 	exec->bufout = faux_buf_new(0);
@@ -142,6 +180,20 @@ void kexec_free(kexec_t *exec)
 	if (!exec)
 		return;
 
+	// Filters those are not finished (interrupted command) must free
+	// their states
+	if (exec->filters_num > 0) {
+		faux_buf_t *trash = faux_buf_new(0);
+		size_t i = 0;
+		for (i = 0; i < exec->filters_num; i++)
+			exec->filters[i].ops->fini(exec->filters[i].state, trash);
+		faux_buf_free(trash);
+	}
+	faux_free(exec->filters);
+	faux_buf_free(exec->bufraw);
+	faux_free(exec->filter_pending);
+	faux_list_free(exec->feeds);
+
 	faux_list_free(exec->contexts);
 
 	if (exec->stdin != -1)
@@ -320,7 +372,8 @@ static bool_t kexec_prepare(kexec_t *exec)
 	bool_t isatty_stderr = BOOL_FALSE;
 	int pts = -1;
 	int ptm = -1;
-	char *pts_name = NULL;
+	faux_list_node_t *tail = NULL; // Last process within pipeline
+	size_t i = 0;
 
 
 	assert(exec);
@@ -330,6 +383,10 @@ static bool_t kexec_prepare(kexec_t *exec)
 	if (kexec_contexts_is_empty(exec))
 		return BOOL_FALSE;
 
+	tail = faux_list_tail(exec->contexts);
+	for (i = 0; i < exec->filters_num; i++)
+		tail = faux_list_prev_node(tail);
+
 	// If user has a terminal somewhere (stdin, stdout, stderr) then prepare
 	// pseudoterminal. Service actions (internal actions like PTYPE checks)
 	// never get terminal
@@ -343,24 +400,21 @@ static bool_t kexec_prepare(kexec_t *exec)
 		isatty_stderr = ksession_isatty_stderr(exec->session);
 	}
 	if (isatty_stdin || isatty_stdout || isatty_stderr) {
-		ptm = open(PTMX_PATH, O_RDWR, O_NOCTTY);
+		// Session lends its pseudo terminal. The kexec gets
+		// duplicates of descriptors and closes them as usual.
+		kpty_t *pty = ksession_lend_pty(exec->session);
+		if (!pty)
+			return BOOL_FALSE;
+		ptm = fcntl(kpty_ptm(pty), F_DUPFD_CLOEXEC, 0);
 		if (ptm < 0)
 			return BOOL_FALSE;
-		// Set O_NONBLOCK flag here. Because this flag is ignored while
-		// open() ptmx. I don't know why. fcntl() is working fine.
-		fflags = fcntl(ptm, F_GETFL);
-		fcntl(ptm, F_SETFL, fflags | O_NONBLOCK);
-		grantpt(ptm);
-		unlockpt(ptm);
-		pts_name = ptsname(ptm);
 		// In a case of pseudo-terminal the pts
 		// must be reopened later in the child after setsid(). So
 		// save filename of pts
-		kexec_set_pts_fname(exec, pts_name);
-		// Open client side (pts) of pseudo terminal. It's necessary for
-		// sync action execution. Additionally open descriptor makes
-		// action (from child) to don't send SIGHUP on terminal handler.
-		pts = open(pts_name, O_RDWR, O_NOCTTY);
+		kexec_set_pts_fname(exec, kpty_pts_fname(pty));
+		// Client side (pts) of pseudo terminal. It's necessary for
+		// sync action execution.
+		pts = fcntl(kpty_pts(pty), F_DUPFD_CLOEXEC, 0);
 		if (pts < 0)
 			return BOOL_FALSE;
 		kexec_set_pts(exec, pts);
@@ -375,7 +429,7 @@ static bool_t kexec_prepare(kexec_t *exec)
 		r_end = pts;
 		w_end = ptm;
 	} else {
-		if (pipe(pipefd) < 0)
+		if (pipe2(pipefd, O_CLOEXEC) < 0)
 			return BOOL_FALSE;
 		// Write end of 'stdin' pipe must be non-blocked
 		fflags = fcntl(pipefd[1], F_GETFL);
@@ -392,7 +446,7 @@ static bool_t kexec_prepare(kexec_t *exec)
 		r_end = ptm;
 		w_end = pts;
 	} else {
-		if (pipe(pipefd) < 0)
+		if (pipe2(pipefd, O_CLOEXEC) < 0)
 			return BOOL_FALSE;
 		// Read end of 'stdout' pipe must be non-blocked
 		fflags = fcntl(pipefd[0], F_GETFL);
@@ -401,15 +455,16 @@ static bool_t kexec_prepare(kexec_t *exec)
 		w_end = pipefd[1];
 	}
 	kexec_set_stdout(exec, r_end); // Read end
-	kcontext_set_stdout(
-		faux_list_data(faux_list_tail(exec->contexts)), w_end); // Write end
+	if (!isatty_stdout)
+		exec->local_stdout = w_end;
+	kcontext_set_stdout(faux_list_data(tail), w_end); // Write end
 
 	// STDERR
 	if (isatty_stderr) {
 		r_end = ptm;
 		w_end = pts;
 	} else {
-		if (pipe(pipefd) < 0)
+		if (pipe2(pipefd, O_CLOEXEC) < 0)
 			return BOOL_FALSE;
 		// Read end of 'stderr' pipe must be non-blocked
 		fflags = fcntl(pipefd[0], F_GETFL);
@@ -420,12 +475,15 @@ static bool_t kexec_prepare(kexec_t *exec)
 	kexec_set_stderr(exec, r_end); // Read end
 	// STDERR write end will be set to all list members as stderr
 	global_stderr = w_end; // Write end
+	if (!isatty_stderr)
+		exec->local_stderr = w_end;
 
 	// Save current path
 	if (ksession_path(exec->session))
 		exec->saved_path = kpath_clone(ksession_path(exec->session));
 
-	// Iterate all context_t elements to fill all stdin, stdout, stderr
+	// Iterate all context_t elements to fill all stdin, stdout, stderr.
+	// Trailing filters executed within process have no streams.
 	for (iter = faux_list_head(exec->contexts); iter;
 		iter = faux_list_next_node(iter)) {
 		faux_list_node_t *next = faux_list_next_node(iter);
@@ -434,10 +492,13 @@ static bool_t kexec_prepare(kexec_t *exec)
 		// Set the same STDERR to all contexts
 		kcontext_set_stderr(context, global_stderr);
 
+		if (iter == tail)
+			break;
+
 		// Create pipes beetween processes
 		if (next) {
 			kcontext_t *next_context = (kcontext_t *)faux_list_data(next);
-			if (pipe(pipefd) < 0)
+			if (pipe2(pipefd, O_CLOEXEC) < 0)
 				return BOOL_FALSE;
 			kcontext_set_stdout(context, pipefd[1]); // Write end
 			kcontext_set_stdin(next_context, pipefd[0]); // Read end
@@ -448,97 +509,405 @@ static bool_t kexec_prepare(kexec_t *exec)
 }
 
 
-// === SYNC symbol execution
-// The function will be executed right here. It's necessary for
-// navigation implementation for example. To grab function output the
-// service process will be forked. It gets output and stores it to the
-// internal buffer. After sym function return grabber will write
-// buffered data back. So grabber will simulate async sym execution.
-static bool_t exec_action_sync(const kexec_t *exec, kcontext_t *context,
-	const kaction_t *action, pid_t *pid, int *retcode)
+// Service kexec (PTYPE, COND etc) that contains sync ACTIONs only can be
+// executed within current process. It doesn't need pipes
+// and event loop to get ACTIONs output.
+static bool_t kexec_is_inplace_capable(const kexec_t *exec)
 {
-	ksym_fn fn = NULL;
-	int exitcode = 0;
-	pid_t child_pid = -1;
-	int pipe_stdout[2] = {};
-	int pipe_stderr[2] = {};
+	faux_list_node_t *iter = NULL;
+	kcontext_t *context = NULL;
 
-	// Create pipes beetween sym function and grabber
-	if (pipe(pipe_stdout) < 0)
+	if (exec->type != KCONTEXT_TYPE_SERVICE_ACTION)
 		return BOOL_FALSE;
-	if (pipe(pipe_stderr) < 0) {
-		close(pipe_stdout[0]);
-		close(pipe_stdout[1]);
+	if (kexec_contexts_is_empty(exec))
 		return BOOL_FALSE;
+
+	iter = kexec_contexts_iter(exec);
+	while ((context = kexec_contexts_each(&iter))) {
+		const kentry_t *entry = kpargv_command(kcontext_pargv(context));
+		kentry_actions_node_t *actions_iter = NULL;
+		kaction_t *action = NULL;
+
+		if (!entry)
+			return BOOL_FALSE;
+		actions_iter = kentry_actions_iter(entry);
+		while ((action = kentry_actions_each(&actions_iter))) {
+			if (!kaction_is_sync(action))
+				return BOOL_FALSE;
+		}
 	}
 
-	fn = ksym_function(kaction_sym(action));
+	return BOOL_TRUE;
+}
 
-	// Prepare streams before fork
-	fflush(stdout);
-	fflush(stderr);
 
-	// Fork the grabber
-	child_pid = fork();
-	if (child_pid == -1) {
-		close(pipe_stdout[0]);
-		close(pipe_stdout[1]);
-		close(pipe_stderr[0]);
-		close(pipe_stderr[1]);
+// In-memory file to capture output of in-place executed sym function
+static int kexec_sink_new(void)
+{
+	int fd = -1;
+	FILE *f = NULL;
+
+#ifdef MFD_CLOEXEC
+	fd = memfd_create("kexec", MFD_CLOEXEC);
+	if (fd >= 0)
+		return fd;
+#endif
+	// Fallback for systems without memfd_create()
+	f = tmpfile();
+	if (!f)
+		return -1;
+	fd = dup(fileno(f));
+	fclose(f);
+	if (fd >= 0)
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	return fd;
+}
+
+
+// Reads all available data from fd to buffer
+static bool_t kexec_fd_drain(int fd, faux_buf_t *buf)
+{
+	ssize_t r = -1;
+
+	if (fd < 0)
 		return BOOL_FALSE;
+
+	do {
+		void *linear_buf = NULL;
+		ssize_t really_readed = 0;
+		ssize_t linear_len =
+			faux_buf_dwrite_lock_easy(buf, &linear_buf);
+		r = read(fd, linear_buf, linear_len);
+		if (r > 0)
+			really_readed = r;
+		faux_buf_dwrite_unlock_easy(buf, really_readed);
+	} while (r > 0);
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t kexec_sink_drain(int fd, faux_buf_t *buf)
+{
+	if (fd < 0)
+		return BOOL_FALSE;
+	if (lseek(fd, 0, SEEK_SET) < 0)
+		return BOOL_FALSE;
+
+	return kexec_fd_drain(fd, buf);
+}
+
+
+// Writes sink content starting from current sink offset. If fd is
+// non-blocking and it becomes full then function returns BOOL_FALSE and
+// errno is EAGAIN. Sink offset points to the first unwritten byte then.
+static bool_t kexec_sink_write(int sink, int fd)
+{
+	char buf[4096];
+	ssize_t r = -1;
+
+	while ((r = read(sink, buf, sizeof(buf))) > 0) {
+		ssize_t done = 0;
+		while (done < r) {
+			ssize_t w = write(fd, buf + done, r - done);
+			if (w < 0) {
+				if (EINTR == errno)
+					continue;
+				lseek(sink, done - r, SEEK_CUR);
+				return BOOL_FALSE;
+			}
+			done += w;
+		}
 	}
 
-	// Parent
-	if (child_pid != 0) {
-		int saved_stdout = -1;
-		int saved_stderr = -1;
+	return (r < 0) ? BOOL_FALSE : BOOL_TRUE;
+}
 
-		// Save pid of grabber
-		if (pid)
-			*pid = child_pid;
 
-		// Temporarily replace orig output streams by pipe
-		// stdout
-		saved_stdout = dup(STDOUT_FILENO);
-		dup2(pipe_stdout[1], STDOUT_FILENO);
-		close(pipe_stdout[0]);
-		close(pipe_stdout[1]);
-		// stderr
-		saved_stderr = dup(STDERR_FILENO);
-		dup2(pipe_stderr[1], STDERR_FILENO);
-		close(pipe_stderr[0]);
-		close(pipe_stderr[1]);
-
-		// Execute sym function right here
+// Executes sym function within current process. Output streams are
+// temporarily replaced by specified descriptors.
+static int kexec_call_captured(ksym_fn fn, kcontext_t *context,
+	int out, int err)
+{
+	int exitcode = 0;
+	int saved_stdout = -1;
+	int saved_stderr = -1;
+	int lock_fd = -1;
+
+	// Temporarily replace orig output streams
+	fflush(stdout);
+	fflush(stderr);
+	saved_stdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+	dup2(out, STDOUT_FILENO);
+	saved_stderr = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0);
+	dup2(err, STDERR_FILENO);
+
+	// Sync ACTION doesn't wait for named lock. Session process must not
+	// be blocked.
+	if (klock_action(context, BOOL_FALSE, &lock_fd)) {
 		exitcode = fn(context);
-		if (retcode)
-			*retcode = exitcode;
-
-		// Restore orig output streams
-		// stdout
-		fflush(stdout);
-		close(STDOUT_FILENO);
-		dup2(saved_stdout, STDOUT_FILENO);
-		close(saved_stdout);
-		// stderr
-		fflush(stderr);
-		close(STDERR_FILENO);
-		dup2(saved_stderr, STDERR_FILENO);
-		close(saved_stderr);
+		klock_release(lock_fd);
+	} else {
+		exitcode = -1;
+	}
+
+	// Restore orig output streams
+	fflush(stdout);
+	dup2(saved_stdout, STDOUT_FILENO);
+	close(saved_stdout);
+	fflush(stderr);
+	dup2(saved_stderr, STDERR_FILENO);
+	close(saved_stderr);
+
+	return exitcode;
+}
+
+
+static bool_t kexec_prepare_inplace(kexec_t *exec)
+{
+	exec->stdout = kexec_sink_new();
+	if (exec->stdout < 0)
+		return BOOL_FALSE;
+	exec->stderr = kexec_sink_new();
+	if (exec->stderr < 0)
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+// === SYNC symbol execution (in-place)
+// The function will be executed right here and its output will be written
+// to in-memory sinks. The sinks will be drained to kexec's buffers when
+// the whole ACTION sequence is done. No processes are forked.
+static bool_t exec_action_inplace(const kexec_t *exec, kcontext_t *context,
+	const kaction_t *action, int *retcode)
+{
+	ksym_fn fn = NULL;
+	int exitcode = 0;
 
+	fn = ksym_function(kaction_sym(action));
+
+	// Execute sym function right here
+	exitcode = kexec_call_captured(fn, context, exec->stdout, exec->stderr);
+	if (retcode)
+		*retcode = exitcode;
+
+	return BOOL_TRUE;
+}
+
+
+// Captured output of sync sym those can't be written to destination
+// without blocking. It's written by kexec_feed() when destination is ready.
+static void kexec_feed_free(void *data)
+{
+	kexec_feed_t *feed = (kexec_feed_t *)data;
+
+	if (!feed)
+		return;
+
+	close(feed->sink);
+	fcntl(feed->fd, F_SETFL, feed->flags);
+	close(feed->fd);
+	faux_free(feed);
+}
+
+
+// Returns BOOL_TRUE if feed is finished. It's finished if all data are
+// written or destination is broken. Data for broken destination are
+// dropped.
+static bool_t kexec_feed_write(kexec_feed_t *feed)
+{
+	if (kexec_sink_write(feed->sink, feed->fd))
 		return BOOL_TRUE;
+	if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+		return BOOL_FALSE;
 
-	// Child (Output grabber)
-	} else {
-		int fds[][2] = {
-			{pipe_stdout[0], kcontext_stdout(context)},
-			{pipe_stderr[0], kcontext_stderr(context)},
-			{-1, -1},
-		};
-		grabber(fds); // Grabber will not return
+	return BOOL_TRUE;
+}
+
+
+// Context is waiting for its output to be written
+static bool_t kexec_context_is_feeding(const kexec_t *exec,
+	const kcontext_t *context)
+{
+	faux_list_node_t *iter = NULL;
+	kexec_feed_t *feed = NULL;
+
+	iter = faux_list_head(exec->feeds);
+	while ((feed = (kexec_feed_t *)faux_list_each(&iter))) {
+		if (feed->context == context)
+			return BOOL_TRUE;
+	}
+
+	return BOOL_FALSE;
+}
+
+
+// Delivers captured output of sync sym to its destination. The sink is
+// owned by function. Returns BOOL_TRUE if destination is full and the rest
+// of sink content is queued to be written later.
+static bool_t kexec_sink_deliver(const kexec_t *exec, kcontext_t *context,
+	int sink, int fd)
+{
+	kexec_feed_t *feed = NULL;
+	faux_list_node_t *iter = NULL;
+	kexec_feed_t *queued = NULL;
+
+	if ((fd < 0) || (lseek(sink, 0, SEEK_CUR) <= 0)) { // Nothing to do
+		close(sink);
+		return BOOL_FALSE;
 	}
 
-	exec = exec; // Happy compiler
+	// Destination is read by kexec owner. Get all pending data first to
+	// keep the output order. Then append captured output. The owner will
+	// send buffers later.
+	if (fd == exec->local_stdout) {
+		kexec_fd_drain(exec->stdout, kexec_bufraw(exec));
+		kexec_sink_drain(sink, kexec_bufraw(exec));
+		close(sink);
+		return BOOL_FALSE;
+	}
+	if (fd == exec->local_stderr) {
+		kexec_fd_drain(exec->stderr, exec->buferr);
+		kexec_sink_drain(sink, exec->buferr);
+		close(sink);
+		return BOOL_FALSE;
+	}
+
+	// Destination is read by another process (filter) or it's a
+	// pseudoterminal. Don't block session's event loop. Non-blocking mode
+	// is set for the whole file description so it's restored when feed is
+	// finished. Another writers (the next ACTIONs of context) wait for
+	// feed anyway.
+	feed = faux_zmalloc(sizeof(*feed));
+	assert(feed);
+	if (!feed) {
+		close(sink);
+		return BOOL_FALSE;
+	}
+	feed->context = context;
+	feed->sink = sink;
+	feed->dest = fd;
+	feed->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	if (feed->fd < 0) {
+		close(sink);
+		faux_free(feed);
+		return BOOL_FALSE;
+	}
+	feed->flags = fcntl(feed->fd, F_GETFL);
+	fcntl(feed->fd, F_SETFL, feed->flags | O_NONBLOCK);
+	lseek(sink, 0, SEEK_SET);
+
+	// Output of another context to the same destination is not written
+	// yet. Keep the order.
+	iter = faux_list_head(exec->feeds);
+	while ((queued = (kexec_feed_t *)faux_list_each(&iter))) {
+		if (queued->dest == fd)
+			break;
+	}
+	if (!queued && kexec_feed_write(feed)) {
+		kexec_feed_free(feed);
+		return BOOL_FALSE;
+	}
+	faux_list_add(exec->feeds, feed);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Returns descriptor the kexec's owner must wait for.
+ *
+ * Sync ACTION's output that was not written to destination without
+ * blocking is queued. The owner waits for POLLOUT on returned descriptor
+ * and then calls kexec_feed(). The descriptor can be changed by
+ * kexec_feed() or by other kexec events. Returns -1 if there is no queued
+ * output.
+ */
+int kexec_feed_fd(const kexec_t *exec)
+{
+	kexec_feed_t *feed = NULL;
+
+	assert(exec);
+	if (!exec)
+		return -1;
+
+	feed = (kexec_feed_t *)faux_list_data(faux_list_head(exec->feeds));
+	if (!feed)
+		return -1;
+
+	return feed->fd;
+}
+
+
+/** @brief Writes queued output of sync ACTIONs.
+ *
+ * When all output of ACTION is written the ACTION sequence of its context
+ * is continued.
+ */
+bool_t kexec_feed(kexec_t *exec)
+{
+	faux_list_node_t *node = NULL;
+
+	assert(exec);
+	if (!exec)
+		return BOOL_FALSE;
+
+	while ((node = faux_list_head(exec->feeds))) {
+		kexec_feed_t *feed = (kexec_feed_t *)faux_list_data(node);
+		kcontext_t *context = feed->context;
+
+		if (!kexec_feed_write(feed))
+			break; // Destination is full. Wait for it.
+		faux_list_del(exec->feeds, node);
+		if (!kexec_context_is_feeding(exec, context))
+			exec_action_sequence(exec, context, KEXEC_FEED_PID, 0);
+	}
+
+	return BOOL_TRUE;
+}
+
+
+// === SYNC symbol execution
+// The function will be executed right here. It's necessary for
+// navigation implementation for example. The function output is captured
+// by in-memory sinks and then it's delivered to context's streams in
+// order. No processes are forked. If destination is full the rest of
+// output is queued and the next ACTION waits for it (see kexec_feed()).
+static bool_t exec_action_sync(const kexec_t *exec, kcontext_t *context,
+	const kaction_t *action, pid_t *pid, int *retcode)
+{
+	ksym_fn fn = NULL;
+	int exitcode = 0;
+	int sink_out = -1;
+	int sink_err = -1;
+	bool_t queued = BOOL_FALSE;
+
+	sink_out = kexec_sink_new();
+	if (sink_out < 0)
+		return BOOL_FALSE;
+	sink_err = kexec_sink_new();
+	if (sink_err < 0) {
+		close(sink_out);
+		return BOOL_FALSE;
+	}
+
+	fn = ksym_function(kaction_sym(action));
+
+	// Execute sym function right here
+	exitcode = kexec_call_captured(fn, context, sink_out, sink_err);
+	if (retcode)
+		*retcode = exitcode;
+
+	if (kexec_sink_deliver(exec, context, sink_out,
+		kcontext_stdout(context)))
+		queued = BOOL_TRUE;
+	if (kexec_sink_deliver(exec, context, sink_err,
+		kcontext_stderr(context)))
+		queued = BOOL_TRUE;
+	if (queued && pid)
+		*pid = KEXEC_FEED_PID;
 
 	return BOOL_TRUE;
 }
@@ -553,9 +922,46 @@ static bool_t exec_action_async(const kexec_t *exec, kcontext_t *context,
 	const kaction_t *action, pid_t *pid)
 {
 	ksym_fn fn = NULL;
+	ksym_spawn_fn spawn_fn = NULL;
 	int exitcode = 0;
 	pid_t child_pid = -1;
 	sigset_t sigs;
+	int lock_fd = -1;
+
+	// Symbol can describe external program to execute. Then vfork() is
+	// used instead of fork() of the whole session process.
+	// The vfork()ed child can't wait for named lock because parent is
+	// suspended till exec.
+	spawn_fn = ksym_spawn(kaction_sym(action));
+	if (spawn_fn && !kaction_lock(action)) {
+		kspawn_t *spawn = kspawn_new();
+		if (spawn_fn(context, spawn)) {
+			child_pid = kspawn_launch(spawn, kcontext_stdin(context),
+				kcontext_stdout(context),
+				kcontext_stderr(context), exec->pts_fname);
+			kspawn_free(spawn);
+			if (child_pid == -1)
+				return BOOL_FALSE;
+			if (pid)
+				*pid = child_pid;
+			return BOOL_TRUE;
+		}
+		// Can't spawn. Execute symbol within forked process.
+		kspawn_free(spawn);
+	}
+
+	// Pre-forked worker can execute ACTION. Worker can't get controlling
+	// terminal so it's used for non-terminal ACTIONs only.
+	if (ksession_workers(exec->session) &&
+		(KCONTEXT_TYPE_ACTION == exec->type) && !exec->pts_fname) {
+		child_pid = kworkers_run(ksession_workers(exec->session),
+			context);
+		if (child_pid != -1) {
+			if (pid)
+				*pid = child_pid;
+			return BOOL_TRUE;
+		}
+	}
 
 	fn = ksym_function(kaction_sym(action));
 
@@ -591,7 +997,7 @@ static bool_t exec_action_async(const kexec_t *exec, kcontext_t *context,
 	if (exec->pts_fname != NULL) {
 		int fd = -1;
 		setsid();
-		fd = open(exec->pts_fname, O_RDWR, 0);
+		fd = open(exec->pts_fname, O_RDWR | O_CLOEXEC, 0);
 		if (fd < 0)
 			_exit(-1);
 		if (isatty(kcontext_stdin(context)))
@@ -605,6 +1011,18 @@ static bool_t exec_action_async(const kexec_t *exec, kcontext_t *context,
 	dup2(kcontext_stdin(context), STDIN_FILENO);
 	dup2(kcontext_stdout(context), STDOUT_FILENO);
 	dup2(kcontext_stderr(context), STDERR_FILENO);
+	kcontext_set_stdin(context, STDIN_FILENO);
+	kcontext_set_stdout(context, STDOUT_FILENO);
+	kcontext_set_stderr(context, STDERR_FILENO);
+	// ACTION process must not hold session's descriptors. Else pipes of
+	// other stages don't get EOF while ACTION is running. Syslog will
+	// reopen its socket if needed.
+	closelog();
+	kspawn_close_fds(NULL, 0);
+
+	// Named lock is held by ACTION process till exit
+	if (!klock_action(context, BOOL_TRUE, &lock_fd))
+		_exit(-1);
 
 	exitcode = fn(context);
 	// We will use _exit() later so stdio streams will remain unflushed.
@@ -632,7 +1050,9 @@ static bool_t exec_action(const kexec_t *exec, kcontext_t *context,
 	if (!action)
 		return BOOL_FALSE;
 
-	if (kaction_is_sync(action))
+	if (kaction_is_sync(action) && exec->inplace)
+		rc = exec_action_inplace(exec, context, action, retcode);
+	else if (kaction_is_sync(action))
 		rc = exec_action_sync(exec, context, action, pid, retcode);
 	else
 		rc = exec_action_async(exec, context, action, pid);
@@ -696,8 +1116,9 @@ static bool_t exec_action_sequence(const kexec_t *exec, kcontext_t *context,
 			kcontext_set_done(context, BOOL_TRUE);
 			// Close the stdout of finished ACTION sequence to inform
 			// process next in pipe about EOF. Else filter will not
-			// stop at all.
-			close(kcontext_stdout(context));
+			// stop at all. In-place execution has no such stream.
+			if (kcontext_stdout(context) != -1)
+				close(kcontext_stdout(context));
 			kcontext_set_stdout(context, -1);
 			return BOOL_TRUE;
 		}
@@ -722,7 +1143,7 @@ static bool_t exec_action_sequence(const kexec_t *exec, kcontext_t *context,
 
 		// SYNC: Compute new value for retcode.
 		// Sync actions return retcode immediatelly. Their forked
-		// processes are for output handling only.
+		// feeder processes (if any) are for output handling only.
 		if (is_sync && kaction_update_retcode(action))
 			kcontext_set_retcode(context, exitstatus);
 
@@ -756,6 +1177,230 @@ bool_t kexec_continue_command_execution(kexec_t *exec, pid_t pid, int wstatus)
 }
 
 
+// Returns line filter functions if context can be executed within
+// process as a filter
+static const ksym_filter_t *kexec_context_filter(const kcontext_t *context)
+{
+	const kentry_t *entry = kcontext_command(context);
+	const kaction_t *action = NULL;
+	const ksym_t *sym = NULL;
+
+	if (!entry)
+		return NULL;
+	if (kentry_filter(entry) != KENTRY_FILTER_TRUE)
+		return NULL;
+	if (kentry_actions_len(entry) != 1)
+		return NULL;
+	action = (const kaction_t *)faux_list_data(
+		faux_list_head(kentry_actions(entry)));
+	sym = kaction_sym(action);
+	if (!sym)
+		return NULL;
+
+	return ksym_filter(sym);
+}
+
+
+// Trailing filters with line filter functions are executed within process.
+// They get output of the last real process. So they don't need processes
+// and pipes.
+static bool_t kexec_prepare_filters(kexec_t *exec)
+{
+	faux_list_node_t *iter = NULL;
+	faux_list_node_t *first = NULL;
+	size_t num = 0;
+	size_t i = 0;
+
+	// Dry-run doesn't execute filters at all
+	if ((exec->type != KCONTEXT_TYPE_ACTION) || exec->dry_run)
+		return BOOL_TRUE;
+
+	// The first context is never a filter
+	iter = faux_list_tail(exec->contexts);
+	while (iter && (iter != faux_list_head(exec->contexts)) &&
+		kexec_context_filter(faux_list_data(iter))) {
+		first = iter;
+		iter = faux_list_prev_node(iter);
+		num++;
+	}
+	if (0 == num)
+		return BOOL_TRUE;
+
+	exec->filters = faux_zmalloc(num * sizeof(*exec->filters));
+	assert(exec->filters);
+	for (iter = first; iter; iter = faux_list_next_node(iter)) {
+		kcontext_t *context = (kcontext_t *)faux_list_data(iter);
+		kexec_filter_t *filter = &exec->filters[i];
+
+		filter->ops = kexec_context_filter(context);
+		filter->state = filter->ops->init(context);
+		// Can't create filter (wrong pattern for example). Execute all
+		// filters as processes. They will report error.
+		if (!filter->state) {
+			faux_buf_t *trash = faux_buf_new(0);
+			size_t j = 0;
+			for (j = 0; j < i; j++)
+				exec->filters[j].ops->fini(
+					exec->filters[j].state, trash);
+			faux_buf_free(trash);
+			faux_free(exec->filters);
+			exec->filters = NULL;
+			return BOOL_TRUE;
+		}
+		i++;
+	}
+	exec->filters_num = num;
+	exec->bufraw = faux_buf_new(0);
+
+	// Filter contexts are done already
+	for (iter = first; iter; iter = faux_list_next_node(iter))
+		kcontext_set_done((kcontext_t *)faux_list_data(iter), BOOL_TRUE);
+
+	return BOOL_TRUE;
+}
+
+
+// Writes line to output if it passes all the filters starting from
+// specified one
+static void kexec_filter_pass(kexec_t *exec, size_t from,
+	char *line, size_t len, bool_t newline)
+{
+	size_t i = 0;
+
+	for (i = from; i < exec->filters_num; i++) {
+		if (!exec->filters[i].ops->line(exec->filters[i].state,
+			line, len))
+			return;
+	}
+	if (newline)
+		line[len] = '\n';
+	faux_buf_write(exec->bufout, line, len + (newline ? 1 : 0));
+}
+
+
+// Passes all complete lines of data through filters starting from
+// specified one. Returns length of processed data.
+static size_t kexec_filter_lines(kexec_t *exec, size_t from,
+	char *data, size_t len)
+{
+	size_t start = 0;
+	char *nl = NULL;
+
+	while ((nl = memchr(data + start, '\n', len - start))) {
+		size_t line_len = nl - (data + start);
+		*nl = '\0';
+		kexec_filter_pass(exec, from, data + start, line_len, BOOL_TRUE);
+		start += line_len + 1;
+	}
+
+	return start;
+}
+
+
+/** @brief Passes output through filters executed within process.
+ *
+ * Owner of kexec must call it after reading of stdout to buffer returned
+ * by kexec_bufraw(). Filtered output is appended to kexec's bufout so
+ * output held by owner is never filtered twice. Complete lines are
+ * filtered. Incomplete line is saved till the next call. The "final" flag
+ * means that output is over. Filters write their final output then.
+ */
+bool_t kexec_filter_stdout(kexec_t *exec, bool_t final)
+{
+	size_t len = 0;
+	size_t total = 0;
+	size_t processed = 0;
+	char *data = NULL;
+	size_t i = 0;
+
+	assert(exec);
+	if (!exec)
+		return BOOL_FALSE;
+	if (0 == exec->filters_num)
+		return BOOL_TRUE;
+
+	len = faux_buf_len(exec->bufraw);
+	if ((0 == len) && !final)
+		return BOOL_TRUE;
+
+	// Linear buffer: incomplete line from previous call + new data
+	total = exec->filter_pending_len + len;
+	data = realloc(exec->filter_pending, total + 1);
+	assert(data);
+	if (!data)
+		return BOOL_FALSE;
+	exec->filter_pending = NULL;
+	exec->filter_pending_len = 0;
+	faux_buf_read(exec->bufraw, data + total - len, len);
+
+	processed = kexec_filter_lines(exec, 0, data, total);
+	if (!final) {
+		memmove(data, data + processed, total - processed);
+		exec->filter_pending = data;
+		exec->filter_pending_len = total - processed;
+		return BOOL_TRUE;
+	}
+
+	// Last line without trailing newline
+	if (processed < total) {
+		data[total] = '\0';
+		kexec_filter_pass(exec, 0, data + processed,
+			total - processed, BOOL_FALSE);
+	}
+	faux_free(data);
+
+	// Final output of each filter goes through the next filters
+	for (i = 0; i < exec->filters_num; i++) {
+		faux_buf_t *out = faux_buf_new(0);
+		exec->filters[i].ops->fini(exec->filters[i].state, out);
+		len = faux_buf_len(out);
+		if (len > 0) {
+			data = faux_malloc(len + 1);
+			faux_buf_read(out, data, len);
+			processed = kexec_filter_lines(exec, i + 1, data, len);
+			if (processed < len) {
+				data[len] = '\0';
+				kexec_filter_pass(exec, i + 1, data + processed,
+					len - processed, BOOL_FALSE);
+			}
+			faux_free(data);
+		}
+		faux_buf_free(out);
+	}
+	faux_free(exec->filters);
+	exec->filters = NULL;
+	exec->filters_num = 0;
+
+	return BOOL_TRUE;
+}
+
+
+// Buffer to read stdout to. Unfiltered output must not be mixed with
+// already filtered one.
+faux_buf_t *kexec_bufraw(const kexec_t *exec)
+{
+	assert(exec);
+	if (!exec)
+		return NULL;
+
+	if (exec->bufraw)
+		return exec->bufraw;
+
+	return exec->bufout;
+}
+
+
+// Stdout is passed through filters executed within process
+bool_t kexec_filtered(const kexec_t *exec)
+{
+	assert(exec);
+	if (!exec)
+		return BOOL_FALSE;
+
+	return (exec->filters_num > 0) ? BOOL_TRUE : BOOL_FALSE;
+}
+
+
 bool_t kexec_exec(kexec_t *exec)
 {
 	kcontext_t *context = NULL;
@@ -768,9 +1413,17 @@ bool_t kexec_exec(kexec_t *exec)
 		return BOOL_FALSE;
 
 	// Firsly prepare kexec object for execution. The file streams must
-	// be created for stdin, stdout, stderr of processes.
-	if (!kexec_prepare(exec))
+	// be created for stdin, stdout, stderr of processes. In-place
+	// execution needs in-memory sinks only.
+	exec->inplace = kexec_is_inplace_capable(exec);
+	if (!kexec_prepare_filters(exec))
+		return BOOL_FALSE;
+	if (exec->inplace) {
+		if (!kexec_prepare_inplace(exec))
+			return BOOL_FALSE;
+	} else if (!kexec_prepare(exec)) {
 		return BOOL_FALSE;
+	}
 
 	// Pre-change VIEW if command has "restore" flag. Only first command in
 	// line (if many commands are piped) matters. Filters can't change the
@@ -791,6 +1444,13 @@ bool_t kexec_exec(kexec_t *exec)
 	// ACTION's process.
 	kexec_continue_command_execution(exec, -1, 0);
 
+	// In-place execution is already done. Move captured output to buffers
+	// like event loop does for forked processes.
+	if (exec->inplace) {
+		kexec_sink_drain(exec->stdout, kexec_bufraw(exec));
+		kexec_sink_drain(exec->stderr, exec->buferr);
+	}
+
 	return BOOL_TRUE;
 }
 
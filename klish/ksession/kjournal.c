@@ -0,0 +1,259 @@
+/** @file kjournal.c
+ *
+ * Journal of service ACTIONs executed by resumable request. Records are
+ * positional. Parsing is deterministic so the next attempt executes the same
+ * sequence of service ACTIONs and the N-th call gets the N-th record. Record
+ * is reserved before ACTION execution because ACTION's parsing can execute
+ * nested service ACTIONs.
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <faux/str.h>
+#include <klish/khelper.h>
+#include <klish/kexec.h>
+#include <klish/kjournal.h>
+
+
+typedef struct {
+	bool_t filled; // Record contains result
+	bool_t ok;
+	int retcode;
+	char *out;
+} kjournal_rec_t;
+
+struct kjournal_s {
+	bool_t active; // Request is processed in resumable mode
+	kjournal_rec_t *recs;
+	size_t len;
+	size_t size; // Allocated records
+	size_t pos; // Replay position
+	kexec_t *pending; // Service ACTION that is executed now
+	size_t pending_index;
+	size_t suspends; // Number of suspensions of request
+};
+
+
+// Active
+KGET_BOOL(journal, active);
+
+// Number of records
+KGET(journal, size_t, len);
+
+// Pending service ACTION
+KGET(journal, kexec_t *, pending);
+
+
+kjournal_t *kjournal_new(void)
+{
+	kjournal_t *journal = NULL;
+
+	journal = faux_zmalloc(sizeof(*journal));
+	assert(journal);
+	if (!journal)
+		return NULL;
+
+	journal->active = BOOL_FALSE;
+	journal->recs = NULL;
+	journal->len = 0;
+	journal->size = 0;
+	journal->pos = 0;
+	journal->pending = NULL;
+	journal->pending_index = 0;
+	journal->suspends = 0;
+
+	return journal;
+}
+
+
+void kjournal_free(kjournal_t *journal)
+{
+	if (!journal)
+		return;
+
+	kjournal_clear(journal);
+	faux_free(journal->recs);
+
+	faux_free(journal);
+}
+
+
+/** @brief Drops all records and pending service ACTION.
+ */
+void kjournal_clear(kjournal_t *journal)
+{
+	size_t i = 0;
+
+	assert(journal);
+	if (!journal)
+		return;
+
+	for (i = 0; i < journal->len; i++)
+		faux_str_free(journal->recs[i].out);
+	journal->len = 0;
+	journal->pos = 0;
+	kexec_free(journal->pending);
+	journal->pending = NULL;
+	journal->pending_index = 0;
+	journal->suspends = 0;
+}
+
+
+/** @brief Checks if request can't be suspended anymore.
+ *
+ * Every attempt replays the whole journal. So the number of suspensions is
+ * limited to keep request processing linear.
+ */
+bool_t kjournal_exhausted(const kjournal_t *journal)
+{
+	assert(journal);
+	if (!journal)
+		return BOOL_TRUE;
+
+	return (journal->suspends >= KJOURNAL_MAX_SUSPENDS);
+}
+
+
+/** @brief Starts (or restarts) resumable processing of request.
+ *
+ * Replay begins with the first record.
+ */
+void kjournal_begin(kjournal_t *journal)
+{
+	assert(journal);
+	if (!journal)
+		return;
+
+	journal->active = BOOL_TRUE;
+	journal->pos = 0;
+}
+
+
+/** @brief Finishes resumable processing of request.
+ *
+ * Records are dropped if request is completed. They are kept for the next
+ * attempt if some service ACTION is still executed.
+ *
+ * @return BOOL_TRUE if request is suspended.
+ */
+bool_t kjournal_end(kjournal_t *journal)
+{
+	assert(journal);
+	if (!journal)
+		return BOOL_FALSE;
+
+	journal->active = BOOL_FALSE;
+	if (journal->pending)
+		return BOOL_TRUE;
+	kjournal_clear(journal);
+
+	return BOOL_FALSE;
+}
+
+
+/** @brief Gets the next record.
+ *
+ * The record is created if journal is over. Caller must execute service
+ * ACTION and fill record by index if record is empty.
+ *
+ * @return BOOL_TRUE if record contains result of previous attempt.
+ */
+bool_t kjournal_next(kjournal_t *journal, size_t *index,
+	bool_t *ok, int *retcode, const char **out)
+{
+	kjournal_rec_t *rec = NULL;
+
+	assert(journal);
+	if (!journal)
+		return BOOL_FALSE;
+
+	if (journal->pos == journal->len) {
+		if (journal->len == journal->size) {
+			journal->size = journal->size ? journal->size * 2 : 8;
+			journal->recs = realloc(journal->recs,
+				journal->size * sizeof(*journal->recs));
+			assert(journal->recs);
+		}
+		memset(&journal->recs[journal->len], 0, sizeof(*rec));
+		journal->len++;
+	}
+	if (index)
+		*index = journal->pos;
+	rec = &journal->recs[journal->pos++];
+	if (!rec->filled)
+		return BOOL_FALSE;
+
+	if (ok)
+		*ok = rec->ok;
+	if (retcode)
+		*retcode = rec->retcode;
+	if (out)
+		*out = rec->out;
+
+	return BOOL_TRUE;
+}
+
+
+bool_t kjournal_set(kjournal_t *journal, size_t index,
+	bool_t ok, int retcode, const char *out)
+{
+	kjournal_rec_t *rec = NULL;
+
+	assert(journal);
+	if (!journal)
+		return BOOL_FALSE;
+	if (index >= journal->len)
+		return BOOL_FALSE;
+
+	rec = &journal->recs[index];
+	faux_str_free(rec->out);
+	rec->filled = BOOL_TRUE;
+	rec->ok = ok;
+	rec->retcode = retcode;
+	rec->out = faux_str_dup(out);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Sets service ACTION that request waits for.
+ *
+ * Journal owns the kexec. Its result will be written to record by index.
+ */
+bool_t kjournal_set_pending(kjournal_t *journal, size_t index, kexec_t *exec)
+{
+	assert(journal);
+	if (!journal)
+		return BOOL_FALSE;
+	if (journal->pending)
+		return BOOL_FALSE;
+	if (index >= journal->len)
+		return BOOL_FALSE;
+
+	journal->pending = exec;
+	journal->pending_index = index;
+	journal->suspends++;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Saves result of pending service ACTION and frees its kexec.
+ */
+bool_t kjournal_complete(kjournal_t *journal, int retcode, const char *out)
+{
+	assert(journal);
+	if (!journal)
+		return BOOL_FALSE;
+	if (!journal->pending)
+		return BOOL_FALSE;
+
+	kjournal_set(journal, journal->pending_index, BOOL_TRUE, retcode, out);
+	kexec_free(journal->pending);
+	journal->pending = NULL;
+	journal->pending_index = 0;
+
+	return BOOL_TRUE;
+}
@@ -0,0 +1,207 @@
+/** @file klock.c
+ *
+ * Named locks are byte range locks within the common lock file. The name
+ * is hashed to the offset of one byte range. Different names with the same
+ * offset are reported while scheme preparing. Open file description locks
+ * (F_OFD_SETLK) are used so each lock holder opens the file itself. Lock
+ * is released when holder closes the file or exits (even on crash). Shared
+ * (reader's) and exclusive (writer's) locks are supported by the kernel.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include <faux/faux.h>
+#include <faux/str.h>
+#include <klish/kaction.h>
+#include <klish/kcontext.h>
+#include <klish/ksession.h>
+#include <klish/klock.h>
+
+
+/** @brief Lock name to offset within lock file.
+ *
+ * FNV-1a hash. The range of off_t is large so collisions are unlikely.
+ * Anyway kscheme_prepare() checks that names of scheme don't collide.
+ */
+off_t klock_offset(const char *name)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	const unsigned char *p = (const unsigned char *)name;
+
+	for (; *p; p++) {
+		hash ^= *p;
+		hash *= 0x100000001b3ULL;
+	}
+
+	return (off_t)(hash & 0x3fffffffffffffffULL);
+}
+
+
+// Opens lock file. The file must be a regular file owned by klishd's user.
+// Else anybody who can create the file (it's in /tmp for example) can hold
+// locks forever or make klishd to lock foreign file.
+static int klock_open(const char *path, int flags)
+{
+	int fd = -1;
+	struct stat st = {};
+
+	fd = open(path, O_RDWR | O_NOFOLLOW | O_CLOEXEC | flags, 0600);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return -1;
+	}
+	if (!S_ISREG(st.st_mode) || (st.st_uid != geteuid())) {
+		close(fd);
+		errno = EPERM;
+		return -1;
+	}
+
+	return fd;
+}
+
+
+/** @brief Creates lock file.
+ *
+ * Listener creates lock file on start. Service processes open it later.
+ * The directory of lock file is created if it doesn't exist. Function
+ * fails if existing file is not owned by current user.
+ */
+bool_t klock_create(const char *path)
+{
+	int fd = -1;
+
+	assert(path);
+	if (!path)
+		return BOOL_FALSE;
+
+	fd = klock_open(path, O_CREAT);
+	if ((fd < 0) && (ENOENT == errno)) {
+		char *dir = faux_str_dup(path);
+		char *slash = strrchr(dir, '/');
+		if (slash && (slash != dir)) {
+			*slash = '\0';
+			mkdir(dir, 0755);
+		}
+		faux_str_free(dir);
+		fd = klock_open(path, O_CREAT);
+	}
+	if (fd < 0)
+		return BOOL_FALSE;
+	close(fd);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Acquires named lock.
+ *
+ * @param [in] path Lock file.
+ * @param [in] name Name of lock.
+ * @param [in] shared Shared (reader's) lock. Else exclusive.
+ * @param [in] wait Wait for lock. Else fail immediately if lock is busy.
+ * @return Descriptor of lock holder or -1 on error. The errno is EAGAIN
+ * if lock is busy.
+ */
+int klock_acquire(const char *path, const char *name,
+	bool_t shared, bool_t wait)
+{
+	int fd = -1;
+	struct flock fl = {};
+	int r = -1;
+
+	assert(path);
+	assert(name);
+	if (!path || !name)
+		return -1;
+
+	fd = klock_open(path, 0);
+	if (fd < 0)
+		return -1;
+
+	fl.l_type = shared ? F_RDLCK : F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = klock_offset(name);
+	fl.l_len = 1;
+	fl.l_pid = 0; // Must be 0 for OFD locks
+	do {
+		r = fcntl(fd, wait ? F_OFD_SETLKW : F_OFD_SETLK, &fl);
+	} while ((r < 0) && (EINTR == errno));
+	if (r < 0) {
+		int saved_errno = errno;
+		close(fd);
+		// Some systems return EACCES instead of EAGAIN
+		errno = (EACCES == saved_errno) ? EAGAIN : saved_errno;
+		return -1;
+	}
+
+	return fd;
+}
+
+
+void klock_release(int fd)
+{
+	if (fd < 0)
+		return;
+
+	close(fd);
+}
+
+
+/** @brief Acquires named lock of context's ACTION.
+ *
+ * The lock_fd is -1 if ACTION doesn't need lock. Error message is printed
+ * to stderr if lock can't be acquired. If may_wait is BOOL_FALSE the
+ * ACTION's "lock_wait" attribute is ignored and busy lock is an error.
+ * It's for sync ACTIONs executed within session process. The waiting
+ * would block all the sessions of process.
+ */
+bool_t klock_action(const kcontext_t *context, bool_t may_wait, int *lock_fd)
+{
+	const kaction_t *action = NULL;
+	const char *path = NULL;
+	const char *name = NULL;
+	int fd = -1;
+
+	assert(context);
+	assert(lock_fd);
+	if (!context || !lock_fd)
+		return BOOL_FALSE;
+	*lock_fd = -1;
+
+	action = kcontext_action(context);
+	if (!action)
+		return BOOL_TRUE;
+	name = kaction_lock(action);
+	if (!name)
+		return BOOL_TRUE;
+
+	if (kcontext_session(context))
+		path = ksession_lockfile(kcontext_session(context));
+	if (!path)
+		path = KLOCK_DEFAULT_PATH;
+
+	fd = klock_acquire(path, name, kaction_lock_shared(action),
+		may_wait && kaction_lock_wait(action));
+	if (fd < 0) {
+		if (EAGAIN == errno)
+			fprintf(stderr, "Error: Lock \"%s\" is busy\n", name);
+		else
+			fprintf(stderr, "Error: Can't acquire lock \"%s\"\n",
+				name);
+		return BOOL_FALSE;
+	}
+	*lock_fd = fd;
+
+	return BOOL_TRUE;
+}
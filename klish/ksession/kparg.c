@@ -11,12 +11,14 @@
 #include <faux/str.h>
 #include <klish/khelper.h>
 #include <klish/kentry.h>
+#include <klish/karena.h>
 #include <klish/kpargv.h> // Contains parg and pargv
 
 
 struct kparg_s {
 	const kentry_t *entry;
 	char *value;
+	karena_t *arena; // Arena parg is allocated within. Don't free.
 };
 
 
@@ -24,7 +26,6 @@ struct kparg_s {
 KGET(parg, const kentry_t *, entry);
 
 // Value
-KSET_STR(parg, value);
 KGET_STR(parg, value);
 
 
@@ -48,10 +49,58 @@ kparg_t *kparg_new(const kentry_t *entry, const char *value)
 }
 
 
+/** @brief Creates parg within arena.
+ *
+ * Such parg and its value are freed with the arena. The kparg_free() does
+ * nothing for it.
+ */
+kparg_t *kparg_new_in_arena(karena_t *arena, const kentry_t *entry,
+	const char *value)
+{
+	kparg_t *parg = NULL;
+
+	if (!arena)
+		return kparg_new(entry, value);
+	if (!entry)
+		return NULL;
+
+	parg = karena_alloc(arena, sizeof(*parg));
+	assert(parg);
+	if (!parg)
+		return NULL;
+
+	// Initialize
+	parg->entry = entry;
+	parg->arena = arena;
+	kparg_set_value(parg, value);
+
+	return parg;
+}
+
+
+bool_t kparg_set_value(kparg_t *parg, const char *value)
+{
+	assert(parg);
+	if (!parg)
+		return BOOL_FALSE;
+
+	if (parg->arena) {
+		parg->value = karena_strdup(parg->arena, value);
+		return BOOL_TRUE;
+	}
+	faux_str_free(parg->value);
+	parg->value = faux_str_dup(value);
+
+	return BOOL_TRUE;
+}
+
+
 void kparg_free(kparg_t *parg)
 {
 	if (!parg)
 		return;
+	if (parg->arena) // Will be freed with arena
+		return;
 
 	faux_str_free(parg->value);
 
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <syslog.h>
 
 #include <faux/list.h>
@@ -13,6 +14,13 @@
 #include <klish/kpargv.h>
 
 
+// Packrat memo record. Result of parsing ENTRY at specified argv position.
+typedef struct {
+	const void *entry; // NULL for free slot
+	const void *pos;
+	kpargv_status_e status;
+} kpargv_memo_t;
+
 struct kpargv_s {
 	faux_list_t *pargs;
 	faux_list_t *completions;
@@ -23,8 +31,22 @@ struct kpargv_s {
 	kpargv_purpose_e purpose; // Exec/Completion/Help
 	char *last_arg;
 	kparg_t *candidate_parg; // Don't free
+	kpargv_memo_t *memo; // Open addressing hash
+	size_t memo_size; // Power of 2
+	size_t memo_len;
+	size_t memo_hits; // Statistics
+	size_t memo_misses;
+	karena_t *arena; // Pargs and parsing temporaries
 };
 
+// Arena
+KGET(pargv, karena_t *, arena);
+
+// Packrat memo statistics
+KGET(pargv, size_t, memo_len);
+KGET(pargv, size_t, memo_hits);
+KGET(pargv, size_t, memo_misses);
+
 // Status
 KGET(pargv, kpargv_status_e, status);
 KSET(pargv, kpargv_status_e, status);
@@ -107,6 +129,13 @@ kpargv_t *kpargv_new()
 	pargv->purpose = KPURPOSE_EXEC;
 	pargv->last_arg = NULL;
 	pargv->candidate_parg = NULL;
+	pargv->memo = NULL;
+	pargv->memo_size = 0;
+	pargv->memo_len = 0;
+	pargv->memo_hits = 0;
+	pargv->memo_misses = 0;
+	pargv->arena = karena_new(KARENA_DEFAULT_CHUNK_SIZE);
+	assert(pargv->arena);
 
 	// Parsed arguments list
 	pargv->pargs = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
@@ -131,6 +160,9 @@ void kpargv_free(kpargv_t *pargv)
 
 	faux_list_free(pargv->pargs);
 	faux_list_free(pargv->completions);
+	faux_free(pargv->memo);
+	// Pargs can be allocated within arena so free arena after lists
+	karena_free(pargv->arena);
 
 	free(pargv);
 }
@@ -258,6 +290,102 @@ faux_list_t *kpargv_find_multi(const kpargv_t *pargv, const char *entry_name)
 }
 
 
+static size_t kpargv_memo_hash(const void *entry, const void *pos)
+{
+	uintptr_t hash = (uintptr_t)entry;
+
+	hash ^= (uintptr_t)pos + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+
+	return (size_t)(hash ^ (hash >> 16));
+}
+
+
+static kpargv_memo_t *kpargv_memo_slot(kpargv_memo_t *memo, size_t size,
+	const void *entry, const void *pos)
+{
+	size_t i = kpargv_memo_hash(entry, pos) & (size - 1);
+
+	while (memo[i].entry &&
+		((memo[i].entry != entry) || (memo[i].pos != pos)))
+		i = (i + 1) & (size - 1);
+
+	return &memo[i];
+}
+
+
+/** @brief Gets memoized result of ENTRY parsing at argv position.
+ *
+ * Memo is valid within single parsing only i.e. for the same argv.
+ */
+bool_t kpargv_memo_get(kpargv_t *pargv, const void *entry,
+	const void *pos, kpargv_status_e *status)
+{
+	kpargv_memo_t *slot = NULL;
+
+	assert(pargv);
+	if (!pargv)
+		return BOOL_FALSE;
+	if (!pargv->memo) {
+		pargv->memo_misses++;
+		return BOOL_FALSE;
+	}
+
+	slot = kpargv_memo_slot(pargv->memo, pargv->memo_size, entry, pos);
+	if (!slot->entry) {
+		pargv->memo_misses++;
+		return BOOL_FALSE;
+	}
+	if (status)
+		*status = slot->status;
+	pargv->memo_hits++;
+
+	return BOOL_TRUE;
+}
+
+
+bool_t kpargv_memo_set(kpargv_t *pargv, const void *entry,
+	const void *pos, kpargv_status_e status)
+{
+	kpargv_memo_t *slot = NULL;
+
+	assert(pargv);
+	if (!pargv)
+		return BOOL_FALSE;
+	assert(entry);
+	if (!entry)
+		return BOOL_FALSE;
+
+	// Keep load factor below 1/2
+	if ((pargv->memo_len + 1) * 2 > pargv->memo_size) {
+		size_t new_size = pargv->memo_size ? pargv->memo_size * 2 : 64;
+		kpargv_memo_t *new_memo = faux_zmalloc(new_size * sizeof(*new_memo));
+		size_t i = 0;
+		assert(new_memo);
+		if (!new_memo)
+			return BOOL_FALSE;
+		for (i = 0; i < pargv->memo_size; i++) {
+			kpargv_memo_t *old = &pargv->memo[i];
+			if (!old->entry)
+				continue;
+			*kpargv_memo_slot(new_memo, new_size,
+				old->entry, old->pos) = *old;
+		}
+		faux_free(pargv->memo);
+		pargv->memo = new_memo;
+		pargv->memo_size = new_size;
+	}
+
+	slot = kpargv_memo_slot(pargv->memo, pargv->memo_size, entry, pos);
+	if (!slot->entry)
+		pargv->memo_len++;
+	slot->entry = entry;
+	slot->pos = pos;
+	slot->status = status;
+
+	return BOOL_TRUE;
+}
+
+
 bool_t kpargv_debug(const kpargv_t *pargv)
 {
 #ifdef PARGV_DEBUG
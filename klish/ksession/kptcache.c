@@ -0,0 +1,200 @@
+/** @file kptcache.c
+ *
+ * PTYPE validation cache. The key is a PTYPE ENTRY, candidate ENTRY and
+ * candidate value. The candidate ENTRY is a part of key because the
+ * PTYPE ENTRY can be shared by linked ENTRYs but PTYPE result can depend
+ * on candidate ENTRY (see COMMAND PTYPE). The cache is direct-mapped so
+ * new record simply replaces the old one with the same slot.
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <faux/str.h>
+#include <klish/khelper.h>
+#include <klish/kentry.h>
+#include <klish/kptcache.h>
+
+
+typedef struct {
+	const kentry_t *ptype;
+	const kentry_t *entry;
+	char *value;
+	int retcode;
+	char *out;
+} kptcache_slot_t;
+
+struct kptcache_s {
+	size_t size;
+	kptcache_slot_t *slots;
+	size_t hits;
+	size_t misses;
+};
+
+
+// Hits
+KGET(ptcache, size_t, hits);
+
+// Misses
+KGET(ptcache, size_t, misses);
+
+
+kptcache_t *kptcache_new(size_t size)
+{
+	kptcache_t *cache = NULL;
+
+	if (0 == size)
+		size = KPTCACHE_DEFAULT_SIZE;
+
+	cache = faux_zmalloc(sizeof(*cache));
+	assert(cache);
+	if (!cache)
+		return NULL;
+
+	cache->size = size;
+	cache->slots = faux_zmalloc(size * sizeof(*cache->slots));
+	assert(cache->slots);
+	cache->hits = 0;
+	cache->misses = 0;
+
+	return cache;
+}
+
+
+static void kptcache_slot_clear(kptcache_slot_t *slot)
+{
+	faux_str_free(slot->value);
+	faux_str_free(slot->out);
+	memset(slot, 0, sizeof(*slot));
+}
+
+
+void kptcache_free(kptcache_t *cache)
+{
+	if (!cache)
+		return;
+
+	kptcache_clear(cache);
+	faux_free(cache->slots);
+
+	faux_free(cache);
+}
+
+
+/** @brief Drops all records.
+ *
+ * The key contains pointers to ENTRYs. Cache belongs to session and the
+ * session's scheme is never changed. Reloaded scheme is used by new
+ * sessions only and old scheme lives while its sessions live. So records
+ * can't point to freed ENTRYs and there is no need to clear cache on
+ * scheme reload.
+ */
+void kptcache_clear(kptcache_t *cache)
+{
+	size_t i = 0;
+
+	assert(cache);
+	if (!cache)
+		return;
+
+	for (i = 0; i < cache->size; i++)
+		kptcache_slot_clear(&cache->slots[i]);
+}
+
+
+static kptcache_slot_t *kptcache_slot(const kptcache_t *cache,
+	const kentry_t *ptype, const kentry_t *entry, const char *value)
+{
+	size_t hash = 5381;
+	const unsigned char *p = (const unsigned char *)value;
+
+	hash ^= (size_t)(uintptr_t)ptype;
+	hash = (hash << 5) + hash + (size_t)(uintptr_t)entry;
+	for (; *p; p++)
+		hash = (hash << 5) + hash + *p;
+
+	return &cache->slots[hash % cache->size];
+}
+
+
+bool_t kptcache_get(kptcache_t *cache, const kentry_t *ptype,
+	const kentry_t *entry, const char *value,
+	int *retcode, const char **out)
+{
+	kptcache_slot_t *slot = NULL;
+
+	assert(cache);
+	if (!cache)
+		return BOOL_FALSE;
+	if (!ptype || !value)
+		return BOOL_FALSE;
+
+	slot = kptcache_slot(cache, ptype, entry, value);
+	if ((slot->ptype != ptype) || (slot->entry != entry) ||
+		!slot->value || (strcmp(slot->value, value) != 0)) {
+		cache->misses++;
+		return BOOL_FALSE;
+	}
+
+	cache->hits++;
+	if (retcode)
+		*retcode = slot->retcode;
+	if (out)
+		*out = slot->out;
+
+	return BOOL_TRUE;
+}
+
+
+bool_t kptcache_set(kptcache_t *cache, const kentry_t *ptype,
+	const kentry_t *entry, const char *value,
+	int retcode, const char *out)
+{
+	kptcache_slot_t *slot = NULL;
+
+	assert(cache);
+	if (!cache)
+		return BOOL_FALSE;
+	if (!ptype || !value)
+		return BOOL_FALSE;
+
+	slot = kptcache_slot(cache, ptype, entry, value);
+	kptcache_slot_clear(slot);
+	slot->ptype = ptype;
+	slot->entry = entry;
+	slot->value = faux_str_dup(value);
+	slot->retcode = retcode;
+	slot->out = faux_str_dup(out);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Returns statistics of cache as a string.
+ *
+ * String contains hits, misses, hit rate and number of used slots. It
+ * must be freed by faux_str_free().
+ */
+char *kptcache_stats(const kptcache_t *cache)
+{
+	size_t used = 0;
+	size_t lookups = 0;
+	size_t i = 0;
+
+	assert(cache);
+	if (!cache)
+		return NULL;
+
+	for (i = 0; i < cache->size; i++) {
+		if (cache->slots[i].value)
+			used++;
+	}
+	lookups = cache->hits + cache->misses;
+
+	return faux_str_sprintf("%zu hits, %zu misses (%zu%% hit rate), "
+		"%zu of %zu slots used", cache->hits, cache->misses,
+		lookups ? (cache->hits * 100 / lookups) : 0,
+		used, cache->size);
+}
@@ -0,0 +1,134 @@
+/** @file kpty.c
+ *
+ * Opening of pseudo terminal needs a lot of system calls: open ptmx,
+ * grantpt(), unlockpt(), ptsname(), open pts. So session creates pseudo
+ * terminal once and lends it to commands. The kexec uses duplicates of
+ * descriptors so it can close them as usual. Terminal's settings are
+ * restored before each use.
+ */
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE
+#define _XOPEN_SOURCE_EXTENDED
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+
+#include <faux/faux.h>
+#include <faux/str.h>
+#include <klish/khelper.h>
+#include <klish/kpty.h>
+
+
+#define PTMX_PATH "/dev/ptmx"
+
+struct kpty_s {
+	int ptm; // Pseudo terminal master
+	int pts; // Pseudo terminal slave
+	char *pts_fname; // Pseudo terminal slave file name
+	struct termios termios; // Initial settings
+};
+
+
+// Master
+KGET(pty, int, ptm);
+
+// Slave
+KGET(pty, int, pts);
+KGET_STR(pty, pts_fname);
+
+
+kpty_t *kpty_new(void)
+{
+	kpty_t *pty = NULL;
+	const char *pts_name = NULL;
+	int fflags = 0;
+
+	pty = faux_zmalloc(sizeof(*pty));
+	assert(pty);
+	if (!pty)
+		return NULL;
+
+	// Initialize
+	pty->ptm = -1;
+	pty->pts = -1;
+	pty->pts_fname = NULL;
+
+	pty->ptm = open(PTMX_PATH, O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (pty->ptm < 0)
+		goto err;
+	// Set O_NONBLOCK flag here. Because this flag is ignored while
+	// open() ptmx. I don't know why. fcntl() is working fine.
+	fflags = fcntl(pty->ptm, F_GETFL);
+	fcntl(pty->ptm, F_SETFL, fflags | O_NONBLOCK);
+	if ((grantpt(pty->ptm) < 0) || (unlockpt(pty->ptm) < 0))
+		goto err;
+	pts_name = ptsname(pty->ptm);
+	if (!pts_name)
+		goto err;
+	pty->pts_fname = faux_str_dup(pts_name);
+	// Open descriptor of slave makes action (from child) to don't send
+	// SIGHUP on terminal handler.
+	pty->pts = open(pty->pts_fname, O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (pty->pts < 0)
+		goto err;
+	// Save initial settings to restore them before each use
+	if (tcgetattr(pty->pts, &pty->termios) < 0)
+		goto err;
+
+	return pty;
+
+err:
+	kpty_free(pty);
+	return NULL;
+}
+
+
+void kpty_free(kpty_t *pty)
+{
+	if (!pty)
+		return;
+
+	if (pty->pts != -1)
+		close(pty->pts);
+	if (pty->ptm != -1)
+		close(pty->ptm);
+	faux_str_free(pty->pts_fname);
+
+	faux_free(pty);
+}
+
+
+/** @brief Prepares pseudo terminal to be used by the next command.
+ *
+ * Returns BOOL_FALSE if previous command has left pseudo terminal in
+ * unusable state. The pseudo terminal must be recreated then.
+ */
+bool_t kpty_reset(kpty_t *pty)
+{
+	pid_t sid = -1;
+
+	assert(pty);
+	if (!pty)
+		return BOOL_FALSE;
+
+	// Descriptor was closed by somebody
+	if ((fcntl(pty->ptm, F_GETFL) < 0) || (fcntl(pty->pts, F_GETFL) < 0))
+		return BOOL_FALSE;
+	// Terminal is still controlling terminal of some session. Processes
+	// of previous command are alive.
+	if (ioctl(pty->ptm, TIOCGSID, &sid) == 0)
+		return BOOL_FALSE;
+	// Drop unread data and restore settings like raw mode
+	tcflush(pty->ptm, TCIOFLUSH);
+	tcflush(pty->pts, TCIOFLUSH);
+	if (tcsetattr(pty->pts, TCSANOW, &pty->termios) < 0)
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
@@ -16,6 +16,11 @@
 struct ksession_s {
 	kscheme_t *scheme;
 	kpath_t *path;
+	kptcache_t *ptcache; // PTYPE validation cache
+	kjournal_t *journal; // Service ACTIONs of resumable request
+	kworkers_t *workers; // Pool of action workers (optional)
+	kpty_t *pty; // Pseudo terminal lent to commands
+	char *lockfile; // File for named locks
 	bool_t done; // Indicates that session is over and must be closed
 	size_t term_width;
 	size_t term_height;
@@ -36,6 +41,19 @@ KGET(session, kscheme_t *, scheme);
 // Path
 KGET(session, kpath_t *, path);
 
+// PTYPE validation cache
+KGET(session, kptcache_t *, ptcache);
+
+// Journal of service ACTIONs executed by resumable request
+KGET(session, kjournal_t *, journal);
+
+// Action workers
+KGET(session, kworkers_t *, workers);
+
+// File for named locks
+KGET_STR(session, lockfile);
+KSET_STR(session, lockfile);
+
 // Done
 KGET_BOOL(session, done);
 KSET_BOOL(session, done);
@@ -77,6 +95,42 @@ KGET_BOOL(session, isatty_stderr);
 KSET_BOOL(session, isatty_stderr);
 
 
+// Session owns the pool. Previous pool is freed.
+bool_t ksession_set_workers(ksession_t *session, kworkers_t *workers)
+{
+	assert(session);
+	if (!session)
+		return BOOL_FALSE;
+
+	kworkers_free(session->workers);
+	session->workers = workers;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Gets pseudo terminal for the next command.
+ *
+ * The pseudo terminal is created once and reused by commands. It's
+ * recreated if previous command left it in unusable state.
+ */
+kpty_t *ksession_lend_pty(ksession_t *session)
+{
+	assert(session);
+	if (!session)
+		return NULL;
+
+	if (session->pty && !kpty_reset(session->pty)) {
+		kpty_free(session->pty);
+		session->pty = NULL;
+	}
+	if (!session->pty)
+		session->pty = kpty_new();
+
+	return session->pty;
+}
+
+
 ksession_t *ksession_new(kscheme_t *scheme, const char *start_entry)
 {
 	ksession_t *session = NULL;
@@ -115,6 +169,13 @@ ksession_t *ksession_new(kscheme_t *scheme, const char *start_entry)
 	level = klevel_new(entry);
 	assert(level);
 	kpath_push(session->path, level);
+	session->ptcache = kptcache_new(KPTCACHE_DEFAULT_SIZE);
+	assert(session->ptcache);
+	session->journal = kjournal_new();
+	assert(session->journal);
+	session->workers = NULL; // Fork per ACTION by default
+	session->pty = NULL; // Will be created on demand
+	session->lockfile = NULL; // Default lock file
 	session->done = BOOL_FALSE;
 	session->term_width = 0;
 	session->term_height = 0;
@@ -138,6 +199,11 @@ void ksession_free(ksession_t *session)
 		return;
 
 	kpath_free(session->path);
+	kptcache_free(session->ptcache);
+	kjournal_free(session->journal);
+	kworkers_free(session->workers);
+	kpty_free(session->pty);
+	faux_str_free(session->lockfile);
 	faux_str_free(session->user);
 
 	free(session);
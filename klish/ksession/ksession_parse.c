@@ -17,6 +17,7 @@
 #include <faux/error.h>
 #include <klish/khelper.h>
 #include <klish/kscheme.h>
+#include <klish/kflat.h>
 #include <klish/kpath.h>
 #include <klish/kpargv.h>
 #include <klish/kexec.h>
@@ -27,12 +28,31 @@
 #define ARGV_ALT_QUOTES "'"
 
 
-static bool_t ksession_validate_arg(ksession_t *session, kpargv_t *pargv)
+// Resumable request must get the same sequence of journal records on the
+// next attempt but cache content can be changed between attempts. So cached
+// result takes journal record too.
+static void ksession_journal_cached(ksession_t *session, int retcode,
+	const char *out)
+{
+	kjournal_t *journal = ksession_journal(session);
+	size_t index = 0;
+
+	if (!kjournal_active(journal))
+		return;
+	if (kjournal_next(journal, &index, NULL, NULL, NULL))
+		return; // Already recorded
+	kjournal_set(journal, index, BOOL_TRUE, retcode, out);
+}
+
+
+static bool_t ksession_validate_arg(ksession_t *session, kpargv_t *pargv,
+	const kentry_t *ptype_entry, bool_t pure_ptype)
 {
 	char *out = NULL;
+	const char *cached_out = NULL;
 	int retcode = -1;
-	const kentry_t *ptype_entry = NULL;
 	kparg_t *candidate = NULL;
+	kptcache_t *cache = NULL;
 
 	assert(session);
 	if (!session)
@@ -43,31 +63,89 @@ static bool_t ksession_validate_arg(ksession_t *session, kpargv_t *pargv)
 	candidate = kpargv_candidate_parg(pargv);
 	if (!candidate)
 		return BOOL_FALSE;
-	ptype_entry = kentry_nested_by_purpose(kparg_entry(candidate),
-		KENTRY_PURPOSE_PTYPE);
 	if (!ptype_entry)
 		return BOOL_FALSE;
 
+	// Try to get result of pure PTYPE from cache. The result of pure
+	// PTYPE depends on candidate ENTRY and value only.
+	if (pure_ptype)
+		cache = ksession_ptcache(session);
+	if (cache && kptcache_get(cache, ptype_entry, kparg_entry(candidate),
+		kparg_value(candidate), &retcode, &cached_out)) {
+		ksession_journal_cached(session, retcode, cached_out);
+		if (retcode != 0)
+			return BOOL_FALSE;
+		if (!faux_str_is_empty(cached_out))
+			kparg_set_value(candidate, cached_out);
+		return BOOL_TRUE;
+	}
+
 	if (!ksession_exec_locally(session, ptype_entry, pargv, NULL, NULL,
 		&retcode, &out)) {
 		return BOOL_FALSE;
 	}
 
-	if (retcode != 0)
+	if (cache)
+		kptcache_set(cache, ptype_entry, kparg_entry(candidate),
+			kparg_value(candidate), retcode, out);
+
+	if (retcode != 0) {
+		faux_str_free(out);
 		return BOOL_FALSE;
+	}
 
 	if (!faux_str_is_empty(out))
 		kparg_set_value(candidate, out);
+	faux_str_free(out);
 
 	return BOOL_TRUE;
 }
 
 
-static kpargv_status_e ksession_parse_arg(ksession_t *session,
-	const kentry_t *current_entry, faux_argv_node_t **argv_iter,
+// Keyword can be checked by index if parser really needs to match current
+// arg. Parser can't skip any ENTRYs when it gathers completions for the
+// last arg.
+static bool_t ksession_keyword_index_usable(faux_argv_node_t **argv_iter,
+	const kpargv_t *pargv)
+{
+	kpargv_purpose_e purpose = kpargv_purpose(pargv);
+
+	if (!*argv_iter)
+		return BOOL_FALSE;
+	if (((KPURPOSE_COMPLETION == purpose) || (KPURPOSE_HELP == purpose)) &&
+		faux_argv_is_last(*argv_iter) && kpargv_continuable(pargv))
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+static kpargv_status_e ksession_parse_node(ksession_t *session,
+	const kflat_node_t *node, faux_argv_node_t **argv_iter,
+	kpargv_t *pargv, bool_t entry_is_command, bool_t is_filter);
+
+
+static bool_t ksession_node_is_entered(const kflat_node_t **entered,
+	size_t entered_num, const kflat_node_t *node)
+{
+	size_t i = 0;
+
+	for (i = 0; i < entered_num; i++) {
+		if (entered[i] == node)
+			return BOOL_TRUE;
+	}
+
+	return BOOL_FALSE;
+}
+
+
+// Parser walks through compiled ENTRYs (see kflat.h). Original ENTRY is
+// used for parsed args only.
+static kpargv_status_e ksession_parse_node_nomemo(ksession_t *session,
+	const kflat_node_t *node, faux_argv_node_t **argv_iter,
 	kpargv_t *pargv, bool_t entry_is_command, bool_t is_filter)
 {
-	const kentry_t *entry = current_entry;
+	const kentry_t *entry = NULL;
 	kentry_mode_e mode = KENTRY_MODE_NONE;
 	kpargv_status_e retcode = KPARSE_NONE; // For ENTRY itself
 	kpargv_status_e rc = KPARSE_NONE; // For nested ENTRYs
@@ -78,8 +156,8 @@ static kpargv_status_e ksession_parse_arg(ksession_t *session,
 //kentry_name(entry), faux_argv_current(*argv_iter),
 //kpargv_pargs_len(pargv));
 
-	assert(current_entry);
-	if (!current_entry)
+	assert(node);
+	if (!node)
 		return KPARSE_ERROR;
 	assert(argv_iter);
 	if (!argv_iter)
@@ -88,6 +166,7 @@ static kpargv_status_e ksession_parse_arg(ksession_t *session,
 	if (!pargv)
 		return KPARSE_ERROR;
 
+	entry = node->entry;
 	purpose = kpargv_purpose(pargv); // Purpose of parsing
 
 	// If we know the entry is a command then don't validate it. This
@@ -98,19 +177,19 @@ static kpargv_status_e ksession_parse_arg(ksession_t *session,
 		kparg_t *parg = NULL;
 
 		// Command is an ENTRY with ACTIONs
-		if (kentry_actions_len(entry) <= 0)
+		if (!node->has_actions)
 			return KPARSE_ERROR;
-		parg = kparg_new(entry, NULL);
+		parg = kparg_new_in_arena(kpargv_arena(pargv), entry, NULL);
 		kpargv_add_pargs(pargv, parg);
 		kpargv_set_command(pargv, entry);
 		retcode = KPARSE_OK;
 
 	// Is entry candidate to resolve current arg?
 	// Container can't be a candidate.
-	} else if (!kentry_container(entry)) {
+	} else if (!node->container) {
 		const char *current_arg = NULL;
 		kparg_t *parg = NULL;
-		kentry_filter_e filter_flag = kentry_filter(entry);
+		kentry_filter_e filter_flag = node->filter;
 
 		// When purpose is COMPLETION or HELP then fill completion list.
 		// Additionally if it's last continuable argument then lie to
@@ -143,12 +222,15 @@ static kpargv_status_e ksession_parse_arg(ksession_t *session,
 
 		// Validate argument
 		current_arg = faux_argv_current(*argv_iter);
-		parg = kparg_new(entry, current_arg);
+		parg = kparg_new_in_arena(kpargv_arena(pargv), entry,
+			current_arg);
 		kpargv_set_candidate_parg(pargv, parg);
-		if (ksession_validate_arg(session, pargv)) {
+		if (ksession_validate_arg(session, pargv,
+			node->ptype ? node->ptype->entry : NULL,
+			node->pure_ptype)) {
 			kpargv_accept_candidate_parg(pargv);
 			// Command is an ENTRY with ACTIONs or NAVigation
-			if (kentry_actions_len(entry) > 0)
+			if (node->has_actions)
 				kpargv_set_command(pargv, entry);
 			faux_argv_each(argv_iter); // Next argument
 			retcode = KPARSE_OK;
@@ -169,12 +251,12 @@ static kpargv_status_e ksession_parse_arg(ksession_t *session,
 	if (retcode == KPARSE_NOTFOUND)
 		return retcode;
 
-	// ENTRY has no nested ENTRYs so return
-	if (kentry_entrys_is_empty(entry))
+	// ENTRY has no nested COMMON ENTRYs so return
+	if (0 == node->children_num)
 		return retcode;
 
 	// EMPTY mode
-	mode = kentry_mode(entry);
+	mode = node->mode;
 	if (KENTRY_MODE_EMPTY == mode)
 		return retcode;
 
@@ -183,22 +265,33 @@ static kpargv_status_e ksession_parse_arg(ksession_t *session,
 	// So these attributes will be ignored. Note SWITCH itself can have
 	// 'min'/'max'.
 	if (KENTRY_MODE_SWITCH == mode) {
-		kentry_entrys_node_t *iter = kentry_entrys_iter(entry);
-		const kentry_t *nested = NULL;
+		size_t i = 0;
+		kentry_index_iter_t index_iter = {};
+		bool_t use_index = BOOL_FALSE;
+		const kflat_node_t *nested = NULL;
 
 //if (kentry_purpose(entry) == KENTRY_PURPOSE_COMMON)
 //fprintf(stderr, "SWITCH: name=%s, arg %s\n", kentry_name(entry),
 //*argv_iter ? faux_argv_current(*argv_iter) : "<empty>");
 
-		while ((nested = kentry_entrys_each(&iter))) {
+		// Keyword index gives only ENTRYs that can match current arg.
+		// Non-matched keywords are skipped without PTYPE execution.
+		if (ksession_keyword_index_usable(argv_iter, pargv))
+			use_index = kentry_index_iter(entry,
+				faux_argv_current(*argv_iter), &index_iter);
+
+		// Compiled node's children are nested COMMON ENTRYs in the
+		// same order as index slots.
+		while (use_index ?
+			(kentry_index_each(entry, &index_iter) != NULL) :
+			(i < node->children_num)) {
 			kpargv_status_e res = KPARSE_NONE;
-			// Ignore entries with non-COMMON purpose.
-			if (kentry_purpose(nested) != KENTRY_PURPOSE_COMMON)
-				continue;
+			nested = node->children[use_index ?
+				index_iter.current : i++];
 //if (kentry_purpose(entry) == KENTRY_PURPOSE_COMMON)
 //fprintf(stderr, "SWITCH-nested name=%s, nested=%s\n",
-//kentry_name(entry), kentry_name(nested));
-			res = ksession_parse_arg(session, nested, argv_iter,
+//kentry_name(entry), nested->name);
+			res = ksession_parse_node(session, nested, argv_iter,
 				pargv, BOOL_FALSE, is_filter);
 			if (res == KPARSE_NONE)
 				rc = KPARSE_NOTFOUND;
@@ -212,38 +305,56 @@ static kpargv_status_e ksession_parse_arg(ksession_t *session,
 
 	// SEQUENCE mode
 	} else if (KENTRY_MODE_SEQUENCE == mode) {
-		kentry_entrys_node_t *iter = kentry_entrys_iter(entry);
-		kentry_entrys_node_t *saved_iter = iter;
-		const kentry_t *nested = NULL;
-		kpargv_t *cur_level_pargv = kpargv_new();
-
-		while ((nested = kentry_entrys_each(&iter))) {
+		size_t i = 0;
+		size_t saved_i = i;
+		const kflat_node_t *nested = NULL;
+		// Nested entries that were already entered on current level.
+		// Each nested entry can be entered once so the number of
+		// nested entries is enough.
+		const kflat_node_t **entered = karena_alloc(kpargv_arena(pargv),
+			node->children_num * sizeof(*entered));
+		size_t entered_num = 0;
+
+		while (i < node->children_num) {
 			kpargv_status_e res = KPARSE_NONE;
 			size_t num = 0;
-			size_t min = kentry_min(nested);
+			size_t min = 0;
 			bool_t break_loop = BOOL_FALSE;
 			bool_t consumed = BOOL_FALSE;
 
-			// Ignore entries with non-COMMON purpose.
-			if (kentry_purpose(nested) != KENTRY_PURPOSE_COMMON)
-				continue;
+			nested = node->children[i++];
+			min = nested->min;
 			// Filter out double parsing for optional entries.
-			if (kpargv_entry_exists(cur_level_pargv, nested))
+			if (ksession_node_is_entered(entered, entered_num,
+				nested))
 				continue;
+			// Keyword that doesn't match current arg is the same as
+			// NOTFOUND from ksession_parse_node() but without PTYPE
+			// execution.
+			if ((nested->keyword != KSYM_KEYWORD_NONE) &&
+				ksession_keyword_index_usable(argv_iter, pargv) &&
+				!kentry_keyword_match(nested->entry,
+				faux_argv_current(*argv_iter))) {
+				if (min > 0) {
+					rc = KPARSE_NOTFOUND;
+					break;
+				}
+				continue;
+			}
 //if (kentry_purpose(entry) == KENTRY_PURPOSE_COMMON)
 //fprintf(stderr, "SEQ name=%s, arg=%s\n",
 //kentry_name(entry), *argv_iter ? faux_argv_current(*argv_iter) : "<empty>");
 			// Try to match argument and current entry
 			// (from 'min' to 'max' times)
-			for (num = 0; num < kentry_max(nested); num++) {
+			for (num = 0; num < nested->max; num++) {
 //if (kentry_purpose(entry) == KENTRY_PURPOSE_COMMON)
 //fprintf(stderr, "SEQ-nested: name=%s, nested=%s\n",
-//kentry_name(entry), kentry_name(nested));
-				res = ksession_parse_arg(session, nested,
+//kentry_name(entry), nested->name);
+				res = ksession_parse_node(session, nested,
 					argv_iter, pargv, BOOL_FALSE, is_filter);
 //if (kentry_purpose(entry) == KENTRY_PURPOSE_COMMON)
 //fprintf(stderr, "SEQ-nested-answer: name=%s, nested=%s, res=%s, num=%d, min=%d\n",
-//kentry_name(entry), kentry_name(nested), kpargv_status_decode(res), num, min);
+//kentry_name(entry), nested->name, kpargv_status_decode(res), num, min);
 				// It's not an error but there will be not
 				// additional arguments of the same entry
 				if ((res == KPARSE_NONE) ||
@@ -265,26 +376,25 @@ static kpargv_status_e ksession_parse_arg(ksession_t *session,
 			if (consumed) {
 				// Remember if optional parameter was already
 				// entered
-				kparg_t *tmp_parg = kparg_new(nested, NULL);
-				kpargv_add_pargs(cur_level_pargv, tmp_parg);
+				entered[entered_num++] = nested;
 				// SEQ container will get all entered nested
 				// entry names as value within resulting pargv
-				if (kentry_container(entry)) {
-					kparg_t *parg = kparg_new(entry,
-						kentry_name(nested));
+				if (node->container) {
+					kparg_t *parg = kparg_new_in_arena(
+						kpargv_arena(pargv), entry,
+						nested->name);
 					kpargv_add_pargs(pargv, parg);
 				}
 				// Mandatory or ordered parameter
-				if ((min > 0) || kentry_order(nested))
-					saved_iter = iter;
+				if ((min > 0) || nested->order)
+					saved_i = i;
 				// If optional entry is found then go back to nearest
 				// non-optional (or ordered) entry to try to find
 				// another optional entries.
 				if ((0 == min) && (num > 0))
-					iter = saved_iter;
+					i = saved_i;
 			}
 		}
-		kpargv_free(cur_level_pargv);
 	}
 
 	if (rc == KPARSE_NONE)
@@ -305,8 +415,100 @@ static kpargv_status_e ksession_parse_arg(ksession_t *session,
 }
 
 
+// Packrat memoization. SEQUENCE backtracking and SWITCH alternatives can
+// try the same ENTRY at the same argv position many times. The result is
+// memoized only if parsing has no side effects (argv position, parsed
+// args, completions and command are unchanged). So repeated attempt can
+// just return saved status.
+static kpargv_status_e ksession_parse_node(ksession_t *session,
+	const kflat_node_t *node, faux_argv_node_t **argv_iter,
+	kpargv_t *pargv, bool_t entry_is_command, bool_t is_filter)
+{
+	kpargv_status_e rc = KPARSE_NONE;
+	faux_argv_node_t *pos = NULL;
+	ssize_t pargs_len = 0;
+	ssize_t completions_len = 0;
+	const kentry_t *command = NULL;
+
+	assert(node);
+	if (!node)
+		return KPARSE_ERROR;
+	assert(argv_iter);
+	if (!argv_iter)
+		return KPARSE_ERROR;
+	assert(pargv);
+	if (!pargv)
+		return KPARSE_ERROR;
+
+	if (entry_is_command)
+		return ksession_parse_node_nomemo(session, node, argv_iter,
+			pargv, entry_is_command, is_filter);
+
+	pos = *argv_iter;
+	if (kpargv_memo_get(pargv, node->entry, pos, &rc))
+		return rc;
+
+	pargs_len = kpargv_pargs_len(pargv);
+	completions_len = kpargv_completions_len(pargv);
+	command = kpargv_command(pargv);
+
+	rc = ksession_parse_node_nomemo(session, node, argv_iter,
+		pargv, entry_is_command, is_filter);
+
+	if ((*argv_iter == pos) &&
+		(kpargv_pargs_len(pargv) == pargs_len) &&
+		(kpargv_completions_len(pargv) == completions_len) &&
+		(kpargv_command(pargv) == command))
+		kpargv_memo_set(pargv, node->entry, pos, rc);
+
+	return rc;
+}
+
+
+// Starts parsing from specified ENTRY. All ENTRYs of prepared scheme are
+// compiled so parser needs compiled node of starting ENTRY only.
+static kpargv_status_e ksession_parse_arg(ksession_t *session,
+	const kentry_t *current_entry, faux_argv_node_t **argv_iter,
+	kpargv_t *pargv, bool_t entry_is_command, bool_t is_filter)
+{
+	const kflat_t *flat = NULL;
+	const kflat_node_t *node = NULL;
+
+	assert(session);
+	if (!session)
+		return KPARSE_ERROR;
+	assert(current_entry);
+	if (!current_entry)
+		return KPARSE_ERROR;
+
+	flat = kscheme_flat(ksession_scheme(session));
+	if (!flat)
+		return KPARSE_ERROR; // Scheme is not prepared
+	node = kflat_find_node(flat, current_entry);
+	if (!node)
+		return KPARSE_ERROR;
+
+	return ksession_parse_node(session, node, argv_iter,
+		pargv, entry_is_command, is_filter);
+}
+
+
 kpargv_t *ksession_parse_line(ksession_t *session, const faux_argv_t *argv,
 	kpargv_purpose_e purpose, bool_t is_filter)
+{
+	return ksession_parse_line_from_level(session, argv, purpose, is_filter,
+		KSESSION_LEVEL_ANY);
+}
+
+
+/** @brief Parses line starting from specified level of path.
+ *
+ * Levels higher than start_level are not tried. Caller can use it when it
+ * knows the first argument can't be resolved on these levels.
+ */
+kpargv_t *ksession_parse_line_from_level(ksession_t *session,
+	const faux_argv_t *argv, kpargv_purpose_e purpose, bool_t is_filter,
+	size_t start_level)
 {
 	faux_argv_node_t *argv_iter = NULL;
 	kpargv_t *pargv = NULL;
@@ -342,6 +544,10 @@ kpargv_t *ksession_parse_line(ksession_t *session, const faux_argv_t *argv,
 		// special processing and will be ignored here.
 		if (kentry_purpose(current_entry) != KENTRY_PURPOSE_COMMON)
 			continue;
+		if (level_found > start_level) {
+			level_found--;
+			continue;
+		}
 		// Parsing
 		pstatus = ksession_parse_arg(session, current_entry, &argv_iter,
 			pargv, BOOL_FALSE, is_filter);
@@ -522,27 +728,25 @@ static bool_t ksession_check_line(const kpargv_t *pargv, faux_error_t *error,
 // component must be parsed for completion.
 // Completion is a "back-end" operation so it doesn't need detailed error
 // reporting.
-kpargv_t *ksession_parse_for_completion(ksession_t *session,
-	const char *raw_line)
+/** @brief Parses already splitted line for completion.
+ *
+ * The first 'checked_stages' pipeline stages are known to be correct (for
+ * example they were checked by previous parsing of the same stages) so
+ * they are not parsed again. The last stage is always parsed.
+ */
+kpargv_t *ksession_parse_for_completion_ext(ksession_t *session,
+	const faux_list_t *split, size_t checked_stages, size_t last_level)
 {
-	faux_list_t *split = NULL;
 	faux_list_node_t *iter = NULL;
 	kpargv_t *pargv = NULL;
 	bool_t is_piped = BOOL_FALSE;
+	size_t stage = 0;
 
 	assert(session);
 	if (!session)
 		return NULL;
-	assert(raw_line);
-	if (!raw_line)
+	if (!split || (faux_list_len(split) < 1))
 		return NULL;
-
-	// Split raw line (with '|') to components
-	split = ksession_split_pipes(raw_line, NULL);
-	if (!split || (faux_list_len(split) < 1)) {
-		faux_list_free(split);
-		return NULL;
-	}
 	is_piped = (faux_list_len(split) > 1);
 
 	iter = faux_list_head(split);
@@ -552,7 +756,13 @@ kpargv_t *ksession_parse_for_completion(ksession_t *session,
 		bool_t is_first = (iter == faux_list_head(split));
 		kpargv_purpose_e purpose = is_last ? KPURPOSE_COMPLETION : KPURPOSE_EXEC;
 
-		pargv = ksession_parse_line(session, argv, purpose, !is_first);
+		if (!is_last && (stage < checked_stages)) {
+			iter = faux_list_next_node(iter);
+			stage++;
+			continue;
+		}
+		pargv = ksession_parse_line_from_level(session, argv, purpose,
+			!is_first, is_last ? last_level : KSESSION_LEVEL_ANY);
 		if (!ksession_check_line(pargv, NULL, is_first, is_piped)) {
 			kpargv_free(pargv);
 			pargv = NULL;
@@ -561,8 +771,30 @@ kpargv_t *ksession_parse_for_completion(ksession_t *session,
 		if (!is_last)
 			kpargv_free(pargv);
 		iter = faux_list_next_node(iter);
+		stage++;
 	}
 
+	return pargv;
+}
+
+
+kpargv_t *ksession_parse_for_completion(ksession_t *session,
+	const char *raw_line)
+{
+	faux_list_t *split = NULL;
+	kpargv_t *pargv = NULL;
+
+	assert(session);
+	if (!session)
+		return NULL;
+	assert(raw_line);
+	if (!raw_line)
+		return NULL;
+
+	// Split raw line (with '|') to components
+	split = ksession_split_pipes(raw_line, NULL);
+	pargv = ksession_parse_for_completion_ext(session, split, 0,
+		KSESSION_LEVEL_ANY);
 	faux_list_free(split);
 
 	return pargv;
@@ -755,16 +987,27 @@ static bool_t get_stdout(kexec_t *exec)
 static bool_t action_terminated_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data)
 {
-	int wstatus = 0;
-	pid_t child_pid = -1;
 	kexec_t *exec = (kexec_t *)user_data;
+	kexec_contexts_node_t *iter = NULL;
+	kcontext_t *context = NULL;
 
 	if (!exec)
 		return BOOL_FALSE;
 
-	// Wait for any child process. Doesn't block.
-	while ((child_pid = waitpid(-1, &wstatus, WNOHANG)) > 0)
-		kexec_continue_command_execution(exec, child_pid, wstatus);
+	// Wait for own processes only. Doesn't block. Process can have another
+	// children (workers, ACTIONs of other sessions) those are waited by
+	// the outer eloop.
+	iter = kexec_contexts_iter(exec);
+	while ((context = kexec_contexts_each(&iter))) {
+		int wstatus = 0;
+		pid_t pid = kcontext_pid(context);
+
+		if (kcontext_done(context) || (pid <= 0))
+			continue;
+		if (waitpid(pid, &wstatus, WNOHANG) != pid)
+			continue;
+		kexec_continue_command_execution(exec, pid, wstatus);
+	}
 
 	// Check if kexec is done now
 	if (kexec_done(exec)) {
@@ -796,25 +1039,18 @@ static bool_t action_stdout_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 }
 
 
-bool_t ksession_exec_locally(ksession_t *session, const kentry_t *entry,
-	kpargv_t *parent_pargv, const kcontext_t *parent_context,
-	const kexec_t *parent_exec, int *retcode, char **out)
+// Parses and starts service ACTION
+static kexec_t *ksession_start_locally(ksession_t *session,
+	const kentry_t *entry, kpargv_t *parent_pargv,
+	const kcontext_t *parent_context, const kexec_t *parent_exec)
 {
 	kexec_t *exec = NULL;
-	faux_eloop_t *eloop = NULL;
-	faux_buf_t *buf = NULL;
-	char *cstr = NULL;
-	ssize_t len = 0;
-
-	assert(entry);
-	if (!entry)
-		return BOOL_FALSE;
 
 	// Parsing
 	exec = ksession_parse_for_local_exec(session, entry,
 		parent_pargv, parent_context, parent_exec);
 	if (!exec)
-		return BOOL_FALSE;
+		return NULL;
 
 	// Session status can be changed while parsing because it can execute
 	// nested ksession_exec_locally() to check for PTYPEs, CONDitions etc.
@@ -825,19 +1061,38 @@ bool_t ksession_exec_locally(ksession_t *session, const kentry_t *entry,
 //		return BOOL_FALSE; // Because action is not completed
 //	}
 
-	// Execute kexec and then wait for completion using local Eloop
 	if (!kexec_exec(exec)) {
 		kexec_free(exec);
-		return BOOL_FALSE; // Something went wrong
-	}
-	// If kexec contains only non-exec (for example dry-run) ACTIONs then
-	// we don't need event loop and can return here.
-	if (kexec_retcode(exec, retcode)) {
-		kexec_free(exec);
-		return BOOL_TRUE;
+		return NULL; // Something went wrong
 	}
 
-	// Local service loop
+	return exec;
+}
+
+
+// Gets output of completed service ACTION
+static char *ksession_local_out(kexec_t *exec)
+{
+	faux_buf_t *buf = NULL;
+	char *cstr = NULL;
+	ssize_t len = 0;
+
+	buf = kexec_bufout(exec);
+	if ((len = faux_buf_len(buf)) <= 0)
+		return NULL;
+	cstr = faux_malloc(len + 1);
+	faux_buf_read(buf, cstr, len);
+	cstr[len] = '\0';
+
+	return cstr;
+}
+
+
+// Waits for service ACTION completion using local eloop
+static void ksession_wait_locally(ksession_t *session, kexec_t *exec)
+{
+	faux_eloop_t *eloop = NULL;
+
 	eloop = faux_eloop_new(NULL);
 	faux_eloop_add_signal(eloop, SIGINT, stop_loop_ev, session);
 	faux_eloop_add_signal(eloop, SIGTERM, stop_loop_ev, session);
@@ -847,24 +1102,170 @@ bool_t ksession_exec_locally(ksession_t *session, const kentry_t *entry,
 		action_stdout_ev, exec);
 	faux_eloop_loop(eloop);
 	faux_eloop_free(eloop);
+	// Local loop has consumed SIGCHLD. Let the outer eloop wait for
+	// the rest of terminated children.
+	raise(SIGCHLD);
+}
 
-	kexec_retcode(exec, retcode);
 
-	if (!out) {
-		kexec_free(exec);
+// Resumable request doesn't wait for service ACTION. The ACTION is left to
+// session's eloop and request will be processed again after its completion.
+// Results of ACTIONs executed by previous attempts are taken from journal.
+static bool_t ksession_exec_resumable(ksession_t *session,
+	const kentry_t *entry, kpargv_t *parent_pargv,
+	const kcontext_t *parent_context, const kexec_t *parent_exec,
+	int *retcode, char **out)
+{
+	kjournal_t *journal = ksession_journal(session);
+	kexec_t *exec = NULL;
+	size_t index = 0;
+	bool_t ok = BOOL_FALSE;
+	int rc = -1;
+	const char *recorded_out = NULL;
+	char *res_out = NULL;
+
+	if (kjournal_next(journal, &index, &ok, &rc, &recorded_out)) {
+		if (!ok)
+			return BOOL_FALSE;
+		if (retcode)
+			*retcode = rc;
+		if (out)
+			*out = faux_str_dup(recorded_out);
 		return BOOL_TRUE;
 	}
-	buf = kexec_bufout(exec);
-	if ((len = faux_buf_len(buf)) <= 0) {
-		kexec_free(exec);
-		return BOOL_TRUE;
+
+	// Request is already suspended. Don't start another ACTIONs. The
+	// result of current attempt will be dropped anyway.
+	if (kjournal_pending(journal))
+		return BOOL_FALSE;
+
+	exec = ksession_start_locally(session, entry,
+		parent_pargv, parent_context, parent_exec);
+	if (!exec) {
+		// Nested service ACTION is pending. Record will be filled by
+		// the next attempt.
+		if (!kjournal_pending(journal))
+			kjournal_set(journal, index, BOOL_FALSE, -1, NULL);
+		return BOOL_FALSE;
+	}
+	if (!kexec_done(exec)) {
+		// Too many suspensions. Wait for the rest of ACTIONs.
+		if (kjournal_exhausted(journal)) {
+			ksession_wait_locally(session, exec);
+		} else {
+			kjournal_set_pending(journal, index, exec);
+			return BOOL_FALSE;
+		}
 	}
-	cstr = faux_malloc(len + 1);
-	faux_buf_read(buf, cstr, len);
-	cstr[len] = '\0';
-	*out = cstr;
 
+	kexec_retcode(exec, &rc);
+	res_out = ksession_local_out(exec);
 	kexec_free(exec);
+	kjournal_set(journal, index, BOOL_TRUE, rc, res_out);
+	if (retcode)
+		*retcode = rc;
+	if (out)
+		*out = res_out;
+	else
+		faux_str_free(res_out);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Executes service ACTION (PTYPE, COND, PROMPT, LOG etc).
+ *
+ * Blocks till ACTION completion using local eloop. But if session's journal
+ * is active (resumable request) it doesn't block. Then BOOL_FALSE is returned
+ * for unfinished ACTION and kjournal_pending() is set. Request that is
+ * suspended KJOURNAL_MAX_SUSPENDS times waits for the rest of ACTIONs.
+ */
+bool_t ksession_exec_locally(ksession_t *session, const kentry_t *entry,
+	kpargv_t *parent_pargv, const kcontext_t *parent_context,
+	const kexec_t *parent_exec, int *retcode, char **out)
+{
+	kexec_t *exec = NULL;
+
+	assert(entry);
+	if (!entry)
+		return BOOL_FALSE;
+
+	if (kjournal_active(ksession_journal(session)))
+		return ksession_exec_resumable(session, entry, parent_pargv,
+			parent_context, parent_exec, retcode, out);
+
+	// Execute kexec and then wait for completion using local Eloop
+	exec = ksession_start_locally(session, entry,
+		parent_pargv, parent_context, parent_exec);
+	if (!exec)
+		return BOOL_FALSE;
+	// If kexec contains only non-exec (for example dry-run) ACTIONs or
+	// sync ACTIONs executed in-place then it's already done. We don't need
+	// event loop. The output (if any) is already in kexec's buffer.
+	if (!kexec_retcode(exec, retcode)) {
+		ksession_wait_locally(session, exec);
+		kexec_retcode(exec, retcode);
+	}
+
+	if (out)
+		*out = ksession_local_out(exec);
+	kexec_free(exec);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Reads output of pending service ACTION of resumable request.
+ */
+bool_t ksession_read_locally(ksession_t *session)
+{
+	kexec_t *exec = NULL;
+
+	assert(session);
+	if (!session)
+		return BOOL_FALSE;
+
+	exec = kjournal_pending(ksession_journal(session));
+	if (!exec)
+		return BOOL_FALSE;
+
+	return get_stdout(exec);
+}
+
+
+/** @brief Passes terminated child to pending service ACTION.
+ *
+ * Foreign PID is ignored.
+ *
+ * @return BOOL_TRUE if ACTION is completed now and suspended request can be
+ * processed again.
+ */
+bool_t ksession_continue_locally(ksession_t *session, pid_t pid, int wstatus)
+{
+	kjournal_t *journal = NULL;
+	kexec_t *exec = NULL;
+	int retcode = -1;
+	char *out = NULL;
+
+	assert(session);
+	if (!session)
+		return BOOL_FALSE;
+
+	journal = ksession_journal(session);
+	exec = kjournal_pending(journal);
+	if (!exec)
+		return BOOL_FALSE;
+
+	kexec_continue_command_execution(exec, pid, wstatus);
+	if (!kexec_done(exec))
+		return BOOL_FALSE;
+
+	// May be buffer still contains data
+	get_stdout(exec);
+	kexec_retcode(exec, &retcode);
+	out = ksession_local_out(exec);
+	kjournal_complete(journal, retcode, out);
+	faux_str_free(out);
 
 	return BOOL_TRUE;
 }
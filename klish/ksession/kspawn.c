@@ -0,0 +1,571 @@
+/** @file kspawn.c
+ *
+ * Spawn request contains everything to execute external program. All the
+ * memory is allocated while request building and before vfork() so the
+ * child does async-signal-safe system calls only. The vfork() doesn't copy
+ * page tables of session process so it's much faster than fork() for
+ * processes with large address space.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <grp.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+
+#include <faux/faux.h>
+#include <faux/str.h>
+#include <klish/khelper.h>
+#include <klish/kspawn.h>
+
+
+extern char **environ;
+
+#ifndef CLOSE_RANGE_CLOEXEC
+#define CLOSE_RANGE_CLOEXEC (1U << 2)
+#endif
+
+struct kspawn_s {
+	char *path; // Program to execute. The argv[0] if not specified
+	char **argv; // NULL-terminated
+	size_t argc;
+	char **env; // NULL-terminated "NAME=VALUE" overrides
+	size_t envc;
+	char *cwd;
+	bool_t set_user; // Drop privileges
+	char *user;
+	uid_t uid;
+	gid_t gid;
+	int *fds; // Pairs of session's fd and child's fd
+	size_t fds_num;
+	int *owned; // Will be closed when request is freed
+	size_t owned_num;
+};
+
+
+// Path
+KGET_STR(spawn, path);
+KSET_STR(spawn, path);
+
+// Working directory
+KSET_STR(spawn, cwd);
+
+
+kspawn_t *kspawn_new(void)
+{
+	kspawn_t *spawn = NULL;
+
+	spawn = faux_zmalloc(sizeof(*spawn));
+	assert(spawn);
+	if (!spawn)
+		return NULL;
+
+	// Initialize
+	spawn->path = NULL;
+	spawn->argv = NULL;
+	spawn->argc = 0;
+	spawn->env = NULL;
+	spawn->envc = 0;
+	spawn->cwd = NULL;
+	spawn->set_user = BOOL_FALSE;
+	spawn->user = NULL;
+	spawn->fds = NULL;
+	spawn->fds_num = 0;
+	spawn->owned = NULL;
+	spawn->owned_num = 0;
+
+	return spawn;
+}
+
+
+static void kspawn_strv_free(char **strv, size_t num)
+{
+	size_t i = 0;
+
+	for (i = 0; i < num; i++)
+		faux_str_free(strv[i]);
+	faux_free(strv);
+}
+
+
+void kspawn_free(kspawn_t *spawn)
+{
+	size_t i = 0;
+
+	if (!spawn)
+		return;
+
+	for (i = 0; i < spawn->owned_num; i++)
+		close(spawn->owned[i]);
+	faux_free(spawn->owned);
+	faux_free(spawn->fds);
+	faux_str_free(spawn->path);
+	kspawn_strv_free(spawn->argv, spawn->argc);
+	kspawn_strv_free(spawn->env, spawn->envc);
+	faux_str_free(spawn->cwd);
+	faux_str_free(spawn->user);
+
+	faux_free(spawn);
+}
+
+
+// Adds string to NULL-terminated array. The string is owned by array then.
+static bool_t kspawn_strv_add(char ***strv, size_t *num, char *str)
+{
+	char **new_strv = NULL;
+
+	new_strv = realloc(*strv, (*num + 2) * sizeof(*new_strv));
+	assert(new_strv);
+	if (!new_strv)
+		return BOOL_FALSE;
+	new_strv[(*num)++] = str;
+	new_strv[*num] = NULL;
+	*strv = new_strv;
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t kspawn_intv_add(int **intv, size_t *num, int value)
+{
+	int *new_intv = NULL;
+
+	new_intv = realloc(*intv, (*num + 1) * sizeof(*new_intv));
+	assert(new_intv);
+	if (!new_intv)
+		return BOOL_FALSE;
+	new_intv[(*num)++] = value;
+	*intv = new_intv;
+
+	return BOOL_TRUE;
+}
+
+
+bool_t kspawn_add_arg(kspawn_t *spawn, const char *arg)
+{
+	assert(spawn);
+	if (!spawn)
+		return BOOL_FALSE;
+	assert(arg);
+	if (!arg)
+		return BOOL_FALSE;
+
+	return kspawn_strv_add(&spawn->argv, &spawn->argc, faux_str_dup(arg));
+}
+
+
+/** @brief Sets environment variable for the child.
+ *
+ * Child inherits session's environment. The variables set by this
+ * function override inherited ones.
+ */
+bool_t kspawn_setenv(kspawn_t *spawn, const char *name, const char *value)
+{
+	char *var = NULL;
+	size_t name_len = 0;
+	size_t i = 0;
+
+	assert(spawn);
+	if (!spawn)
+		return BOOL_FALSE;
+	if (faux_str_is_empty(name) || !value)
+		return BOOL_FALSE;
+
+	var = faux_str_sprintf("%s=%s", name, value);
+	name_len = strlen(name) + 1; // Including '='
+	for (i = 0; i < spawn->envc; i++) {
+		if (strncmp(spawn->env[i], var, name_len) == 0) {
+			faux_str_free(spawn->env[i]);
+			spawn->env[i] = var;
+			return BOOL_TRUE;
+		}
+	}
+
+	return kspawn_strv_add(&spawn->env, &spawn->envc, var);
+}
+
+
+/** @brief Drops child's privileges to specified user.
+ *
+ * Supplementary groups of user are set too.
+ */
+bool_t kspawn_set_user(kspawn_t *spawn, const char *user,
+	uid_t uid, gid_t gid)
+{
+	assert(spawn);
+	if (!spawn)
+		return BOOL_FALSE;
+
+	faux_str_free(spawn->user);
+	spawn->user = faux_str_dup(user);
+	spawn->uid = uid;
+	spawn->gid = gid;
+	spawn->set_user = BOOL_TRUE;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Maps session's descriptor to child's descriptor.
+ *
+ * Child's stdin, stdout, stderr are mapped to context's streams by
+ * default. The explicit mapping overrides default one.
+ */
+bool_t kspawn_add_fd(kspawn_t *spawn, int fd, int child_fd)
+{
+	size_t num = 0;
+
+	assert(spawn);
+	if (!spawn)
+		return BOOL_FALSE;
+	if ((fd < 0) || (child_fd < 0))
+		return BOOL_FALSE;
+
+	num = spawn->fds_num;
+	if (!kspawn_intv_add(&spawn->fds, &num, fd))
+		return BOOL_FALSE;
+	if (!kspawn_intv_add(&spawn->fds, &num, child_fd))
+		return BOOL_FALSE;
+	spawn->fds_num++;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Passes descriptor's ownership to request.
+ *
+ * Descriptor will be closed within session process when request is freed.
+ * Launched child keeps its own copy if descriptor is mapped.
+ */
+bool_t kspawn_own_fd(kspawn_t *spawn, int fd)
+{
+	assert(spawn);
+	if (!spawn)
+		return BOOL_FALSE;
+	if (fd < 0)
+		return BOOL_FALSE;
+
+	return kspawn_intv_add(&spawn->owned, &spawn->owned_num, fd);
+}
+
+
+// Session's environment merged with overrides
+static char **kspawn_envp(const kspawn_t *spawn)
+{
+	char **envp = NULL;
+	size_t num = 0;
+	size_t i = 0;
+	size_t j = 0;
+
+	for (i = 0; environ && environ[i]; i++)
+		num++;
+	envp = faux_zmalloc((num + spawn->envc + 1) * sizeof(*envp));
+	assert(envp);
+	if (!envp)
+		return NULL;
+
+	num = 0;
+	for (i = 0; i < spawn->envc; i++)
+		envp[num++] = spawn->env[i];
+	for (i = 0; environ && environ[i]; i++) {
+		const char *eq = strchr(environ[i], '=');
+		size_t name_len = eq ? (size_t)(eq - environ[i] + 1) :
+			strlen(environ[i]);
+		bool_t overridden = BOOL_FALSE;
+		for (j = 0; j < spawn->envc; j++) {
+			if (strncmp(spawn->env[j], environ[i], name_len) == 0) {
+				overridden = BOOL_TRUE;
+				break;
+			}
+		}
+		if (!overridden)
+			envp[num++] = environ[i];
+	}
+	envp[num] = NULL;
+
+	return envp;
+}
+
+
+static gid_t *kspawn_groups(const kspawn_t *spawn, int *ngroups)
+{
+	gid_t *groups = NULL;
+	int num = 32;
+
+	*ngroups = 0;
+	if (!spawn->user)
+		return NULL;
+
+	groups = faux_zmalloc(num * sizeof(*groups));
+	assert(groups);
+	if (getgrouplist(spawn->user, spawn->gid, groups, &num) < 0) {
+		// The num contains real number of groups now
+		faux_free(groups);
+		groups = faux_zmalloc(num * sizeof(*groups));
+		assert(groups);
+		if (getgrouplist(spawn->user, spawn->gid, groups, &num) < 0) {
+			faux_free(groups);
+			return NULL;
+		}
+	}
+	*ngroups = num;
+
+	return groups;
+}
+
+
+/** @brief Launches program described by request.
+ *
+ * The stdin_fd, stdout_fd, stderr_fd are context's streams. If pts_fname
+ * is specified then child gets new session and descriptors those are
+ * terminals are replaced by reopened pseudoterminal. Returns PID of child
+ * or -1 on error. Child's exit code is 127 if program can't be executed.
+ */
+pid_t kspawn_launch(const kspawn_t *spawn, int stdin_fd, int stdout_fd,
+	int stderr_fd, const char *pts_fname)
+{
+	const char *path = NULL;
+	char *default_argv[2] = {};
+	char **argv = NULL;
+	char **envp = NULL;
+	gid_t *groups = NULL;
+	int ngroups = 0;
+	size_t map_num = 0;
+	int *map = NULL; // Triples: source fd, destination fd, is tty
+	int min_tmp_fd = 3;
+	bool_t use_pts = BOOL_FALSE;
+	sigset_t all_sigs;
+	sigset_t saved_sigs;
+	pid_t pid = -1;
+	size_t i = 0;
+
+	assert(spawn);
+	if (!spawn)
+		return -1;
+
+	path = spawn->path ? spawn->path :
+		(spawn->argc > 0 ? spawn->argv[0] : NULL);
+	if (!path)
+		return -1;
+	argv = spawn->argv;
+	if (!argv) {
+		default_argv[0] = (char *)path;
+		argv = default_argv;
+	}
+
+	// Prepare all the data before vfork()
+	envp = kspawn_envp(spawn);
+	if (!envp)
+		return -1;
+	if (spawn->set_user) {
+		groups = kspawn_groups(spawn, &ngroups);
+		if (spawn->user && !groups) {
+			faux_free(envp);
+			return -1;
+		}
+	}
+	map_num = 3 + spawn->fds_num;
+	map = faux_zmalloc(map_num * 3 * sizeof(*map));
+	assert(map);
+	map[0] = stdin_fd; map[1] = STDIN_FILENO;
+	map[3] = stdout_fd; map[4] = STDOUT_FILENO;
+	map[6] = stderr_fd; map[7] = STDERR_FILENO;
+	for (i = 0; i < spawn->fds_num; i++) {
+		map[(3 + i) * 3] = spawn->fds[i * 2];
+		map[(3 + i) * 3 + 1] = spawn->fds[i * 2 + 1];
+	}
+	for (i = 0; i < map_num; i++) {
+		int *m = &map[i * 3];
+		if (pts_fname && (m[0] >= 0) && isatty(m[0])) {
+			m[2] = 1;
+			use_pts = BOOL_TRUE;
+		}
+		if (m[1] >= min_tmp_fd)
+			min_tmp_fd = m[1] + 1;
+	}
+
+	// Child must not run session's signal handlers because it shares
+	// memory with session
+	sigfillset(&all_sigs);
+	sigprocmask(SIG_BLOCK, &all_sigs, &saved_sigs);
+
+	pid = vfork();
+
+	// Child
+	if (0 == pid) {
+		int pts = -1;
+		int sig = 0;
+
+		for (sig = 1; sig < NSIG; sig++) {
+			struct sigaction sa;
+			if (sigaction(sig, NULL, &sa) < 0)
+				continue;
+			if ((SIG_IGN == sa.sa_handler) ||
+				(SIG_DFL == sa.sa_handler))
+				continue;
+			sa.sa_handler = SIG_DFL;
+			sa.sa_flags = 0;
+			sigemptyset(&sa.sa_mask);
+			sigaction(sig, &sa, NULL);
+		}
+
+		// Reopen streams if the pseudoterminal is used.
+		// It's necessary to set session terminal
+		if (use_pts) {
+			setsid();
+			pts = open(pts_fname, O_RDWR | O_CLOEXEC, 0);
+			if (pts < 0)
+				_exit(127);
+		}
+
+		// Session's descriptors must not leak to program. Mapped
+		// descriptors lose CLOEXEC flag while dup2() below.
+		kspawn_sanitize_fds();
+
+		// Move sources out of destinations' range at first. Temporary
+		// descriptors have CLOEXEC flag so exec will close them.
+		for (i = 0; i < map_num; i++) {
+			int *m = &map[i * 3];
+			int src = m[2] ? pts : m[0];
+			if (src < 0)
+				continue;
+			m[0] = fcntl(src, F_DUPFD_CLOEXEC, min_tmp_fd);
+		}
+		for (i = 0; i < map_num; i++) {
+			int *m = &map[i * 3];
+			if (m[0] < 0)
+				continue;
+			dup2(m[0], m[1]);
+		}
+
+		if (spawn->cwd && (chdir(spawn->cwd) < 0))
+			_exit(127);
+
+		if (spawn->set_user) {
+			if (setgroups(ngroups, groups) < 0)
+				_exit(127);
+			if (setgid(spawn->gid) || setuid(spawn->uid))
+				_exit(127);
+		}
+
+		sigemptyset(&all_sigs);
+		sigprocmask(SIG_SETMASK, &all_sigs, NULL);
+
+		execve(path, argv, envp);
+		_exit(127);
+	}
+
+	// Parent
+	sigprocmask(SIG_SETMASK, &saved_sigs, NULL);
+	faux_free(map);
+	faux_free(groups);
+	faux_free(envp);
+
+	return pid;
+}
+
+
+// Closes descriptors from specified range or sets CLOEXEC flag to them.
+// The close_range() is used if kernel supports it (Linux 5.11+). Else
+// /proc/self/fd is enumerated. The function doesn't allocate memory so it
+// can be used after vfork().
+static void kspawn_fds_range(unsigned int from, unsigned int to,
+	bool_t do_close)
+{
+#ifdef SYS_getdents64
+	int dirfd = -1;
+	union {
+		char buf[1024];
+		uint64_t align;
+	} dirents;
+	long n = 0;
+#endif
+
+#ifdef SYS_close_range
+	if (syscall(SYS_close_range, from, to,
+		do_close ? 0 : CLOSE_RANGE_CLOEXEC) == 0)
+		return;
+#endif
+
+#ifdef SYS_getdents64
+	dirfd = open("/proc/self/fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dirfd < 0)
+		return;
+	while ((n = syscall(SYS_getdents64, dirfd,
+		dirents.buf, sizeof(dirents.buf))) > 0) {
+		long off = 0;
+		while (off < n) {
+			// Layout of struct linux_dirent64
+			const char *d = dirents.buf + off;
+			unsigned short reclen = *(const unsigned short *)
+				(d + 2 * sizeof(uint64_t));
+			const char *name = d + 2 * sizeof(uint64_t) +
+				sizeof(unsigned short) + 1;
+			unsigned int fd = 0;
+			off += reclen;
+			if ((*name < '0') || (*name > '9'))
+				continue; // "." and ".."
+			for (; (*name >= '0') && (*name <= '9'); name++)
+				fd = fd * 10 + (*name - '0');
+			if ((fd < from) || (fd > to) || ((int)fd == dirfd))
+				continue;
+			if (do_close)
+				close(fd);
+			else
+				fcntl(fd, F_SETFD, FD_CLOEXEC);
+		}
+	}
+	close(dirfd);
+#endif
+}
+
+
+/** @brief Sets CLOEXEC flag to all descriptors except stdin/out/err.
+ *
+ * Child process (spawned program) inherits all the session's descriptors:
+ * client socket, eloop's descriptors, pipes of other commands. The
+ * descriptors are still usable by the child itself but they will be
+ * closed on exec.
+ */
+void kspawn_sanitize_fds(void)
+{
+	kspawn_fds_range(3, ~0U, BOOL_FALSE);
+}
+
+
+/** @brief Closes all descriptors except stdin/out/err and specified ones.
+ *
+ * Forked child that doesn't exec (ACTION executed within forked process,
+ * worker) must not hold session's descriptors at all. Else the reader of
+ * pipe doesn't get EOF while the child is alive. The keep array is
+ * sorted in place.
+ */
+void kspawn_close_fds(int *keep, size_t keep_num)
+{
+	unsigned int from = 3;
+	size_t i = 0;
+
+	// Few descriptors only
+	for (i = 1; i < keep_num; i++) {
+		int fd = keep[i];
+		size_t j = i;
+		for (; (j > 0) && (keep[j - 1] > fd); j--)
+			keep[j] = keep[j - 1];
+		keep[j] = fd;
+	}
+
+	for (i = 0; i < keep_num; i++) {
+		if ((keep[i] < 0) || ((unsigned int)keep[i] < from))
+			continue;
+		if ((unsigned int)keep[i] > from)
+			kspawn_fds_range(from, keep[i] - 1, BOOL_TRUE);
+		from = keep[i] + 1;
+	}
+	kspawn_fds_range(from, ~0U, BOOL_TRUE);
+}
@@ -0,0 +1,610 @@
+/** @file kworkers.c
+ *
+ * Workers are forked from session process while session is idle. So each
+ * worker has the same scheme as session process. The scheme is immutable
+ * so pointers to scheme objects (ENTRYs, ACTIONs) are passed to worker as
+ * is. Another data (argument values, path) is serialized. The context's
+ * stdin, stdout, stderr are passed using SCM_RIGHTS.
+ *
+ * Worker reports ACTION's exit code to the common "done" pipe. Session
+ * process uses worker's PID as a PID of ACTION and feeds exit code to kexec
+ * like it does for terminated process.
+ *
+ * Worker gets session state (plugin's data etc.) as it was at worker start.
+ * Worker exits when it's idle longer than idle timeout or when session
+ * closes its socket.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+#include <syslog.h>
+
+#include <faux/faux.h>
+#include <faux/list.h>
+#include <klish/khelper.h>
+#include <klish/kcontext.h>
+#include <klish/kpath.h>
+#include <klish/kpargv.h>
+#include <klish/ksession.h>
+#include <klish/kworkers.h>
+#include <klish/kspawn.h>
+#include <klish/klock.h>
+
+
+// Max size of serialized request
+#define KWORKERS_MSG_MAX 65536
+
+typedef struct {
+	pid_t pid;
+	int sock; // Session's end of socket pair
+	bool_t busy;
+} kworker_t;
+
+struct kworkers_s {
+	size_t size;
+	unsigned int idle_timeout; // Seconds. 0 - infinite
+	kworker_t *workers;
+	size_t workers_num;
+	int done_r; // Read end of "done" pipe
+	int done_w; // Write end of "done" pipe
+};
+
+// Record written by worker when ACTION is done
+typedef struct {
+	pid_t pid;
+	int wstatus;
+} kworkers_done_t;
+
+// Serialization buffer
+typedef struct {
+	char *data;
+	size_t len;
+	size_t pos; // Read position
+} kworkers_msg_t;
+
+
+// Size
+KGET(workers, size_t, size);
+
+// Idle timeout
+KGET(workers, unsigned int, idle_timeout);
+
+
+kworkers_t *kworkers_new(size_t size, unsigned int idle_timeout)
+{
+	kworkers_t *workers = NULL;
+	int pipefd[2] = {};
+
+	if (0 == size)
+		return NULL;
+
+	workers = faux_zmalloc(sizeof(*workers));
+	assert(workers);
+	if (!workers)
+		return NULL;
+
+	// Initialize
+	workers->size = size;
+	workers->idle_timeout = idle_timeout;
+	workers->workers = faux_zmalloc(size * sizeof(*workers->workers));
+	assert(workers->workers);
+	workers->workers_num = 0;
+
+	// Record is less than PIPE_BUF so write is atomic
+	if (pipe2(pipefd, O_CLOEXEC) < 0) {
+		faux_free(workers->workers);
+		faux_free(workers);
+		return NULL;
+	}
+	fcntl(pipefd[0], F_SETFL, fcntl(pipefd[0], F_GETFL) | O_NONBLOCK);
+	workers->done_r = pipefd[0];
+	workers->done_w = pipefd[1];
+
+	return workers;
+}
+
+
+void kworkers_free(kworkers_t *workers)
+{
+	size_t i = 0;
+
+	if (!workers)
+		return;
+
+	// Workers will exit on socket's EOF
+	for (i = 0; i < workers->workers_num; i++)
+		close(workers->workers[i].sock);
+	faux_free(workers->workers);
+	close(workers->done_r);
+	close(workers->done_w);
+
+	faux_free(workers);
+}
+
+
+/** @brief Gets descriptor to wait for ACTIONs completion.
+ *
+ * When descriptor is readable the kworkers_reap() must be called.
+ */
+int kworkers_fd(const kworkers_t *workers)
+{
+	assert(workers);
+	if (!workers)
+		return -1;
+
+	return workers->done_r;
+}
+
+
+static bool_t kworkers_msg_put(kworkers_msg_t *msg, const void *ptr, size_t n)
+{
+	if ((msg->len + n) > KWORKERS_MSG_MAX)
+		return BOOL_FALSE;
+	memcpy(msg->data + msg->len, ptr, n);
+	msg->len += n;
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t kworkers_msg_put_str(kworkers_msg_t *msg, const char *str)
+{
+	size_t len = str ? (strlen(str) + 1) : 0; // 0 for NULL
+
+	if (!kworkers_msg_put(msg, &len, sizeof(len)))
+		return BOOL_FALSE;
+
+	return kworkers_msg_put(msg, str, len);
+}
+
+
+static bool_t kworkers_msg_get(kworkers_msg_t *msg, void *ptr, size_t n)
+{
+	if ((msg->pos + n) > msg->len)
+		return BOOL_FALSE;
+	memcpy(ptr, msg->data + msg->pos, n);
+	msg->pos += n;
+
+	return BOOL_TRUE;
+}
+
+
+// Returned string points to message's data
+static bool_t kworkers_msg_get_str(kworkers_msg_t *msg, const char **str)
+{
+	size_t len = 0;
+
+	if (!kworkers_msg_get(msg, &len, sizeof(len)))
+		return BOOL_FALSE;
+	if ((msg->pos + len) > msg->len)
+		return BOOL_FALSE;
+	if ((len > 0) && (msg->data[msg->pos + len - 1] != '\0'))
+		return BOOL_FALSE;
+	*str = len ? (msg->data + msg->pos) : NULL;
+	msg->pos += len;
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t kworkers_serialize(kworkers_msg_t *msg,
+	const kcontext_t *context)
+{
+	ksession_t *session = kcontext_session(context);
+	const kpargv_t *pargv = kcontext_pargv(context);
+	faux_list_node_t *action_iter = kcontext_action_iter(context);
+	const kentry_t *command = kpargv_command(pargv);
+	size_t level = kpargv_level(pargv);
+	int retcode = kcontext_retcode(context);
+	size_t stage = kcontext_pipeline_stage(context);
+	kpath_t *path = ksession_path(session);
+	size_t num = 0;
+	kpath_levels_node_t *path_iter = NULL;
+	klevel_t *klevel = NULL;
+	kpargv_pargs_node_t *pargs_iter = NULL;
+	kparg_t *parg = NULL;
+	bool_t rc = BOOL_TRUE;
+
+	rc = rc && kworkers_msg_put(msg, &session, sizeof(session));
+	rc = rc && kworkers_msg_put(msg, &action_iter, sizeof(action_iter));
+	rc = rc && kworkers_msg_put(msg, &command, sizeof(command));
+	rc = rc && kworkers_msg_put(msg, &level, sizeof(level));
+	rc = rc && kworkers_msg_put(msg, &retcode, sizeof(retcode));
+	rc = rc && kworkers_msg_put(msg, &stage, sizeof(stage));
+	rc = rc && kworkers_msg_put_str(msg, kcontext_line(context));
+
+	// Current path of session
+	num = kpath_len(path);
+	rc = rc && kworkers_msg_put(msg, &num, sizeof(num));
+	path_iter = kpath_iter(path);
+	while (rc && (klevel = kpath_each(&path_iter))) {
+		const kentry_t *entry = klevel_entry(klevel);
+		rc = kworkers_msg_put(msg, &entry, sizeof(entry));
+	}
+
+	// Arguments
+	num = kpargv_pargs_len(pargv);
+	rc = rc && kworkers_msg_put(msg, &num, sizeof(num));
+	pargs_iter = kpargv_pargs_iter(pargv);
+	while (rc && (parg = kpargv_pargs_each(&pargs_iter))) {
+		const kentry_t *entry = kparg_entry(parg);
+		rc = kworkers_msg_put(msg, &entry, sizeof(entry));
+		rc = rc && kworkers_msg_put_str(msg, kparg_value(parg));
+	}
+
+	return rc;
+}
+
+
+// Builds context within worker
+static kcontext_t *kworkers_deserialize(kworkers_msg_t *msg)
+{
+	ksession_t *session = NULL;
+	faux_list_node_t *action_iter = NULL;
+	const kentry_t *command = NULL;
+	size_t level = 0;
+	int retcode = 0;
+	size_t stage = 0;
+	const char *line = NULL;
+	size_t num = 0;
+	size_t i = 0;
+	kpath_t *path = NULL;
+	kpargv_t *pargv = NULL;
+	kcontext_t *context = NULL;
+
+	if (!kworkers_msg_get(msg, &session, sizeof(session)) ||
+		!kworkers_msg_get(msg, &action_iter, sizeof(action_iter)) ||
+		!kworkers_msg_get(msg, &command, sizeof(command)) ||
+		!kworkers_msg_get(msg, &level, sizeof(level)) ||
+		!kworkers_msg_get(msg, &retcode, sizeof(retcode)) ||
+		!kworkers_msg_get(msg, &stage, sizeof(stage)) ||
+		!kworkers_msg_get_str(msg, &line))
+		return NULL;
+
+	// Current path of session
+	if (!kworkers_msg_get(msg, &num, sizeof(num)))
+		return NULL;
+	path = ksession_path(session);
+	while (kpath_len(path) > 0)
+		kpath_pop(path);
+	for (i = 0; i < num; i++) {
+		const kentry_t *entry = NULL;
+		if (!kworkers_msg_get(msg, &entry, sizeof(entry)))
+			return NULL;
+		kpath_push(path, klevel_new(entry));
+	}
+
+	// Arguments
+	pargv = kpargv_new();
+	kpargv_set_command(pargv, command);
+	kpargv_set_level(pargv, level);
+	kpargv_set_purpose(pargv, KPURPOSE_EXEC);
+	if (!kworkers_msg_get(msg, &num, sizeof(num))) {
+		kpargv_free(pargv);
+		return NULL;
+	}
+	for (i = 0; i < num; i++) {
+		const kentry_t *entry = NULL;
+		const char *value = NULL;
+		if (!kworkers_msg_get(msg, &entry, sizeof(entry)) ||
+			!kworkers_msg_get_str(msg, &value)) {
+			kpargv_free(pargv);
+			return NULL;
+		}
+		kpargv_add_pargs(pargv, kparg_new_in_arena(
+			kpargv_arena(pargv), entry, value));
+	}
+
+	context = kcontext_new(KCONTEXT_TYPE_ACTION);
+	assert(context);
+	kcontext_set_scheme(context, ksession_scheme(session));
+	kcontext_set_pargv(context, pargv);
+	kcontext_set_session(context, session);
+	kcontext_set_line(context, line);
+	kcontext_set_pipeline_stage(context, stage);
+	kcontext_set_retcode(context, retcode);
+	kcontext_set_action_iter(context, action_iter);
+
+	return context;
+}
+
+
+// Worker's main loop. Never returns.
+static void kworkers_worker(int sock, int done_w, unsigned int idle_timeout)
+{
+	char *data = NULL;
+	int devnull = -1;
+	sigset_t sigs;
+	kworkers_done_t done = {};
+	int keep[2] = {};
+
+	// Unblock signals like forked ACTION process does
+	sigemptyset(&sigs);
+	sigprocmask(SIG_SETMASK, &sigs, NULL);
+
+	// Worker must not hold descriptors of session: pipes of commands
+	// executed later, client socket, other workers' sockets. Else the
+	// next process in pipe never gets EOF and session's resources live
+	// while worker lives. Syslog will reopen its socket if needed.
+	closelog();
+	keep[0] = sock;
+	keep[1] = done_w;
+	kspawn_close_fds(keep, 2);
+
+	data = faux_malloc(KWORKERS_MSG_MAX);
+	assert(data);
+	devnull = open("/dev/null", O_RDWR | O_CLOEXEC);
+	done.pid = getpid();
+
+	while (1) {
+		struct pollfd pfd = { .fd = sock, .events = POLLIN };
+		kworkers_msg_t msg = { .data = data, .len = 0, .pos = 0 };
+		union {
+			char buf[CMSG_SPACE(3 * sizeof(int))];
+			struct cmsghdr align;
+		} control = {};
+		struct iovec iov = { .iov_base = data,
+			.iov_len = KWORKERS_MSG_MAX };
+		struct msghdr mh = {};
+		struct cmsghdr *cmsg = NULL;
+		int fds[3] = { -1, -1, -1 };
+		kcontext_t *context = NULL;
+		ssize_t r = -1;
+		int exitcode = -1;
+		int lock_fd = -1;
+		int i = 0;
+
+		r = poll(&pfd, 1, idle_timeout ? (int)(idle_timeout * 1000) : -1);
+		if (r < 0) {
+			if (EINTR == errno)
+				continue;
+			break;
+		}
+		if (0 == r) // Idle timeout
+			break;
+
+		mh.msg_iov = &iov;
+		mh.msg_iovlen = 1;
+		mh.msg_control = control.buf;
+		mh.msg_controllen = sizeof(control.buf);
+		r = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+		if (r < 0) {
+			if (EINTR == errno)
+				continue;
+			break;
+		}
+		if (0 == r) // Session is closed
+			break;
+		msg.len = r;
+		cmsg = CMSG_FIRSTHDR(&mh);
+		if (cmsg && (SOL_SOCKET == cmsg->cmsg_level) &&
+			(SCM_RIGHTS == cmsg->cmsg_type) &&
+			(cmsg->cmsg_len == CMSG_LEN(sizeof(fds))))
+			memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+		context = kworkers_deserialize(&msg);
+		if (context && (fds[0] >= 0)) {
+			ksym_fn fn = ksym_function(
+				kaction_sym(kcontext_action(context)));
+			dup2(fds[0], STDIN_FILENO);
+			dup2(fds[1], STDOUT_FILENO);
+			dup2(fds[2], STDERR_FILENO);
+			kcontext_set_stdin(context, STDIN_FILENO);
+			kcontext_set_stdout(context, STDOUT_FILENO);
+			kcontext_set_stderr(context, STDERR_FILENO);
+			if (klock_action(context, BOOL_TRUE, &lock_fd)) {
+				exitcode = fn(context);
+				klock_release(lock_fd);
+			}
+			fflush(stdout);
+			fflush(stderr);
+			// Release streams to inform next process in pipe
+			// about EOF
+			kcontext_set_stdin(context, -1);
+			kcontext_set_stdout(context, -1);
+			kcontext_set_stderr(context, -1);
+			dup2(devnull, STDIN_FILENO);
+			dup2(devnull, STDOUT_FILENO);
+			dup2(devnull, STDERR_FILENO);
+		}
+		kcontext_free(context);
+		for (i = 0; i < 3; i++) {
+			if (fds[i] >= 0)
+				close(fds[i]);
+		}
+
+		// Like exit() status for WEXITSTATUS()
+		done.wstatus = (exitcode & 0xff) << 8;
+		while ((write(done_w, &done, sizeof(done)) < 0) &&
+			(EINTR == errno));
+	}
+
+	_exit(0);
+}
+
+
+/** @brief Forks workers up to pool size.
+ *
+ * Worker closes all inherited descriptors except its socket and the
+ * pipe for completion reports. So it can be called at any time.
+ */
+bool_t kworkers_fill(kworkers_t *workers)
+{
+	assert(workers);
+	if (!workers)
+		return BOOL_FALSE;
+
+	while (workers->workers_num < workers->size) {
+		int sv[2] = {};
+		pid_t pid = -1;
+
+		if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC,
+			0, sv) < 0)
+			return BOOL_FALSE;
+
+		fflush(stdout);
+		fflush(stderr);
+		pid = fork();
+		if (pid < 0) {
+			close(sv[0]);
+			close(sv[1]);
+			return BOOL_FALSE;
+		}
+
+		// Child (worker). It closes all inherited descriptors.
+		if (0 == pid)
+			kworkers_worker(sv[1], workers->done_w,
+				workers->idle_timeout);
+
+		// Parent
+		close(sv[1]);
+		workers->workers[workers->workers_num].pid = pid;
+		workers->workers[workers->workers_num].sock = sv[0];
+		workers->workers[workers->workers_num].busy = BOOL_FALSE;
+		workers->workers_num++;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Removes worker from pool.
+ *
+ * It's used when worker process is terminated.
+ */
+bool_t kworkers_del(kworkers_t *workers, pid_t pid)
+{
+	size_t i = 0;
+
+	assert(workers);
+	if (!workers)
+		return BOOL_FALSE;
+
+	for (i = 0; i < workers->workers_num; i++) {
+		if (workers->workers[i].pid != pid)
+			continue;
+		close(workers->workers[i].sock);
+		workers->workers_num--;
+		workers->workers[i] = workers->workers[workers->workers_num];
+		return BOOL_TRUE;
+	}
+
+	return BOOL_FALSE;
+}
+
+
+/** @brief Passes ACTION to idle worker.
+ *
+ * Context's action iterator must point to ACTION to execute. Returns PID
+ * of worker that is used as ACTION's PID. Returns -1 if there is no idle
+ * worker. The caller can fork() new process then.
+ */
+pid_t kworkers_run(kworkers_t *workers, const kcontext_t *context)
+{
+	kworker_t *worker = NULL;
+	kworkers_msg_t msg = {};
+	int fds[3] = {};
+	union {
+		char buf[CMSG_SPACE(sizeof(fds))];
+		struct cmsghdr align;
+	} control = {};
+	struct iovec iov = {};
+	struct msghdr mh = {};
+	struct cmsghdr *cmsg = NULL;
+	size_t i = 0;
+	ssize_t r = -1;
+
+	assert(workers);
+	if (!workers)
+		return -1;
+	assert(context);
+	if (!context)
+		return -1;
+
+	for (i = 0; i < workers->workers_num; i++) {
+		if (!workers->workers[i].busy) {
+			worker = &workers->workers[i];
+			break;
+		}
+	}
+	if (!worker)
+		return -1;
+
+	msg.data = faux_malloc(KWORKERS_MSG_MAX);
+	assert(msg.data);
+	if (!kworkers_serialize(&msg, context)) {
+		faux_free(msg.data);
+		return -1;
+	}
+
+	fds[0] = kcontext_stdin(context);
+	fds[1] = kcontext_stdout(context);
+	fds[2] = kcontext_stderr(context);
+	iov.iov_base = msg.data;
+	iov.iov_len = msg.len;
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = control.buf;
+	mh.msg_controllen = sizeof(control.buf);
+	cmsg = CMSG_FIRSTHDR(&mh);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	do {
+		r = sendmsg(worker->sock, &mh, MSG_NOSIGNAL);
+	} while ((r < 0) && (EINTR == errno));
+	faux_free(msg.data);
+	if (r < 0) {
+		// Worker is dead. Its process will be reaped later.
+		kworkers_del(workers, worker->pid);
+		return -1;
+	}
+	worker->busy = BOOL_TRUE;
+
+	return worker->pid;
+}
+
+
+/** @brief Gets completed ACTION.
+ *
+ * The wstatus has the same format as waitpid() status. Returns BOOL_FALSE
+ * if there are no completed ACTIONs.
+ */
+bool_t kworkers_reap(kworkers_t *workers, pid_t *pid, int *wstatus)
+{
+	kworkers_done_t done = {};
+	ssize_t r = -1;
+	size_t i = 0;
+
+	assert(workers);
+	if (!workers)
+		return BOOL_FALSE;
+
+	r = read(workers->done_r, &done, sizeof(done));
+	if (r != sizeof(done))
+		return BOOL_FALSE;
+
+	for (i = 0; i < workers->workers_num; i++) {
+		if (workers->workers[i].pid == done.pid) {
+			workers->workers[i].busy = BOOL_FALSE;
+			break;
+		}
+	}
+	if (pid)
+		*pid = done.pid;
+	if (wstatus)
+		*wstatus = done.wstatus;
+
+	return BOOL_TRUE;
+}
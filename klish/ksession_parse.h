@@ -11,13 +11,21 @@
 #include <klish/ksession.h>
 
 
+// Parsing is not limited by level of path
+#define KSESSION_LEVEL_ANY ((size_t)(-1))
+
 C_DECL_BEGIN
 
 kpargv_t *ksession_parse_line(ksession_t *session, const faux_argv_t *argv,
 	kpargv_purpose_e purpose, bool_t is_filter);
+kpargv_t *ksession_parse_line_from_level(ksession_t *session,
+	const faux_argv_t *argv, kpargv_purpose_e purpose, bool_t is_filter,
+	size_t start_level);
 faux_list_t *ksession_split_pipes(const char *raw_line, faux_error_t *error);
 kpargv_t *ksession_parse_for_completion(ksession_t *session,
 	const char *raw_line);
+kpargv_t *ksession_parse_for_completion_ext(ksession_t *session,
+	const faux_list_t *split, size_t checked_stages, size_t last_level);
 kexec_t *ksession_parse_for_exec(ksession_t *session, const char *raw_line,
 	faux_error_t *error);
 kexec_t *ksession_parse_for_local_exec(ksession_t *session, const kentry_t *entry,
@@ -27,6 +35,10 @@ bool_t ksession_exec_locally(ksession_t *session, const kentry_t *entry,
 	kpargv_t *parent_pargv, const kcontext_t *parent_context,
 	const kexec_t *parent_exec, int *retcode, char **out);
 
+// Resumable request. Pending service ACTION is driven by session's eloop.
+bool_t ksession_read_locally(ksession_t *session);
+bool_t ksession_continue_locally(ksession_t *session, pid_t pid, int wstatus);
+
 C_DECL_END
 
 #endif // _klish_ksession_parse_h
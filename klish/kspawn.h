@@ -0,0 +1,42 @@
+/** @file kspawn.h
+ *
+ * @brief Klish spawn request. Plugin's symbol can describe external program
+ * to execute (argv, environment, working directory, descriptors) instead of
+ * forking itself. Then kexec launches the program using vfork() so the
+ * large session process is not copied.
+ */
+
+#ifndef _klish_kspawn_h
+#define _klish_kspawn_h
+
+#include <sys/types.h>
+
+#include <faux/faux.h>
+
+
+typedef struct kspawn_s kspawn_t;
+
+C_DECL_BEGIN
+
+kspawn_t *kspawn_new(void);
+void kspawn_free(kspawn_t *spawn);
+
+bool_t kspawn_set_path(kspawn_t *spawn, const char *path);
+const char *kspawn_path(const kspawn_t *spawn);
+bool_t kspawn_add_arg(kspawn_t *spawn, const char *arg);
+bool_t kspawn_setenv(kspawn_t *spawn, const char *name, const char *value);
+bool_t kspawn_set_cwd(kspawn_t *spawn, const char *cwd);
+bool_t kspawn_set_user(kspawn_t *spawn, const char *user,
+	uid_t uid, gid_t gid);
+bool_t kspawn_add_fd(kspawn_t *spawn, int fd, int child_fd);
+bool_t kspawn_own_fd(kspawn_t *spawn, int fd);
+
+pid_t kspawn_launch(const kspawn_t *spawn, int stdin_fd, int stdout_fd,
+	int stderr_fd, const char *pts_fname);
+
+void kspawn_sanitize_fds(void);
+void kspawn_close_fds(int *keep, size_t keep_num);
+
+C_DECL_END
+
+#endif // _klish_kspawn_h
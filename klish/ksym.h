@@ -6,13 +6,46 @@
 #ifndef _klish_ksym_h
 #define _klish_ksym_h
 
+#include <faux/error.h>
+#include <faux/buf.h>
 #include <klish/kcontext_base.h>
+#include <klish/kspawn.h>
 
 typedef struct ksym_s ksym_t;
 
 // Callback function prototype
 typedef int (*ksym_fn)(kcontext_t *context);
 
+// Prepare function compiles ACTION's script to immutable argument block
+// while scheme preparing. Returns NULL on error. The block is freed by
+// symbol's prepared_free function. If symbol has no such function then
+// the block must be a single chunk of memory allocated by malloc().
+typedef void *(*ksym_prepare_fn)(const char *script, faux_error_t *error);
+typedef void (*ksym_prepared_free_fn)(void *prepared);
+
+// Spawn function fills spawn request to execute external program instead
+// of forking session process for async ACTION. It's executed within session
+// process. Returns BOOL_FALSE if program can't be spawned. The symbol's
+// regular function will be executed within forked process then.
+typedef bool_t (*ksym_spawn_fn)(kcontext_t *context, kspawn_t *spawn);
+
+// Line filter. Filter symbol that has line filter functions can be
+// executed within session process when it's trailing stage of pipeline.
+// The "init" function creates filter state for context. Returns NULL on
+// error. The "line" function gets NUL-terminated line without trailing
+// newline and returns BOOL_TRUE if line must be passed to output. The
+// "fini" function can write final output and must free the state.
+typedef void *(*ksym_filter_init_fn)(kcontext_t *context);
+typedef bool_t (*ksym_filter_line_fn)(void *state,
+	const char *line, size_t len);
+typedef void (*ksym_filter_fini_fn)(void *state, faux_buf_t *out);
+
+typedef struct {
+	ksym_filter_init_fn init;
+	ksym_filter_line_fn line;
+	ksym_filter_fini_fn fini;
+} ksym_filter_t;
+
 // Aliases for permanent flag
 #define KSYM_USERDEFINED_PERMANENT TRI_UNDEFINED
 #define KSYM_NONPERMANENT TRI_FALSE
@@ -23,6 +56,15 @@ typedef int (*ksym_fn)(kcontext_t *context);
 #define KSYM_UNSYNC TRI_FALSE
 #define KSYM_SYNC TRI_TRUE
 
+// Keyword symbols (PTYPEs like COMMAND) validate argument by comparison
+// with ENTRY's name (or value). ENTRYs with such PTYPEs can be indexed
+// and found without symbol execution.
+typedef enum {
+	KSYM_KEYWORD_NONE, // Generic symbol
+	KSYM_KEYWORD_CASE, // Case sensitive keyword
+	KSYM_KEYWORD_NOCASE, // Case insensitive keyword
+} ksym_keyword_e;
+
 
 C_DECL_BEGIN
 
@@ -43,6 +85,22 @@ bool_t ksym_set_permanent(ksym_t *sym, tri_t permanent);
 tri_t ksym_sync(const ksym_t *sym);
 bool_t ksym_set_sync(ksym_t *sym, tri_t sync);
 
+ksym_keyword_e ksym_keyword(const ksym_t *sym);
+bool_t ksym_set_keyword(ksym_t *sym, ksym_keyword_e keyword);
+
+bool_t ksym_pure(const ksym_t *sym);
+bool_t ksym_set_pure(ksym_t *sym, bool_t pure);
+
+ksym_prepare_fn ksym_prepare(const ksym_t *sym);
+bool_t ksym_set_prepare(ksym_t *sym, ksym_prepare_fn prepare);
+ksym_prepared_free_fn ksym_prepared_free(const ksym_t *sym);
+bool_t ksym_set_prepared_free(ksym_t *sym,
+	ksym_prepared_free_fn prepared_free);
+ksym_spawn_fn ksym_spawn(const ksym_t *sym);
+bool_t ksym_set_spawn(ksym_t *sym, ksym_spawn_fn spawn);
+const ksym_filter_t *ksym_filter(const ksym_t *sym);
+bool_t ksym_set_filter(ksym_t *sym, const ksym_filter_t *filter);
+
 C_DECL_END
 
 #endif // _klish_ksym_h
@@ -56,6 +56,7 @@ typedef enum {
 	KTP_STATUS_NEED_STDIN =		(uint32_t)0x00001000, // Server's cmd need stdin
 	KTP_STATUS_INTERACTIVE =	(uint32_t)0x00002000, // Server's stdout is for tty
 	KTP_STATUS_DRY_RUN =		(uint32_t)0x00010000,
+	KTP_STATUS_STOP_ON_ERROR =	(uint32_t)0x00020000, // Skip next cmds on error
 	KTP_STATUS_EXIT =		(uint32_t)0x80000000,
 } ktp_status_e;
 
@@ -67,6 +68,7 @@ typedef enum {
 #define KTP_STATUS_IS_NEED_STDIN(status) (status & KTP_STATUS_NEED_STDIN)
 #define KTP_STATUS_IS_INTERACTIVE(status) (status & KTP_STATUS_INTERACTIVE)
 #define KTP_STATUS_IS_DRY_RUN(status) (status & KTP_STATUS_DRY_RUN)
+#define KTP_STATUS_IS_STOP_ON_ERROR(status) (status & KTP_STATUS_STOP_ON_ERROR)
 #define KTP_STATUS_IS_EXIT(status) (status & KTP_STATUS_EXIT)
 
 
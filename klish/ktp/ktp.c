@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -10,6 +11,7 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <syslog.h>
+#include <arpa/inet.h>
 
 #include <faux/str.h>
 #include <faux/msg.h>
@@ -29,7 +31,7 @@ int ktp_connect_unix(const char *sun_path)
 		return -1;
 
 	// Create socket
-	if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+	if ((sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1)
 		return -1;
 	if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
 		close(sock);
@@ -61,7 +63,7 @@ int ktp_accept(int listen_sock)
 {
 	int new_conn = -1;
 
-	new_conn = accept(listen_sock, NULL, NULL);
+	new_conn = accept4(listen_sock, NULL, NULL, SOCK_CLOEXEC);
 
 	return new_conn;
 }
@@ -101,6 +103,43 @@ faux_msg_t *ktp_msg_preform(ktp_cmd_e cmd, uint32_t status)
 }
 
 
+/** @brief Forms header of stream message (KTP_STDOUT, KTP_STDERR).
+ *
+ * The message contains single KTP_PARAM_LINE parameter. Header of message
+ * and header of parameter are written to the "frame" buffer. The frame
+ * buffer must be KTP_STREAM_HDR_LEN bytes long. The parameter's data must
+ * be sent right after the frame. So the data can be sent directly from
+ * the source buffer without copying to faux_msg_t object.
+ *
+ * @param [out] frame Buffer for header.
+ * @param [in] cmd Command code of message.
+ * @param [in] len Length of parameter's data.
+ * @return Length of formed header.
+ */
+size_t ktp_stream_hdr(void *frame, ktp_cmd_e cmd, size_t len)
+{
+	faux_hdr_t *hdr = (faux_hdr_t *)frame;
+	faux_phdr_t *phdr = (faux_phdr_t *)((char *)frame + sizeof(*hdr));
+
+	assert(frame);
+	if (!frame)
+		return 0;
+
+	memset(frame, 0, KTP_STREAM_HDR_LEN);
+	hdr->magic = htonl(KTP_MAGIC);
+	hdr->major = KTP_MAJOR;
+	hdr->minor = KTP_MINOR;
+	hdr->cmd = htons(cmd);
+	hdr->status = htonl(KTP_STATUS_NONE);
+	hdr->param_num = htonl(1);
+	hdr->len = htonl(KTP_STREAM_HDR_LEN + len);
+	phdr->param_type = htons(KTP_PARAM_LINE);
+	phdr->param_len = htonl(len);
+
+	return KTP_STREAM_HDR_LEN;
+}
+
+
 bool_t ktp_send_error(faux_async_t *async, ktp_cmd_e cmd, const char *error)
 {
 	faux_msg_t *msg = NULL;
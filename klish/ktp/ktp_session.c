@@ -21,6 +21,13 @@ typedef struct cb_s {
 } cb_t;
 
 
+// Command that was sent to server but is not answered yet
+typedef struct {
+	uint32_t req_id;
+	faux_error_t *error;
+} ktp_cmd_req_t;
+
+
 struct ktp_session_s {
 	ktp_session_state_e state;
 	faux_async_t *async;
@@ -38,6 +45,9 @@ struct ktp_session_s {
 	bool_t stdout_need_newline; // Does stdout has final line feed. If no then newline is needed
 	bool_t stderr_need_newline; // Does stderr has final line feed. If no then newline is needed
 	int last_stream; // Last active stream: stdout or stderr
+	uint32_t req_id; // Id of last sent request
+	faux_list_t *cmd_queue; // Sent commands waiting for ACK (pipelining)
+	bool_t stop_on_error; // Ask server to skip next commands on error
 };
 
 
@@ -76,6 +86,10 @@ ktp_session_t *ktp_session_new(int sock, faux_eloop_t *eloop)
 	ktp->stdout_need_newline = BOOL_FALSE;
 	ktp->stderr_need_newline = BOOL_FALSE;
 	ktp->last_stream = STDOUT_FILENO;
+	ktp->req_id = 0;
+	ktp->cmd_queue = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, faux_free);
+	ktp->stop_on_error = BOOL_FALSE;
 
 	// Async object
 	ktp->async = faux_async_new(sock);
@@ -100,9 +114,20 @@ ktp_session_t *ktp_session_new(int sock, faux_eloop_t *eloop)
 
 void ktp_session_free(ktp_session_t *ktp)
 {
+	ktp_cmd_req_t *req = NULL;
+	faux_list_node_t *iter = NULL;
+
 	if (!ktp)
 		return;
 
+	// Error object of current command is freed by caller. But errors of
+	// pipelined commands are not visible to caller yet.
+	iter = faux_list_head(ktp->cmd_queue);
+	while ((req = (ktp_cmd_req_t *)faux_list_each(&iter))) {
+		if (req->error != ktp->error)
+			faux_error_free(req->error);
+	}
+	faux_list_free(ktp->cmd_queue);
 	// Remove socket from eloop but don't free eloop because it's external
 	faux_eloop_del_fd(ktp->eloop, ktp_session_fd(ktp));
 	faux_free(ktp->hdr);
@@ -395,6 +420,7 @@ static bool_t ktp_session_process_cmd_ack(ktp_session_t *ktp, const faux_msg_t *
 	uint8_t *retcode8bit = NULL;
 	ktp_status_e status = KTP_STATUS_NONE;
 	char *error_str = NULL;
+	ktp_cmd_req_t *req = NULL;
 
 	assert(ktp);
 	assert(msg);
@@ -417,6 +443,20 @@ static bool_t ktp_session_process_cmd_ack(ktp_session_t *ktp, const faux_msg_t *
 		return BOOL_TRUE;
 	}
 
+	// Server executes pipelined commands in order so ACK is for the
+	// oldest command. Old servers don't send request id at all.
+	req = (ktp_cmd_req_t *)faux_list_takeaway(ktp->cmd_queue,
+		faux_list_head(ktp->cmd_queue));
+	if (req) {
+		if ((faux_msg_get_req_id(msg) != 0) &&
+			(faux_msg_get_req_id(msg) != req->req_id))
+			syslog(LOG_WARNING, "Unexpected KTP_CMD_ACK request id "
+				"%u (%u is expected)\n",
+				faux_msg_get_req_id(msg), req->req_id);
+		ktp->error = req->error;
+		faux_free(req);
+	}
+
 	// If retcode param is not present it means all is ok (retcode = 0).
 	// Server will not send retcode in a case of empty command. Empty command
 	// doesn't execute real actions
@@ -437,7 +477,8 @@ static bool_t ktp_session_process_cmd_ack(ktp_session_t *ktp, const faux_msg_t *
 
 	ktp->cmd_retcode_available = BOOL_TRUE; // Answer from server was received
 	ktp->request_done = BOOL_TRUE;
-	ktp->state = KTP_SESSION_STATE_IDLE;
+	if (faux_list_is_empty(ktp->cmd_queue))
+		ktp->state = KTP_SESSION_STATE_IDLE;
 	// Get exit flag from message
 	if (KTP_STATUS_IS_EXIT(status))
 		ktp_session_set_done(ktp, BOOL_TRUE);
@@ -449,6 +490,18 @@ static bool_t ktp_session_process_cmd_ack(ktp_session_t *ktp, const faux_msg_t *
 			ktp, msg,
 			ktp->cb[KTP_SESSION_CB_CMD_ACK].udata);
 
+	// Next pipelined command becomes current one. Don't drop retcode
+	// because it's the result of last answered command.
+	req = (ktp_cmd_req_t *)faux_list_data(faux_list_head(ktp->cmd_queue));
+	if (req) {
+		ktp->error = req->error;
+		ktp->cmd_features = KTP_STATUS_NONE;
+		ktp->cmd_features_available = BOOL_FALSE;
+		ktp->stdout_need_newline = BOOL_FALSE;
+		ktp->stderr_need_newline = BOOL_FALSE;
+		ktp->last_stream = STDOUT_FILENO;
+	}
+
 	return BOOL_TRUE;
 }
 
@@ -700,8 +753,11 @@ static bool_t ktp_session_req(ktp_session_t *ktp, ktp_cmd_e cmd,
 	// Set dry-run flag
 	if (dry_run)
 		status |= KTP_STATUS_DRY_RUN;
+	if ((KTP_CMD == cmd) && ktp->stop_on_error)
+		status |= KTP_STATUS_STOP_ON_ERROR;
 
 	req = ktp_msg_preform(cmd, status);
+	faux_msg_set_req_id(req, ++ktp->req_id);
 	if (line)
 		faux_msg_add_param(req, KTP_PARAM_LINE, line, line_len);
 	faux_msg_send_async(req, ktp->async);
@@ -715,17 +771,57 @@ static bool_t ktp_session_req(ktp_session_t *ktp, ktp_cmd_e cmd,
 }
 
 
+/** @brief Sends command to server.
+ *
+ * Command can be sent while previous commands are not answered yet
+ * (pipelining). Server executes commands in order. The per-command state
+ * (error object, features, retcode) is switched to the next command when
+ * ACK of previous one is received.
+ */
 bool_t ktp_session_cmd(ktp_session_t *ktp, const char *line,
 	faux_error_t *error, bool_t dry_run)
 {
+	ktp_cmd_req_t *req = NULL;
+	bool_t drop_state = BOOL_FALSE;
+
 	if (!line)
 		return BOOL_FALSE;
 
+	// Don't touch state of command in progress
+	drop_state = faux_list_is_empty(ktp->cmd_queue);
 	if (!ktp_session_req(ktp, KTP_CMD, line, strlen(line),
-		error, dry_run, BOOL_TRUE))
+		error, dry_run, drop_state))
 		return BOOL_FALSE;
 	ktp->state = KTP_SESSION_STATE_WAIT_FOR_CMD;
 
+	req = faux_zmalloc(sizeof(*req));
+	assert(req);
+	req->req_id = ktp->req_id;
+	req->error = error;
+	faux_list_add(ktp->cmd_queue, req);
+
+	return BOOL_TRUE;
+}
+
+
+size_t ktp_session_cmd_outstanding(const ktp_session_t *ktp)
+{
+	assert(ktp);
+	if (!ktp)
+		return 0;
+
+	return faux_list_len(ktp->cmd_queue);
+}
+
+
+bool_t ktp_session_set_stop_on_error(ktp_session_t *ktp, bool_t stop_on_error)
+{
+	assert(ktp);
+	if (!ktp)
+		return BOOL_FALSE;
+
+	ktp->stop_on_error = stop_on_error;
+
 	return BOOL_TRUE;
 }
 
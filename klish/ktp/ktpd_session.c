@@ -14,6 +14,8 @@
 #include <poll.h>
 #include <sys/wait.h>
 #include <ctype.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
 
 #include <faux/str.h>
 #include <faux/conv.h>
@@ -27,6 +29,8 @@
 #include <klish/ktp_session.h>
 
 #define BUF_LIMIT 65536
+// Max number of pipelined commands waiting for execution
+#define CMD_QUEUE_LIMIT 1024
 
 
 typedef enum {
@@ -34,6 +38,7 @@ typedef enum {
 	KTPD_SESSION_STATE_UNAUTHORIZED = 'a',
 	KTPD_SESSION_STATE_IDLE = 'i',
 	KTPD_SESSION_STATE_WAIT_FOR_PROCESS = 'p',
+	KTPD_SESSION_STATE_WAIT_FOR_LOCAL = 'l', // Request is suspended
 } ktpd_session_state_e;
 
 
@@ -44,8 +49,40 @@ struct ktpd_session_s {
 	faux_hdr_t *hdr; // Engine will receive header and then msg
 	faux_eloop_t *eloop; // External link, dont's free()
 	kexec_t *exec;
+	// Pipelining. Client can send next commands without waiting for
+	// the ACK of current one. Such commands are queued and executed in
+	// order.
+	faux_list_t *cmd_queue;
+	uint32_t cmd_req_id; // Request id of current command
+	bool_t cmd_stop_on_error; // Current command has stop-on-error flag
+	bool_t cmd_skip; // Skip stop-on-error commands after failure
+	// Request (command parsing, completion, help) is suspended while
+	// service ACTION is executed. It will be processed again.
+	faux_msg_t *local_req;
+	int local_fd; // Output of pending service ACTION
+	int feed_fd; // Destination of queued output of sync ACTION
 	bool_t exit;
+	// Session shares eloop with other sessions. It doesn't stop eloop and
+	// doesn't wait for SIGCHLD itself.
+	ktpd_session_close_cb_fn close_cb;
+	void *close_udata;
 	bool_t stdin_must_be_closed;
+	// Result of last parsing for completion/help. Consecutive requests
+	// usually have the same line or extend the previous one.
+	faux_list_t *compl_split;
+	kpargv_t *compl_pargv;
+	kpath_t *compl_path;
+	kscheme_t *compl_scheme;
+	// Output coalescing. Small chunks of output are held within kexec's
+	// buffers till coalesce_bytes are accumulated or delay is expired.
+	size_t coalesce_bytes; // 0 - coalescing is off
+	struct timespec coalesce_delay;
+	faux_ev_t *coalesce_ev; // Scheduled flush
+	size_t held_chunks[2]; // Chunks within stdout/stderr buffers
+	// Output statistics
+	size_t stream_frames;
+	size_t stream_bytes;
+	size_t stream_saved_frames;
 };
 
 
@@ -54,6 +91,9 @@ static bool_t ktpd_session_read_cb(faux_async_t *async,
 	faux_buf_t *buf, size_t len, void *user_data);
 static bool_t wait_for_actions_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data);
+static bool_t workers_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data);
+static bool_t ktpd_session_check_exec(ktpd_session_t *ktpd);
 bool_t client_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data);
 static bool_t ktpd_session_log(ktpd_session_t *ktpd, const kexec_t *exec);
@@ -66,10 +106,26 @@ static bool_t action_stderr_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data);
 static bool_t get_stream(ktpd_session_t *ktpd, int fd, bool_t is_stderr,
 	bool_t process_all_data);
-
-
-ktpd_session_t *ktpd_session_new(int sock, kscheme_t *scheme,
-	const char *start_entry, faux_eloop_t *eloop)
+static void ktpd_session_drop_completion(ktpd_session_t *ktpd);
+static void stream_flush(ktpd_session_t *ktpd);
+static bool_t ktpd_session_queue_cmd(ktpd_session_t *ktpd,
+	const faux_msg_t *msg);
+static bool_t ktpd_session_process_completion(ktpd_session_t *ktpd,
+	faux_msg_t *msg);
+static bool_t ktpd_session_process_help(ktpd_session_t *ktpd,
+	faux_msg_t *msg);
+static bool_t ktpd_session_process_resumable(ktpd_session_t *ktpd,
+	const faux_msg_t *msg);
+static bool_t ktpd_session_resume(ktpd_session_t *ktpd);
+static void ktpd_session_run_queue(ktpd_session_t *ktpd);
+static bool_t ktpd_session_stop(ktpd_session_t *ktpd);
+static void ktpd_session_reap(ktpd_session_t *ktpd, pid_t pid, int wstatus);
+static void ktpd_session_watch_feed(ktpd_session_t *ktpd);
+
+
+static ktpd_session_t *ktpd_session_create(int sock, kscheme_t *scheme,
+	const char *start_entry, faux_eloop_t *eloop,
+	ktpd_session_close_cb_fn close_cb, void *close_udata)
 {
 	ktpd_session_t *ktpd = NULL;
 
@@ -92,6 +148,14 @@ ktpd_session_t *ktpd_session_new(int sock, kscheme_t *scheme,
 		return NULL;
 	}
 	ktpd->exec = NULL;
+	ktpd->cmd_queue = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, (void (*)(void *))faux_msg_free);
+	ktpd->cmd_req_id = 0;
+	ktpd->cmd_stop_on_error = BOOL_FALSE;
+	ktpd->cmd_skip = BOOL_FALSE;
+	ktpd->local_req = NULL;
+	ktpd->local_fd = -1;
+	ktpd->feed_fd = -1;
 	// Client can send command to close stdin but it can't be done
 	// immediately because stdin buffer can still contain data. So really
 	// close stdin after all data is written.
@@ -102,6 +166,17 @@ ktpd_session_t *ktpd_session_new(int sock, kscheme_t *scheme,
 	// function must use ksession done flag. This exit flag is internal
 	// feature of KTPD session.
 	ktpd->exit = BOOL_FALSE;
+	ktpd->close_cb = close_cb;
+	ktpd->close_udata = close_udata;
+	ktpd->compl_split = NULL;
+	ktpd->compl_pargv = NULL;
+	ktpd->compl_path = NULL;
+	ktpd->compl_scheme = NULL;
+	ktpd->coalesce_bytes = 0; // Off by default
+	ktpd->coalesce_ev = NULL;
+	ktpd->stream_frames = 0;
+	ktpd->stream_bytes = 0;
+	ktpd->stream_saved_frames = 0;
 
 	// Async object
 	ktpd->async = faux_async_new(sock);
@@ -116,16 +191,51 @@ ktpd_session_t *ktpd_session_new(int sock, kscheme_t *scheme,
 	// Eloop callbacks
 	faux_eloop_add_fd(ktpd->eloop, ktpd_session_fd(ktpd), POLLIN,
 		client_ev, ktpd);
-	faux_eloop_add_signal(ktpd->eloop, SIGCHLD, wait_for_actions_ev, ktpd);
+	if (!ktpd->close_cb)
+		faux_eloop_add_signal(ktpd->eloop, SIGCHLD,
+			wait_for_actions_ev, ktpd);
 
 	return ktpd;
 }
 
 
+/** @brief Creates session that owns the eloop.
+ *
+ * The eloop is stopped when session is finished.
+ */
+ktpd_session_t *ktpd_session_new(int sock, kscheme_t *scheme,
+	const char *start_entry, faux_eloop_t *eloop)
+{
+	return ktpd_session_create(sock, scheme, start_entry, eloop,
+		NULL, NULL);
+}
+
+
+/** @brief Creates session that shares the eloop with other sessions.
+ *
+ * Finished session doesn't stop eloop but executes close_cb. The callback
+ * must not free session immediately because session's eloop handler is in
+ * progress. The owner waits for terminated child processes itself and passes
+ * them to ktpd_session_child_exited() of each session.
+ */
+ktpd_session_t *ktpd_session_new_shared(int sock, kscheme_t *scheme,
+	const char *start_entry, faux_eloop_t *eloop,
+	ktpd_session_close_cb_fn close_cb, void *user_data)
+{
+	assert(close_cb);
+	if (!close_cb)
+		return NULL;
+
+	return ktpd_session_create(sock, scheme, start_entry, eloop,
+		close_cb, user_data);
+}
+
+
 void ktpd_session_free(ktpd_session_t *ktpd)
 {
 	kcontext_t *context = NULL;
 	kscheme_t *scheme = NULL;
+	char *stats = NULL;
 
 	if (!ktpd)
 		return;
@@ -138,9 +248,36 @@ void ktpd_session_free(ktpd_session_t *ktpd)
 		kcontext_set_scheme(context, scheme);
 		kscheme_fini_session_plugins(scheme, context, NULL);
 		kcontext_free(context);
+		stats = kptcache_stats(ksession_ptcache(ktpd->session));
+		syslog(LOG_INFO, "PTYPE cache: %s", stats);
+		faux_str_free(stats);
+		syslog(LOG_DEBUG, "Output: %zu frames, %zu bytes, "
+			"coalescing saved %zu frames, %zu bytes",
+			ktpd->stream_frames, ktpd->stream_bytes,
+			ktpd->stream_saved_frames,
+			ktpd->stream_saved_frames * KTP_STREAM_HDR_LEN);
 	}
 
+	ktpd_session_drop_completion(ktpd);
+	if (ktpd->coalesce_ev)
+		faux_eloop_del_sched(ktpd->eloop, ktpd->coalesce_ev);
+	// Eloop can be shared with other sessions so remove own handlers
+	faux_eloop_del_fd(ktpd->eloop, ktpd_session_fd(ktpd));
+	if (ktpd->exec) {
+		faux_eloop_del_fd(ktpd->eloop, kexec_stdin(ktpd->exec));
+		faux_eloop_del_fd(ktpd->eloop, kexec_stdout(ktpd->exec));
+		faux_eloop_del_fd(ktpd->eloop, kexec_stderr(ktpd->exec));
+	}
+	if (ktpd->feed_fd >= 0)
+		faux_eloop_del_fd(ktpd->eloop, ktpd->feed_fd);
 	kexec_free(ktpd->exec);
+	faux_list_free(ktpd->cmd_queue);
+	if (ktpd->local_fd >= 0)
+		faux_eloop_del_fd(ktpd->eloop, ktpd->local_fd);
+	faux_msg_free(ktpd->local_req);
+	if (ksession_workers(ktpd->session))
+		faux_eloop_del_fd(ktpd->eloop,
+			kworkers_fd(ksession_workers(ktpd->session)));
 	ksession_free(ktpd->session);
 	faux_free(ktpd->hdr);
 	close(ktpd_session_fd(ktpd));
@@ -397,6 +534,26 @@ static bool_t ktpd_session_process_cmd(ktpd_session_t *ktpd, faux_msg_t *msg)
 	assert(ktpd);
 	assert(msg);
 
+	// ACKs of the command will contain the same request id. So client
+	// can match answers and pipelined requests.
+	ktpd->cmd_req_id = faux_msg_get_req_id(msg);
+	ktpd->cmd_stop_on_error = KTP_STATUS_IS_STOP_ON_ERROR(
+		faux_msg_get_status(msg)) ? BOOL_TRUE : BOOL_FALSE;
+	// Previous stop-on-error command has failed. So the rest of
+	// stop-on-error commands (queued or still in flight) are skipped.
+	// Command without such flag finishes skipping.
+	if (!ktpd->cmd_stop_on_error)
+		ktpd->cmd_skip = BOOL_FALSE;
+	if (ktpd->cmd_skip) {
+		const char *err = "Skipped due to previous error";
+		ack = ktp_msg_preform(cmd, KTP_STATUS_ERROR);
+		faux_msg_set_req_id(ack, ktpd->cmd_req_id);
+		faux_msg_add_param(ack, KTP_PARAM_ERROR, err, strlen(err));
+		faux_msg_send_async(ack, ktpd->async);
+		faux_msg_free(ack);
+		return BOOL_FALSE;
+	}
+
 	// Get line from message
 	line = faux_msg_get_str_param_by_type(msg, KTP_PARAM_LINE);
 	if (!line_has_content(line)) {
@@ -404,6 +561,7 @@ static bool_t ktpd_session_process_cmd(ktpd_session_t *ktpd, faux_msg_t *msg)
 		// Line is not specified. User sent empty command.
 		// It's not bug. Send OK to user and regenerate prompt
 		ack = ktp_msg_preform(cmd, KTP_STATUS_NONE);
+		faux_msg_set_req_id(ack, ktpd->cmd_req_id);
 		// Generate prompt
 		prompt = generate_prompt(ktpd);
 		if (prompt) {
@@ -426,6 +584,12 @@ static bool_t ktpd_session_process_cmd(ktpd_session_t *ktpd, faux_msg_t *msg)
 		dry_run, &view_was_changed);
 	faux_str_free(line);
 
+	// Parsing is suspended. Command will be processed again.
+	if (kjournal_pending(ksession_journal(ktpd->session))) {
+		faux_error_free(error);
+		return BOOL_TRUE;
+	}
+
 	// Command is scheduled. Eloop will wait for ACTION completion.
 	// So inform client about it and about command features like
 	// interactive/non-interactive.
@@ -437,6 +601,7 @@ static bool_t ktpd_session_process_cmd(ktpd_session_t *ktpd, faux_msg_t *msg)
 		if (kexec_need_stdin(ktpd->exec))
 			status |= KTP_STATUS_NEED_STDIN;
 		ack = ktp_msg_preform(cmd, status);
+		faux_msg_set_req_id(ack, ktpd->cmd_req_id);
 		faux_msg_send_async(ack, ktpd->async);
 		faux_msg_free(ack);
 		faux_error_free(error);
@@ -451,15 +616,20 @@ static bool_t ktpd_session_process_cmd(ktpd_session_t *ktpd, faux_msg_t *msg)
 
 	// Prepare ACK message
 	ack = ktp_msg_preform(cmd, status);
+	faux_msg_set_req_id(ack, ktpd->cmd_req_id);
 	if (rc) {
 		uint8_t retcode8bit = 0;
 		retcode8bit = (uint8_t)(retcode & 0xff);
 		faux_msg_add_param(ack, KTP_PARAM_RETCODE, &retcode8bit, 1);
+		if ((retcode != 0) && ktpd->cmd_stop_on_error)
+			ktpd->cmd_skip = BOOL_TRUE;
 	} else {
 		faux_msg_set_status(ack, KTP_STATUS_ERROR);
 		char *err = faux_error_cstr(error);
 		faux_msg_add_param(ack, KTP_PARAM_ERROR, err, strlen(err));
 		faux_str_free(err);
+		if (ktpd->cmd_stop_on_error)
+			ktpd->cmd_skip = BOOL_TRUE;
 		ret = BOOL_FALSE;
 	}
 	// Generate prompt
@@ -501,8 +671,24 @@ static bool_t ktpd_session_exec(ktpd_session_t *ktpd, const char *line,
 		return BOOL_TRUE;
 	}
 
-	// Parsing
+	// Command can change anything so previous completion results can be
+	// out of date
+	ktpd_session_drop_completion(ktpd);
+
+	// Refill pool of workers used by previous commands. Workers close
+	// inherited descriptors so they don't hold pipes of ACTIONs executed
+	// by other sessions of the process.
+	if (ksession_workers(ktpd->session))
+		kworkers_fill(ksession_workers(ktpd->session));
+
+	// Parsing. Service ACTIONs (PTYPEs etc.) executed while parsing don't
+	// block the eloop. Parsing is suspended instead.
+	kjournal_begin(ksession_journal(ktpd->session));
 	exec = ksession_parse_for_exec(ktpd->session, line, error);
+	if (kjournal_end(ksession_journal(ktpd->session))) {
+		kexec_free(exec);
+		return BOOL_FALSE;
+	}
 	if (!exec)
 		return BOOL_FALSE;
 
@@ -524,6 +710,11 @@ static bool_t ktpd_session_exec(ktpd_session_t *ktpd, const char *line,
 	// If kexec contains only non-exec (for example dry-run) ACTIONs then
 	// we don't need event loop and can return here.
 	if (kexec_retcode(exec, retcode)) {
+		// Sync ACTIONs leave their output within kexec's buffers
+		ktpd->exec = exec;
+		get_stream(ktpd, kexec_stdout(exec), BOOL_FALSE, BOOL_TRUE);
+		get_stream(ktpd, kexec_stderr(exec), BOOL_TRUE, BOOL_TRUE);
+		ktpd->exec = NULL;
 		if (view_was_changed_p)
 			*view_was_changed_p = !kpath_is_equal(
 				ksession_path(ktpd->session),
@@ -548,6 +739,11 @@ static bool_t ktpd_session_exec(ktpd_session_t *ktpd, const char *line,
 	faux_eloop_include_fd_event(ktpd->eloop, kexec_stdout(exec), POLLIN);
 	faux_eloop_include_fd_event(ktpd->eloop, kexec_stderr(exec), POLLIN);
 
+	// Send output of already executed sync ACTIONs
+	get_stream(ktpd, kexec_stdout(exec), BOOL_FALSE, BOOL_FALSE);
+	get_stream(ktpd, kexec_stderr(exec), BOOL_TRUE, BOOL_FALSE);
+	ktpd_session_watch_feed(ktpd);
+
 	return BOOL_TRUE;
 }
 
@@ -558,29 +754,173 @@ static bool_t wait_for_actions_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	int wstatus = 0;
 	pid_t child_pid = -1;
 	ktpd_session_t *ktpd = (ktpd_session_t *)user_data;
-	int retcode = -1;
-	uint8_t retcode8bit = 0;
-	faux_msg_t *ack = NULL;
-	ktp_cmd_e cmd = KTP_CMD_ACK;
-	uint32_t status = KTP_STATUS_NONE;
-	char *prompt = NULL;
-	bool_t view_was_changed = BOOL_FALSE;
 
 	if (!ktpd)
 		return BOOL_FALSE;
 
 	// Wait for any child process. Doesn't block.
-	while ((child_pid = waitpid(-1, &wstatus, WNOHANG)) > 0) {
+	while ((child_pid = waitpid(-1, &wstatus, WNOHANG)) > 0)
+		ktpd_session_reap(ktpd, child_pid, wstatus);
+
+	// Happy compiler
+	eloop = eloop;
+	type = type;
+	associated_data = associated_data;
+
+	if (!ktpd_session_resume(ktpd))
+		return BOOL_FALSE;
+
+	return ktpd_session_check_exec(ktpd);
+}
+
+
+static void ktpd_session_reap(ktpd_session_t *ktpd, pid_t pid, int wstatus)
+{
+	// Terminated process can be an action worker
+	if (ksession_workers(ktpd->session))
+		kworkers_del(ksession_workers(ktpd->session), pid);
+	// Foreign PID is ignored
+	if (ktpd->exec)
+		kexec_continue_command_execution(ktpd->exec, pid, wstatus);
+	// Service ACTION of suspended request. Its kexec is freed when
+	// completed.
+	if (ksession_continue_locally(ktpd->session, pid, wstatus) &&
+		(ktpd->local_fd >= 0)) {
+		faux_eloop_del_fd(ktpd->eloop, ktpd->local_fd);
+		ktpd->local_fd = -1;
+	}
+}
+
+
+/** @brief Passes terminated child process to shared session.
+ *
+ * The PID can belong to another session. Then it's ignored.
+ */
+bool_t ktpd_session_child_exited(ktpd_session_t *ktpd, pid_t pid,
+	int wstatus)
+{
+	assert(ktpd);
+	if (!ktpd)
+		return BOOL_FALSE;
+
+	ktpd_session_reap(ktpd, pid, wstatus);
+	if (!ktpd_session_resume(ktpd))
+		return BOOL_FALSE;
+
+	return ktpd_session_check_exec(ktpd);
+}
+
+
+// Session is finished. Standalone session stops the eloop. Shared session
+// informs the owner and other sessions continue to work.
+static bool_t ktpd_session_stop(ktpd_session_t *ktpd)
+{
+	if (!ktpd->close_cb)
+		return BOOL_FALSE;
+
+	if (KTPD_SESSION_STATE_DISCONNECTED == ktpd->state)
+		return BOOL_TRUE; // Already closed
+	ktpd->state = KTPD_SESSION_STATE_DISCONNECTED;
+	faux_eloop_del_fd(ktpd->eloop, ktpd_session_fd(ktpd));
+	ktpd->close_cb(ktpd, ktpd->close_udata);
+
+	return BOOL_TRUE;
+}
+
+
+// Action workers report completed ACTIONs
+static bool_t workers_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	pid_t pid = -1;
+	int wstatus = 0;
+	ktpd_session_t *ktpd = (ktpd_session_t *)user_data;
+	kworkers_t *workers = NULL;
+
+	if (!ktpd)
+		return BOOL_FALSE;
+
+	workers = ksession_workers(ktpd->session);
+	while (workers && kworkers_reap(workers, &pid, &wstatus)) {
 		if (ktpd->exec)
-			kexec_continue_command_execution(ktpd->exec, child_pid,
+			kexec_continue_command_execution(ktpd->exec, pid,
 				wstatus);
 	}
+
+	// Happy compiler
+	eloop = eloop;
+	type = type;
+	associated_data = associated_data;
+
+	return ktpd_session_check_exec(ktpd);
+}
+
+
+// Destination of queued output of sync ACTION is ready
+static bool_t action_feed_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	ktpd_session_t *ktpd = (ktpd_session_t *)user_data;
+
+	if (!ktpd)
+		return BOOL_FALSE;
+
+	if (ktpd->exec)
+		kexec_feed(ktpd->exec);
+
+	// Happy compiler
+	eloop = eloop;
+	type = type;
+	associated_data = associated_data;
+
+	return ktpd_session_check_exec(ktpd);
+}
+
+
+// Queued output of sync ACTION can appear or disappear on any kexec event.
+// Watch for the current destination.
+static void ktpd_session_watch_feed(ktpd_session_t *ktpd)
+{
+	int fd = -1;
+
+	if (ktpd->exec)
+		fd = kexec_feed_fd(ktpd->exec);
+	if (fd == ktpd->feed_fd)
+		return;
+
+	if (ktpd->feed_fd >= 0)
+		faux_eloop_del_fd(ktpd->eloop, ktpd->feed_fd);
+	ktpd->feed_fd = fd;
+	if (fd >= 0)
+		faux_eloop_add_fd(ktpd->eloop, fd, POLLOUT,
+			action_feed_ev, ktpd);
+}
+
+
+// Finish command if all its ACTIONs are done
+static bool_t ktpd_session_check_exec(ktpd_session_t *ktpd)
+{
+	int retcode = -1;
+	uint8_t retcode8bit = 0;
+	faux_msg_t *ack = NULL;
+	ktp_cmd_e cmd = KTP_CMD_ACK;
+	uint32_t status = KTP_STATUS_NONE;
+	char *prompt = NULL;
+	bool_t view_was_changed = BOOL_FALSE;
+	faux_eloop_t *eloop = ktpd->eloop;
+
+	ktpd_session_watch_feed(ktpd);
 	if (!ktpd->exec)
 		return BOOL_TRUE;
 
 	// Check if kexec is done now
-	if (!kexec_retcode(ktpd->exec, &retcode))
+	if (!kexec_retcode(ktpd->exec, &retcode)) {
+		// Sync ACTIONs started by finished ones leave their output
+		// within kexec's buffers. Don't wait for the next fd event.
+		get_stream(ktpd, kexec_stdout(ktpd->exec), BOOL_FALSE, BOOL_FALSE);
+		get_stream(ktpd, kexec_stderr(ktpd->exec), BOOL_TRUE, BOOL_FALSE);
 		return BOOL_TRUE; // Continue
+	}
 
 	// Sometimes SIGCHILD signal can appear before all data were really read
 	// from process stdout buffer. So read the least data before closing
@@ -598,6 +938,8 @@ static bool_t wait_for_actions_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	kexec_free(ktpd->exec);
 	ktpd->exec = NULL;
 	ktpd->state = KTPD_SESSION_STATE_IDLE;
+	// All output is flushed above. Cancel scheduled flush.
+	stream_flush(ktpd);
 
 	// All kexec_t actions are done so can break the loop if needed.
 	if (ksession_done(ktpd->session)) {
@@ -605,8 +947,12 @@ static bool_t wait_for_actions_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 		status |= KTP_STATUS_EXIT; // Notify client about exiting
 	}
 
+	if ((retcode != 0) && ktpd->cmd_stop_on_error)
+		ktpd->cmd_skip = BOOL_TRUE;
+
 	// Send ACK message
 	ack = ktp_msg_preform(cmd, status);
+	faux_msg_set_req_id(ack, ktpd->cmd_req_id);
 	retcode8bit = (uint8_t)(retcode & 0xff);
 	faux_msg_add_param(ack, KTP_PARAM_RETCODE, &retcode8bit, 1);
 	// Generate prompt
@@ -621,16 +967,142 @@ static bool_t wait_for_actions_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	faux_msg_send_async(ack, ktpd->async);
 	faux_msg_free(ack);
 
-	type = type; // Happy compiler
-	associated_data = associated_data; // Happy compiler
+	// Execute pipelined commands
+	ktpd_session_run_queue(ktpd);
 
 	if (ktpd->exit)
+		return ktpd_session_stop(ktpd);
+
+	return BOOL_TRUE;
+}
+
+
+// Message is freed by caller so copy fields that are used by request
+// processing functions.
+static faux_msg_t *ktpd_session_copy_req(const faux_msg_t *msg)
+{
+	faux_msg_t *req = NULL;
+	char *line = NULL;
+	uint32_t line_len = 0;
+
+	req = ktp_msg_preform(faux_msg_get_cmd(msg), faux_msg_get_status(msg));
+	faux_msg_set_req_id(req, faux_msg_get_req_id(msg));
+	if (faux_msg_get_param_by_type(msg, KTP_PARAM_LINE,
+		(void **)&line, &line_len))
+		faux_msg_add_param(req, KTP_PARAM_LINE, line, line_len);
+
+	return req;
+}
+
+
+// Save pipelined command to execute it later
+static bool_t ktpd_session_queue_cmd(ktpd_session_t *ktpd,
+	const faux_msg_t *msg)
+{
+	faux_list_add(ktpd->cmd_queue, ktpd_session_copy_req(msg));
+
+	return BOOL_TRUE;
+}
+
+
+// Output of service ACTION must be read to don't block it
+static bool_t local_stdout_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	ktpd_session_t *ktpd = (ktpd_session_t *)user_data;
+
+	ksession_read_locally(ktpd->session);
+
+	// Happy compiler
+	eloop = eloop;
+	type = type;
+	associated_data = associated_data;
+
+	return BOOL_TRUE;
+}
+
+
+// Processes request that can execute service ACTIONs. If service ACTION is
+// not completed immediately the request is suspended. It will be processed
+// again from the beginning by ktpd_session_resume(). Results of already
+// executed service ACTIONs are taken from session's journal.
+static bool_t ktpd_session_process_resumable(ktpd_session_t *ktpd,
+	const faux_msg_t *msg)
+{
+	kexec_t *pending = NULL;
+	bool_t rc = BOOL_FALSE;
+
+	switch (faux_msg_get_cmd(msg)) {
+	case KTP_CMD:
+		rc = ktpd_session_process_cmd(ktpd, (faux_msg_t *)msg);
+		break;
+	case KTP_COMPLETION:
+		rc = ktpd_session_process_completion(ktpd, (faux_msg_t *)msg);
+		break;
+	case KTP_HELP:
+		rc = ktpd_session_process_help(ktpd, (faux_msg_t *)msg);
+		break;
+	default:
 		return BOOL_FALSE;
+	}
+
+	pending = kjournal_pending(ksession_journal(ktpd->session));
+	if (!pending)
+		return rc;
+
+	ktpd->local_req = ktpd_session_copy_req(msg);
+	ktpd->local_fd = kexec_stdout(pending);
+	faux_eloop_add_fd(ktpd->eloop, ktpd->local_fd, POLLIN,
+		local_stdout_ev, ktpd);
+	ktpd->state = KTPD_SESSION_STATE_WAIT_FOR_LOCAL;
+
+	return BOOL_TRUE;
+}
+
+
+// Process suspended request again if its service ACTION is completed
+static bool_t ktpd_session_resume(ktpd_session_t *ktpd)
+{
+	faux_msg_t *msg = NULL;
+
+	if (ktpd->state != KTPD_SESSION_STATE_WAIT_FOR_LOCAL)
+		return BOOL_TRUE;
+	if (kjournal_pending(ksession_journal(ktpd->session)))
+		return BOOL_TRUE; // Still waiting
+
+	msg = ktpd->local_req;
+	ktpd->local_req = NULL;
+	ktpd->state = KTPD_SESSION_STATE_IDLE;
+	ktpd_session_process_resumable(ktpd, msg);
+	faux_msg_free(msg);
+
+	// Execute pipelined commands
+	ktpd_session_run_queue(ktpd);
+
+	if (ktpd->exit)
+		return ktpd_session_stop(ktpd);
 
 	return BOOL_TRUE;
 }
 
 
+// Execute commands that were received while previous command was in
+// progress. Stop when the next command needs eloop to wait for ACTIONs or
+// it's suspended.
+static void ktpd_session_run_queue(ktpd_session_t *ktpd)
+{
+	faux_list_node_t *node = NULL;
+
+	while (!ktpd->exit && (KTPD_SESSION_STATE_IDLE == ktpd->state) &&
+		(node = faux_list_head(ktpd->cmd_queue))) {
+		faux_msg_t *msg = (faux_msg_t *)faux_list_takeaway(
+			ktpd->cmd_queue, node);
+		ktpd_session_process_resumable(ktpd, msg);
+		faux_msg_free(msg);
+	}
+}
+
+
 static bool_t ktpd_session_log(ktpd_session_t *ktpd, const kexec_t *exec)
 {
 	kexec_contexts_node_t *iter = NULL;
@@ -675,6 +1147,151 @@ static int compl_kcompare(const void *key, const void *list_item)
 }
 
 
+static void ktpd_session_drop_completion(ktpd_session_t *ktpd)
+{
+	faux_list_free(ktpd->compl_split);
+	ktpd->compl_split = NULL;
+	kpargv_free(ktpd->compl_pargv);
+	ktpd->compl_pargv = NULL;
+	kpath_free(ktpd->compl_path);
+	ktpd->compl_path = NULL;
+	ktpd->compl_scheme = NULL;
+}
+
+
+static bool_t argv_is_equal(const faux_argv_t *f, const faux_argv_t *s)
+{
+	faux_argv_node_t *f_iter = faux_argv_iter(f);
+	faux_argv_node_t *s_iter = faux_argv_iter(s);
+	const char *f_arg = NULL;
+	const char *s_arg = NULL;
+
+	if (faux_argv_is_continuable(f) != faux_argv_is_continuable(s))
+		return BOOL_FALSE;
+
+	do {
+		f_arg = faux_argv_each(&f_iter);
+		s_arg = faux_argv_each(&s_iter);
+		if (!f_arg || !s_arg)
+			break;
+		if (strcmp(f_arg, s_arg) != 0)
+			return BOOL_FALSE;
+	} while (BOOL_TRUE);
+
+	return (!f_arg && !s_arg) ? BOOL_TRUE : BOOL_FALSE;
+}
+
+
+// First argument is complete if user types the next ones already
+static const char *argv_complete_first(const faux_argv_t *argv)
+{
+	ssize_t len = faux_argv_len((faux_argv_t *)argv);
+
+	if (len < 1)
+		return NULL;
+	if ((1 == len) && faux_argv_is_continuable(argv))
+		return NULL;
+
+	return faux_argv_index(argv, 0);
+}
+
+
+// Previous parsing of last stage tried path levels from higher to lower
+// ones. The levels higher than the level where the first argument was
+// resolved can't resolve the same complete first argument. So parsing of
+// extended stage starts from this level.
+static size_t ktpd_session_stable_level(const kpargv_t *pargv,
+	const faux_argv_t *argv, const faux_argv_t *old_argv)
+{
+	const char *first = NULL;
+	const char *old_first = NULL;
+
+	if (kpargv_pargs_len(pargv) < 1)
+		return KSESSION_LEVEL_ANY;
+	first = argv_complete_first(argv);
+	old_first = argv_complete_first(old_argv);
+	if (!first || !old_first || (strcmp(first, old_first) != 0))
+		return KSESSION_LEVEL_ANY;
+
+	return kpargv_level(pargv);
+}
+
+
+// Parse line for completion or help. The pargv is owned by ktpd session so
+// don't free it. The previous result is reused if line is the same and
+// pipeline stages (except last one) are not parsed again if they are the
+// same as previous ones. Parsing of changed last stage resumes from the
+// path level where its first argument was resolved previously. Any path
+// or scheme change leads to full parsing.
+static kpargv_t *ktpd_session_parse_for_completion(ktpd_session_t *ktpd,
+	const char *line)
+{
+	faux_list_t *split = NULL;
+	faux_list_node_t *iter = NULL;
+	faux_list_node_t *old_iter = NULL;
+	size_t checked_stages = 0;
+	size_t last_level = KSESSION_LEVEL_ANY;
+	bool_t same_line = BOOL_FALSE;
+
+	split = ksession_split_pipes(line, NULL);
+	if (!split || (faux_list_len(split) < 1)) {
+		faux_list_free(split);
+		return NULL;
+	}
+
+	// Find out how many stages are the same as previous ones
+	if (ktpd->compl_pargv &&
+		(ktpd->compl_scheme == ksession_scheme(ktpd->session)) &&
+		kpath_is_equal(ktpd->compl_path, ksession_path(ktpd->session))) {
+		iter = faux_list_head(split);
+		old_iter = faux_list_head(ktpd->compl_split);
+		while (iter && old_iter) {
+			if (!argv_is_equal(faux_list_data(iter),
+				faux_list_data(old_iter)))
+				break;
+			iter = faux_list_next_node(iter);
+			old_iter = faux_list_next_node(old_iter);
+			// Old last stage was parsed for completion only
+			if (old_iter)
+				checked_stages++;
+		}
+		same_line = (!iter && !old_iter);
+		// Only last stage is changed
+		if (iter && old_iter && !faux_list_next_node(iter) &&
+			!faux_list_next_node(old_iter))
+			last_level = ktpd_session_stable_level(
+				ktpd->compl_pargv, faux_list_data(iter),
+				faux_list_data(old_iter));
+	}
+
+	if (same_line) {
+		faux_list_free(split);
+		kpargv_set_candidate_parg(ktpd->compl_pargv, NULL);
+		return ktpd->compl_pargv;
+	}
+
+	// Parsing can be suspended. Don't keep the result of unfinished
+	// parsing. Note the reused result doesn't need journal at all.
+	kpargv_free(ktpd->compl_pargv);
+	kjournal_begin(ksession_journal(ktpd->session));
+	ktpd->compl_pargv = ksession_parse_for_completion_ext(ktpd->session,
+		split, checked_stages, last_level);
+	if (kjournal_end(ksession_journal(ktpd->session))) {
+		kpargv_free(ktpd->compl_pargv);
+		ktpd->compl_pargv = NULL;
+	}
+	faux_list_free(ktpd->compl_split);
+	ktpd->compl_split = split;
+	kpath_free(ktpd->compl_path);
+	ktpd->compl_path = kpath_clone(ksession_path(ktpd->session));
+	ktpd->compl_scheme = ksession_scheme(ktpd->session);
+	if (!ktpd->compl_pargv)
+		ktpd_session_drop_completion(ktpd);
+
+	return ktpd->compl_pargv;
+}
+
+
 static bool_t ktpd_session_process_completion(ktpd_session_t *ktpd, faux_msg_t *msg)
 {
 	char *line = NULL;
@@ -694,10 +1311,13 @@ static bool_t ktpd_session_process_completion(ktpd_session_t *ktpd, faux_msg_t *
 		return BOOL_FALSE;
 	}
 
-	// Parsing
-	pargv = ksession_parse_for_completion(ktpd->session, line);
+	// Parsing. The pargv is owned by ktpd session.
+	pargv = ktpd_session_parse_for_completion(ktpd, line);
 	faux_str_free(line);
 	if (!pargv) {
+		// Suspended. Will be processed again.
+		if (kjournal_pending(ksession_journal(ktpd->session)))
+			return BOOL_TRUE;
 		ktp_send_error(ktpd->async, cmd, NULL);
 		return BOOL_FALSE;
 	}
@@ -718,7 +1338,9 @@ static bool_t ktpd_session_process_completion(ktpd_session_t *ktpd, faux_msg_t *
 		faux_msg_add_param(ack, KTP_PARAM_PREFIX, prefix, prefix_len);
 	}
 
-	// Fill msg with possible completions
+	// Fill msg with possible completions. Completion ACTIONs can suspend
+	// the request.
+	kjournal_begin(ksession_journal(ktpd->session));
 	if (!kpargv_completions_is_empty(pargv)) {
 		const kentry_t *candidate = NULL;
 		kpargv_completions_node_t *citer = kpargv_completions_iter(pargv);
@@ -789,11 +1411,17 @@ static bool_t ktpd_session_process_completion(ktpd_session_t *ktpd, faux_msg_t *
 		}
 		faux_list_free(completions);
 	}
+	if (kjournal_end(ksession_journal(ktpd->session))) {
+		faux_msg_free(ack);
+		kpargv_set_candidate_parg(pargv, NULL);
+		return BOOL_TRUE;
+	}
 
 	faux_msg_send_async(ack, ktpd->async);
 	faux_msg_free(ack);
 
-	kpargv_free(pargv);
+	// Don't free pargv. It's owned by ktpd session and can be reused.
+	kpargv_set_candidate_parg(pargv, NULL);
 
 	return BOOL_TRUE;
 }
@@ -842,10 +1470,13 @@ static bool_t ktpd_session_process_help(ktpd_session_t *ktpd, faux_msg_t *msg)
 		return BOOL_FALSE;
 	}
 
-	// Parsing
-	pargv = ksession_parse_for_completion(ktpd->session, line);
+	// Parsing. The pargv is owned by ktpd session.
+	pargv = ktpd_session_parse_for_completion(ktpd, line);
 	faux_str_free(line);
 	if (!pargv) {
+		// Suspended. Will be processed again.
+		if (kjournal_pending(ksession_journal(ktpd->session)))
+			return BOOL_TRUE;
 		ktp_send_error(ktpd->async, cmd, NULL);
 		return BOOL_FALSE;
 	}
@@ -861,7 +1492,9 @@ static bool_t ktpd_session_process_help(ktpd_session_t *ktpd, faux_msg_t *msg)
 	// Last unfinished word. Common prefix for all entries
 	prefix = kpargv_last_arg(pargv);
 
-	// Fill msg with possible help messages
+	// Fill msg with possible help messages. Help ACTIONs can suspend the
+	// request.
+	kjournal_begin(ksession_journal(ktpd->session));
 	if (!kpargv_completions_is_empty(pargv)) {
 		const kentry_t *candidate = NULL;
 		kpargv_completions_node_t *citer = kpargv_completions_iter(pargv);
@@ -962,11 +1595,17 @@ static bool_t ktpd_session_process_help(ktpd_session_t *ktpd, faux_msg_t *msg)
 		}
 		faux_list_free(help_list);
 	}
+	if (kjournal_end(ksession_journal(ktpd->session))) {
+		faux_msg_free(ack);
+		kpargv_set_candidate_parg(pargv, NULL);
+		return BOOL_TRUE;
+	}
 
 	faux_msg_send_async(ack, ktpd->async);
 	faux_msg_free(ack);
 
-	kpargv_free(pargv);
+	// Don't free pargv. It's owned by ktpd session and can be reused.
+	kpargv_set_candidate_parg(pargv, NULL);
 
 	return BOOL_TRUE;
 }
@@ -1205,6 +1844,7 @@ static bool_t ktpd_session_process_stdout_close(ktpd_session_t *ktpd,
 	// Remove already generated data from out buffer. This data is not
 	// needed now
 	faux_buf_empty(kexec_bufout(ktpd->exec));
+	faux_buf_empty(kexec_bufraw(ktpd->exec));
 
 	return BOOL_TRUE;
 }
@@ -1257,12 +1897,19 @@ static bool_t ktpd_session_dispatch(ktpd_session_t *ktpd, faux_msg_t *msg)
 		ktpd_session_process_auth(ktpd, msg);
 		break;
 	case KTP_CMD:
+		// Pipelined command. Execute it later
+		if (((ktpd->state == KTPD_SESSION_STATE_WAIT_FOR_PROCESS) ||
+			(ktpd->state == KTPD_SESSION_STATE_WAIT_FOR_LOCAL)) &&
+			(faux_list_len(ktpd->cmd_queue) < CMD_QUEUE_LIMIT)) {
+			ktpd_session_queue_cmd(ktpd, msg);
+			break;
+		}
 		if (ktpd->state != KTPD_SESSION_STATE_IDLE) {
 			ecmd = KTP_CMD_ACK;
 			err = "Server illegal state for command execution";
 			break;
 		}
-		ktpd_session_process_cmd(ktpd, msg);
+		ktpd_session_process_resumable(ktpd, msg);
 		break;
 	case KTP_COMPLETION:
 		if (ktpd->state != KTPD_SESSION_STATE_IDLE) {
@@ -1270,7 +1917,7 @@ static bool_t ktpd_session_dispatch(ktpd_session_t *ktpd, faux_msg_t *msg)
 			err = "Server illegal state for completion";
 			break;
 		}
-		ktpd_session_process_completion(ktpd, msg);
+		ktpd_session_process_resumable(ktpd, msg);
 		break;
 	case KTP_HELP:
 		if (ktpd->state != KTPD_SESSION_STATE_IDLE) {
@@ -1278,7 +1925,7 @@ static bool_t ktpd_session_dispatch(ktpd_session_t *ktpd, faux_msg_t *msg)
 			err = "Server illegal state for help";
 			break;
 		}
-		ktpd_session_process_help(ktpd, msg);
+		ktpd_session_process_resumable(ktpd, msg);
 		break;
 	case KTP_STDIN:
 		if (ktpd->state != KTPD_SESSION_STATE_WAIT_FOR_PROCESS) {
@@ -1415,54 +2062,356 @@ int ktpd_session_fd(const ktpd_session_t *ktpd)
 }
 
 
+/** @brief Enables pool of pre-forked action workers.
+ *
+ * By default each async ACTION is executed within its own forked process.
+ */
+bool_t ktpd_session_set_workers(ktpd_session_t *ktpd, size_t size,
+	unsigned int idle_timeout)
+{
+	kworkers_t *workers = NULL;
+
+	assert(ktpd);
+	if (!ktpd)
+		return BOOL_FALSE;
+
+	workers = kworkers_new(size, idle_timeout);
+	if (!workers)
+		return BOOL_FALSE;
+	ksession_set_workers(ktpd->session, workers);
+	faux_eloop_add_fd(ktpd->eloop, kworkers_fd(workers), POLLIN,
+		workers_ev, ktpd);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Sets output coalescing parameters.
+ *
+ * Small chunks of ACTION's output are collected and sent to client as a
+ * single message when "bytes" are accumulated or "delay_ms" is expired.
+ * Output of interactive ACTIONs is not coalesced. The zero "bytes" turns
+ * coalescing off.
+ */
+bool_t ktpd_session_set_coalesce(ktpd_session_t *ktpd, size_t bytes,
+	unsigned int delay_ms)
+{
+	assert(ktpd);
+	if (!ktpd)
+		return BOOL_FALSE;
+
+	ktpd->coalesce_bytes = bytes;
+	ktpd->coalesce_delay.tv_sec = delay_ms / 1000;
+	ktpd->coalesce_delay.tv_nsec = (delay_ms % 1000) * 1000000l;
+
+	return BOOL_TRUE;
+}
+
+
+// File for named locks of ACTIONs
+bool_t ktpd_session_set_lockfile(ktpd_session_t *ktpd, const char *lockfile)
+{
+	assert(ktpd);
+	if (!ktpd)
+		return BOOL_FALSE;
+
+	return ksession_set_lockfile(ktpd->session, lockfile);
+}
+
+
+// Sends data to client socket directly if there is no queued data. The
+// rest of data (socket is full) is queued to async's output buffer. So
+// the data is copied only if client is slow. Returns number of bytes sent
+// or queued.
+static ssize_t stream_writev(ktpd_session_t *ktpd,
+	struct iovec *iov, size_t iov_num)
+{
+	faux_async_t *async = ktpd->async;
+	ssize_t sent = 0;
+	ssize_t total = 0;
+	size_t i = 0;
+
+	// Socket is non-blocking (see faux_async_new())
+	if (faux_buf_len(faux_async_obuf(async)) == 0) {
+		struct msghdr msg = {};
+		msg.msg_iov = iov;
+		msg.msg_iovlen = iov_num;
+		sent = sendmsg(faux_async_fd(async), &msg,
+			MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (sent < 0)
+			sent = 0;
+	}
+
+	total = sent;
+	for (i = 0; i < iov_num; i++) {
+		if ((size_t)sent >= iov[i].iov_len) {
+			sent -= iov[i].iov_len;
+			continue;
+		}
+		faux_async_write(async, (char *)iov[i].iov_base + sent,
+			iov[i].iov_len - sent);
+		total += iov[i].iov_len - sent;
+		sent = 0;
+	}
+
+	return total;
+}
+
+
+// Sends all data from buffer as single KTP_STDOUT/KTP_STDERR message.
+// The data is not linearized. Buffer's chunks are sent as is.
+static bool_t send_stream_buf(ktpd_session_t *ktpd, faux_buf_t *buf,
+	bool_t is_stderr)
+{
+	char frame[KTP_STREAM_HDR_LEN];
+	struct iovec *chunks = NULL;
+	size_t chunks_num = 0;
+	struct iovec *iov = NULL;
+	ssize_t len = 0;
+
+	len = faux_buf_dread_lock(buf, faux_buf_len(buf), &chunks, &chunks_num);
+	if (len <= 0)
+		return BOOL_FALSE;
+
+	iov = faux_zmalloc((chunks_num + 1) * sizeof(*iov));
+	assert(iov);
+	iov[0].iov_base = frame;
+	iov[0].iov_len = ktp_stream_hdr(frame,
+		is_stderr ? KTP_STDERR : KTP_STDOUT, len);
+	memcpy(iov + 1, chunks, chunks_num * sizeof(*iov));
+	stream_writev(ktpd, iov, chunks_num + 1);
+	faux_free(iov);
+
+	faux_buf_dread_unlock(buf, len, chunks);
+
+	ktpd->stream_frames++;
+	ktpd->stream_bytes += len;
+	if (ktpd->held_chunks[is_stderr ? 1 : 0] > 1)
+		ktpd->stream_saved_frames +=
+			ktpd->held_chunks[is_stderr ? 1 : 0] - 1;
+	ktpd->held_chunks[is_stderr ? 1 : 0] = 0;
+
+	return BOOL_TRUE;
+}
+
+
+// Reads exactly "len" bytes from fd and queues them to async's output
+// buffer. Used when splice() can't transfer whole message's payload.
+static bool_t queue_stream_rest(ktpd_session_t *ktpd, int fd, size_t len)
+{
+	char *buf = NULL;
+	size_t got = 0;
+
+	buf = faux_malloc(len);
+	assert(buf);
+	while (got < len) {
+		ssize_t r = read(fd, buf + got, len - got);
+		if (r <= 0) {
+			if ((r < 0) && (EINTR == errno))
+				continue;
+			break;
+		}
+		got += r;
+	}
+	// Message length is already sent to client. So pad the message in
+	// the case of unexpected short read.
+	if (got < len)
+		memset(buf + got, 0, len - got);
+	faux_async_write(ktpd->async, buf, len);
+	faux_free(buf);
+
+	return (got == len) ? BOOL_TRUE : BOOL_FALSE;
+}
+
+
+// Raw data goes from pipe to client socket by splice() without copying
+// to user space. It's possible when there is no queued data so the order
+// of data is kept. Returns number of bytes of data sent, 0 if pipe is
+// empty and -1 if splice() can't be used.
+static ssize_t splice_stream(ktpd_session_t *ktpd, int fd, bool_t is_stderr,
+	size_t min_len)
+{
+	int sock = faux_async_fd(ktpd->async);
+	char frame[KTP_STREAM_HDR_LEN];
+	struct stat st = {};
+	int avail = 0;
+	ssize_t sent = 0;
+	size_t spliced = 0;
+
+	if (faux_buf_len(faux_async_obuf(ktpd->async)) > 0)
+		return -1;
+	// Pseudo terminal (interactive ACTIONs) can't be spliced
+	if ((fstat(fd, &st) < 0) || !S_ISFIFO(st.st_mode))
+		return -1;
+	if (ioctl(fd, FIONREAD, &avail) < 0)
+		return -1;
+	if (avail <= 0)
+		return 0;
+	// Small chunk will be coalesced with the next ones
+	if ((size_t)avail < min_len)
+		return -1;
+
+	ktp_stream_hdr(frame, is_stderr ? KTP_STDERR : KTP_STDOUT, avail);
+	ktpd->stream_frames++;
+	ktpd->stream_bytes += avail;
+	sent = send(sock, frame, sizeof(frame), MSG_DONTWAIT | MSG_NOSIGNAL);
+	if (sent < 0)
+		sent = 0;
+	if ((size_t)sent < sizeof(frame)) {
+		faux_async_write(ktpd->async, frame + sent,
+			sizeof(frame) - sent);
+		queue_stream_rest(ktpd, fd, avail);
+		return avail;
+	}
+
+	while (spliced < (size_t)avail) {
+		ssize_t r = splice(fd, NULL, sock, NULL, avail - spliced,
+			SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (r < 0) {
+			if (EINTR == errno)
+				continue;
+			break;
+		}
+		if (0 == r)
+			break;
+		spliced += r;
+	}
+	if (spliced < (size_t)avail)
+		queue_stream_rest(ktpd, fd, avail - spliced);
+
+	return avail;
+}
+
+
+static bool_t coalesce_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	ktpd_session_t *ktpd = (ktpd_session_t *)user_data;
+
+	// Event is freed by eloop after execution
+	ktpd->coalesce_ev = NULL;
+	stream_flush(ktpd);
+
+	eloop = eloop; // Happy compiler
+	type = type; // Happy compiler
+	associated_data = associated_data; // Happy compiler
+
+	return BOOL_TRUE;
+}
+
+
+// Sends all held output and cancels scheduled flush
+static void stream_flush(ktpd_session_t *ktpd)
+{
+	if (ktpd->coalesce_ev) {
+		faux_eloop_del_sched(ktpd->eloop, ktpd->coalesce_ev);
+		ktpd->coalesce_ev = NULL;
+	}
+	if (!ktpd->exec) {
+		ktpd->held_chunks[0] = 0;
+		ktpd->held_chunks[1] = 0;
+		return;
+	}
+
+	if (faux_buf_len(kexec_bufout(ktpd->exec)) > 0)
+		send_stream_buf(ktpd, kexec_bufout(ktpd->exec), BOOL_FALSE);
+	if (faux_buf_len(kexec_buferr(ktpd->exec)) > 0)
+		send_stream_buf(ktpd, kexec_buferr(ktpd->exec), BOOL_TRUE);
+
+	if (faux_buf_len(faux_async_obuf(ktpd->async)) > BUF_LIMIT) {
+		faux_eloop_exclude_fd_event(ktpd->eloop,
+			kexec_stdout(ktpd->exec), POLLIN);
+		faux_eloop_exclude_fd_event(ktpd->eloop,
+			kexec_stderr(ktpd->exec), POLLIN);
+	}
+}
+
+
 static bool_t get_stream(ktpd_session_t *ktpd, int fd, bool_t is_stderr,
 	bool_t process_all_data)
 {
 	ssize_t r = -1;
 	faux_buf_t *faux_buf = NULL;
-	char *buf = NULL;
-	ssize_t len = 0;
-	faux_msg_t *ack = NULL;
+	faux_buf_t *read_buf = NULL;
+	size_t coalesce_bytes = 0;
+	size_t len = 0;
+	size_t before = 0;
 
 	if (!ktpd)
 		return BOOL_TRUE;
 	if (!ktpd->exec)
 		return BOOL_TRUE;
 
-	if (is_stderr)
+	// Stdout of filtered kexec is read to separate buffer. Filters
+	// append their output to bufout. So output held by coalescing is
+	// not filtered again.
+	if (is_stderr) {
 		faux_buf = kexec_buferr(ktpd->exec);
-	else
+		read_buf = faux_buf;
+	} else {
 		faux_buf = kexec_bufout(ktpd->exec);
+		read_buf = kexec_bufraw(ktpd->exec);
+	}
 	assert(faux_buf);
+	assert(read_buf);
+
+	// Interactive output goes to client immediately
+	if (!kexec_interactive(ktpd->exec))
+		coalesce_bytes = ktpd->coalesce_bytes;
+
+	// Zero-copy path. Buffered data (output of sync ACTIONs) must be
+	// sent first and filtered output needs reading.
+	if ((faux_buf_len(faux_buf) == 0) &&
+		(is_stderr || !kexec_filtered(ktpd->exec))) {
+		ssize_t spliced = 0;
+		do {
+			spliced = splice_stream(ktpd, fd, is_stderr,
+				coalesce_bytes);
+		} while ((spliced > 0) && process_all_data);
+		if (spliced >= 0)
+			goto backpressure;
+	}
 
+	before = faux_buf_len(faux_buf);
 	do {
 		void *linear_buf = NULL;
 		ssize_t really_readed = 0;
 		ssize_t linear_len =
-			faux_buf_dwrite_lock_easy(faux_buf, &linear_buf);
+			faux_buf_dwrite_lock_easy(read_buf, &linear_buf);
 		// Non-blocked read. The fd became non-blocked while
 		// kexec_prepare().
 		r = read(fd, linear_buf, linear_len);
 		if (r > 0)
 			really_readed = r;
-		faux_buf_dwrite_unlock_easy(faux_buf, really_readed);
+		faux_buf_dwrite_unlock_easy(read_buf, really_readed);
 	} while ((r > 0) && process_all_data);
 
+	// Trailing filters are executed here. The output is over when all
+	// the data is read from finished kexec.
+	if (!is_stderr)
+		kexec_filter_stdout(ktpd->exec,
+			process_all_data && kexec_done(ktpd->exec));
+
 	len = faux_buf_len(faux_buf);
 	if (0 == len)
+		goto backpressure;
+	if (len > before)
+		ktpd->held_chunks[is_stderr ? 1 : 0]++;
+
+	// Hold small chunk of output till the next data or flush event
+	if (!process_all_data && (len < coalesce_bytes)) {
+		if (!ktpd->coalesce_ev)
+			ktpd->coalesce_ev = faux_eloop_add_sched_once_delayed(
+				ktpd->eloop, &ktpd->coalesce_delay, 0,
+				coalesce_ev, ktpd);
 		return BOOL_TRUE;
+	}
 
-	buf = malloc(len);
-	faux_buf_read(faux_buf, buf, len);
-
-	// Create KTP_STDOUT/KTP_STDERR message to send to client
-	ack = ktp_msg_preform(is_stderr ? KTP_STDERR : KTP_STDOUT, KTP_STATUS_NONE);
-	faux_msg_add_param(ack, KTP_PARAM_LINE, buf, len);
-	faux_msg_send_async(ack, ktpd->async);
-	faux_msg_free(ack);
-
-	free(buf);
+	// Create KTP_STDOUT/KTP_STDERR message to send to client. The
+	// message is sent right from kexec's buffer.
+	send_stream_buf(ktpd, faux_buf, is_stderr);
 
+backpressure:
 	// Pause stdout/stderr receiving because buffer (to send to client)
 	// is full
 	if (faux_buf_len(faux_async_obuf(ktpd->async)) > BUF_LIMIT)
@@ -1534,7 +2483,7 @@ bool_t client_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 			// Someting went wrong
 			faux_eloop_del_fd(eloop, info->fd);
 			syslog(LOG_ERR, "Can't send data to client");
-			return BOOL_FALSE; // Stop event loop
+			return ktpd_session_stop(ktpd); // Stop event loop
 		}
 		// Restore stdout and stderr receiving if out buffer is not
 		// full
@@ -1553,7 +2502,7 @@ bool_t client_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 			// Someting went wrong
 			faux_eloop_del_fd(eloop, info->fd);
 			syslog(LOG_ERR, "Can't get data from client");
-			return BOOL_FALSE; // Stop event loop
+			return ktpd_session_stop(ktpd); // Stop event loop
 		}
 	}
 
@@ -1561,21 +2510,21 @@ bool_t client_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	if (info->revents & POLLHUP) {
 		faux_eloop_del_fd(eloop, info->fd);
 		syslog(LOG_DEBUG, "Connection %d is closed by client", info->fd);
-		return BOOL_FALSE; // Stop event loop
+		return ktpd_session_stop(ktpd); // Stop event loop
 	}
 
 	// POLLERR
 	if (info->revents & POLLERR) {
 		faux_eloop_del_fd(eloop, info->fd);
 		syslog(LOG_DEBUG, "POLLERR received %d", info->fd);
-		return BOOL_FALSE; // Stop event loop
+		return ktpd_session_stop(ktpd); // Stop event loop
 	}
 
 	// POLLNVAL
 	if (info->revents & POLLNVAL) {
 		faux_eloop_del_fd(eloop, info->fd);
 		syslog(LOG_DEBUG, "POLLNVAL received %d", info->fd);
-		return BOOL_FALSE; // Stop event loop
+		return ktpd_session_stop(ktpd); // Stop event loop
 	}
 
 	type = type; // Happy compiler
@@ -1584,7 +2533,7 @@ bool_t client_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	// stopped immediately so it's only two places within code to really
 	// break the loop. This one and within wait_for_action_ev().
 	if (ktpd->exit)
-		return BOOL_FALSE;
+		return ktpd_session_stop(ktpd);
 
 	return BOOL_TRUE;
 }
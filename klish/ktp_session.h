@@ -12,6 +12,14 @@
 
 #define KLISH_DEFAULT_UNIX_SOCKET_PATH "/tmp/klish-unix-socket"
 
+// Length of stream message's header. Message contains single parameter
+#define KTP_STREAM_HDR_LEN (sizeof(faux_hdr_t) + sizeof(faux_phdr_t))
+
+// Default output coalescing. Small chunks of ACTION's output are collected
+// till the size is reached or delay (in milliseconds) is expired.
+#define KTPD_COALESCE_DEFAULT_BYTES 4096
+#define KTPD_COALESCE_DEFAULT_DELAY 2
+
 typedef struct ktpd_session_s ktpd_session_t;
 typedef struct ktp_session_s ktp_session_t;
 
@@ -26,6 +34,7 @@ int ktp_accept(int listen_sock);
 bool_t ktp_check_header(faux_hdr_t *hdr);
 faux_msg_t *ktp_msg_preform(ktp_cmd_e cmd, uint32_t status);
 bool_t ktp_send_error(faux_async_t *async, ktp_cmd_e cmd, const char *error);
+size_t ktp_stream_hdr(void *frame, ktp_cmd_e cmd, size_t len);
 
 bool_t ktp_peer_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data);
@@ -94,6 +103,8 @@ ktp_session_state_e ktp_session_state(const ktp_session_t *ktp);
 
 bool_t ktp_session_cmd(ktp_session_t *ktp, const char *line,
 	faux_error_t *error, bool_t dry_run);
+size_t ktp_session_cmd_outstanding(const ktp_session_t *ktp);
+bool_t ktp_session_set_stop_on_error(ktp_session_t *ktp, bool_t stop_on_error);
 bool_t ktp_session_auth(ktp_session_t *ktp, faux_error_t *error);
 bool_t ktp_session_completion(ktp_session_t *ktp, const char *line,
 	bool_t dry_run);
@@ -112,14 +123,27 @@ int ktp_session_last_stream(ktp_session_t *ktp);
 // Server KTP session
 typedef bool_t (*ktpd_session_stall_cb_fn)(ktpd_session_t *session,
 	void *user_data);
+typedef void (*ktpd_session_close_cb_fn)(ktpd_session_t *session,
+	void *user_data);
 
 ktpd_session_t *ktpd_session_new(int sock, kscheme_t *scheme,
 	const char *start_entry, faux_eloop_t *eloop);
+ktpd_session_t *ktpd_session_new_shared(int sock, kscheme_t *scheme,
+	const char *start_entry, faux_eloop_t *eloop,
+	ktpd_session_close_cb_fn close_cb, void *user_data);
 void ktpd_session_free(ktpd_session_t *session);
+bool_t ktpd_session_child_exited(ktpd_session_t *session, pid_t pid,
+	int wstatus);
 bool_t ktpd_session_connected(ktpd_session_t *session);
 int ktpd_session_fd(const ktpd_session_t *session);
 bool_t ktpd_session_async_in(ktpd_session_t *session);
 bool_t ktpd_session_async_out(ktpd_session_t *session);
+bool_t ktpd_session_set_workers(ktpd_session_t *session, size_t size,
+	unsigned int idle_timeout);
+bool_t ktpd_session_set_coalesce(ktpd_session_t *session, size_t bytes,
+	unsigned int delay_ms);
+bool_t ktpd_session_set_lockfile(ktpd_session_t *session,
+	const char *lockfile);
 
 C_DECL_END
 
@@ -0,0 +1,37 @@
+/** @file kworkers.h
+ *
+ * @brief Klish action workers. Pool of pre-forked helper processes to
+ * execute async ACTIONs without fork() of session process per ACTION.
+ */
+
+#ifndef _klish_kworkers_h
+#define _klish_kworkers_h
+
+#include <sys/types.h>
+
+#include <faux/faux.h>
+#include <klish/kcontext_base.h>
+
+// Default idle timeout (in seconds) of worker
+#define KWORKERS_DEFAULT_IDLE_TIMEOUT 60
+
+
+typedef struct kworkers_s kworkers_t;
+
+C_DECL_BEGIN
+
+kworkers_t *kworkers_new(size_t size, unsigned int idle_timeout);
+void kworkers_free(kworkers_t *workers);
+
+size_t kworkers_size(const kworkers_t *workers);
+unsigned int kworkers_idle_timeout(const kworkers_t *workers);
+int kworkers_fd(const kworkers_t *workers);
+
+bool_t kworkers_fill(kworkers_t *workers);
+pid_t kworkers_run(kworkers_t *workers, const kcontext_t *context);
+bool_t kworkers_reap(kworkers_t *workers, pid_t *pid, int *wstatus);
+bool_t kworkers_del(kworkers_t *workers, pid_t pid);
+
+C_DECL_END
+
+#endif // _klish_kworkers_h
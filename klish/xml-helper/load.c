@@ -378,6 +378,8 @@ static bool_t process_action(const kxml_node_t *element, void *parent,
 
 	iaction.sym = kxml_node_attr(element, "sym");
 	iaction.lock = kxml_node_attr(element, "lock");
+	iaction.lock_shared = kxml_node_attr(element, "lock_shared");
+	iaction.lock_wait = kxml_node_attr(element, "lock_wait");
 	iaction.interrupt = kxml_node_attr(element, "interrupt");
 	iaction.in = kxml_node_attr(element, "in");
 	iaction.out = kxml_node_attr(element, "out");
@@ -424,6 +426,8 @@ static bool_t process_action(const kxml_node_t *element, void *parent,
 err:
 	kxml_node_attr_free(iaction.sym);
 	kxml_node_attr_free(iaction.lock);
+	kxml_node_attr_free(iaction.lock_shared);
+	kxml_node_attr_free(iaction.lock_wait);
 	kxml_node_attr_free(iaction.interrupt);
 	kxml_node_attr_free(iaction.in);
 	kxml_node_attr_free(iaction.out);
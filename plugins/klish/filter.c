@@ -0,0 +1,250 @@
+/*
+ * Output filters: include, exclude, begin, count.
+ *
+ * Each filter has line filter functions so klish engine executes trailing
+ * filters within session process without forking. The same functions are
+ * used by filter's symbol when filter is executed as a process (filter is
+ * followed by another non-builtin filter for example).
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <regex.h>
+
+#include <faux/str.h>
+#include <faux/buf.h>
+#include <klish/kcontext.h>
+#include <klish/kpargv.h>
+#include <klish/ksym.h>
+
+#include "private.h"
+
+
+typedef enum {
+	KLISH_FILTER_INCLUDE,
+	KLISH_FILTER_EXCLUDE,
+	KLISH_FILTER_BEGIN,
+	KLISH_FILTER_COUNT,
+} klish_filter_e;
+
+typedef struct {
+	klish_filter_e type;
+	char *pattern;
+	size_t pattern_len;
+	bool_t is_regex;
+	regex_t re;
+	bool_t begun; // "begin" filter found the first matched line
+	size_t count;
+} klish_filter_t;
+
+
+// Filter's pattern is a value of its argument
+static const char *klish_filter_pattern(kcontext_t *context)
+{
+	kpargv_t *pargv = kcontext_pargv(context);
+	kparg_t *parg = NULL;
+
+	parg = kpargv_pargs_last(pargv);
+	if (!parg || (kparg_entry(parg) == kpargv_command(pargv)))
+		return NULL;
+
+	return kparg_value(parg);
+}
+
+
+static void *klish_filter_init(kcontext_t *context, klish_filter_e type)
+{
+	klish_filter_t *filter = NULL;
+	const char *pattern = NULL;
+
+	if (type != KLISH_FILTER_COUNT) {
+		pattern = klish_filter_pattern(context);
+		if (faux_str_is_empty(pattern)) {
+			fprintf(stderr, "Error: Filter pattern is not specified\n");
+			return NULL;
+		}
+	}
+
+	filter = faux_zmalloc(sizeof(*filter));
+	assert(filter);
+	filter->type = type;
+	filter->begun = BOOL_FALSE;
+	filter->count = 0;
+	if (!pattern)
+		return filter;
+
+	filter->pattern = faux_str_dup(pattern);
+	filter->pattern_len = strlen(pattern);
+	// Plain substring is searched by memmem(). It's much faster than
+	// regular expression.
+	filter->is_regex = strpbrk(pattern, ".[]()*+?{}|^$\\") ?
+		BOOL_TRUE : BOOL_FALSE;
+	if (filter->is_regex &&
+		(regcomp(&filter->re, pattern, REG_EXTENDED | REG_NOSUB) != 0)) {
+		fprintf(stderr, "Error: Illegal regular expression \"%s\"\n",
+			pattern);
+		faux_str_free(filter->pattern);
+		faux_free(filter);
+		return NULL;
+	}
+
+	return filter;
+}
+
+
+static void *klish_filter_init_include(kcontext_t *context)
+{
+	return klish_filter_init(context, KLISH_FILTER_INCLUDE);
+}
+
+
+static void *klish_filter_init_exclude(kcontext_t *context)
+{
+	return klish_filter_init(context, KLISH_FILTER_EXCLUDE);
+}
+
+
+static void *klish_filter_init_begin(kcontext_t *context)
+{
+	return klish_filter_init(context, KLISH_FILTER_BEGIN);
+}
+
+
+static void *klish_filter_init_count(kcontext_t *context)
+{
+	return klish_filter_init(context, KLISH_FILTER_COUNT);
+}
+
+
+static bool_t klish_filter_match(const klish_filter_t *filter,
+	const char *line, size_t len)
+{
+	if (filter->is_regex)
+		return (regexec(&filter->re, line, 0, NULL, 0) == 0) ?
+			BOOL_TRUE : BOOL_FALSE;
+
+	return memmem(line, len, filter->pattern, filter->pattern_len) ?
+		BOOL_TRUE : BOOL_FALSE;
+}
+
+
+static bool_t klish_filter_line(void *state, const char *line, size_t len)
+{
+	klish_filter_t *filter = (klish_filter_t *)state;
+
+	switch (filter->type) {
+	case KLISH_FILTER_INCLUDE:
+		return klish_filter_match(filter, line, len);
+	case KLISH_FILTER_EXCLUDE:
+		return !klish_filter_match(filter, line, len);
+	case KLISH_FILTER_BEGIN:
+		if (!filter->begun)
+			filter->begun = klish_filter_match(filter, line, len);
+		return filter->begun;
+	case KLISH_FILTER_COUNT:
+		filter->count++;
+		return BOOL_FALSE;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+static void klish_filter_fini(void *state, faux_buf_t *out)
+{
+	klish_filter_t *filter = (klish_filter_t *)state;
+
+	if (KLISH_FILTER_COUNT == filter->type) {
+		char *str = faux_str_sprintf("%zu\n", filter->count);
+		faux_buf_write(out, str, strlen(str));
+		faux_str_free(str);
+	}
+
+	if (filter->is_regex)
+		regfree(&filter->re);
+	faux_str_free(filter->pattern);
+	faux_free(filter);
+}
+
+
+const ksym_filter_t klish_filter_include = {
+	klish_filter_init_include, klish_filter_line, klish_filter_fini };
+const ksym_filter_t klish_filter_exclude = {
+	klish_filter_init_exclude, klish_filter_line, klish_filter_fini };
+const ksym_filter_t klish_filter_begin = {
+	klish_filter_init_begin, klish_filter_line, klish_filter_fini };
+const ksym_filter_t klish_filter_count = {
+	klish_filter_init_count, klish_filter_line, klish_filter_fini };
+
+
+// Execute filter as a process. Read stdin and write to stdout.
+static int klish_filter_process(kcontext_t *context,
+	const ksym_filter_t *ops)
+{
+	void *state = NULL;
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len = 0;
+	faux_buf_t *out = NULL;
+	char *final = NULL;
+	size_t final_len = 0;
+
+	state = ops->init(context);
+	if (!state)
+		return -1;
+
+	while ((len = getline(&line, &size, stdin)) >= 0) {
+		bool_t newline = BOOL_FALSE;
+		if ((len > 0) && (line[len - 1] == '\n')) {
+			line[--len] = '\0';
+			newline = BOOL_TRUE;
+		}
+		if (!ops->line(state, line, len))
+			continue;
+		fwrite(line, 1, len, stdout);
+		if (newline)
+			fputc('\n', stdout);
+	}
+	free(line);
+
+	out = faux_buf_new(0);
+	ops->fini(state, out);
+	final_len = faux_buf_len(out);
+	if (final_len > 0) {
+		final = faux_malloc(final_len);
+		faux_buf_read(out, final, final_len);
+		fwrite(final, 1, final_len, stdout);
+		faux_free(final);
+	}
+	faux_buf_free(out);
+
+	return 0;
+}
+
+
+int klish_include(kcontext_t *context)
+{
+	return klish_filter_process(context, &klish_filter_include);
+}
+
+
+int klish_exclude(kcontext_t *context)
+{
+	return klish_filter_process(context, &klish_filter_exclude);
+}
+
+
+int klish_begin(kcontext_t *context)
+{
+	return klish_filter_process(context, &klish_filter_begin);
+}
+
+
+int klish_count(kcontext_t *context)
+{
+	return klish_filter_process(context, &klish_filter_count);
+}
@@ -110,6 +110,25 @@ int klish_pwd(kcontext_t *context)
 }
 
 
+// Symbol to show statistics of session's PTYPE validation cache
+int klish_ptcache_stats(kcontext_t *context)
+{
+	ksession_t *session = NULL;
+	char *stats = NULL;
+
+	session = kcontext_session(context);
+	if (!session)
+		return -1;
+	stats = kptcache_stats(ksession_ptcache(session));
+	if (!stats)
+		return -1;
+	printf("PTYPE cache: %s\n", stats);
+	faux_str_free(stats);
+
+	return 0;
+}
+
+
 // Template for easy prompt string generation
 int klish_prompt(kcontext_t *context)
 {
@@ -17,9 +17,33 @@ const uint8_t kplugin_klish_major = KPLUGIN_MAJOR;
 const uint8_t kplugin_klish_minor = KPLUGIN_MINOR;
 
 
+static void klish_add_native_ptype(kplugin_t *plugin, const char *name,
+	ksym_fn fn, ksym_prepare_fn prepare)
+{
+	ksym_t *sym = NULL;
+
+	sym = ksym_new_ext(name, fn, KSYM_USERDEFINED_PERMANENT, KSYM_SYNC);
+	ksym_set_prepare(sym, prepare);
+	ksym_set_pure(sym, BOOL_TRUE);
+	kplugin_add_syms(plugin, sym);
+}
+
+
+static void klish_add_filter(kplugin_t *plugin, const char *name,
+	ksym_fn fn, const ksym_filter_t *filter)
+{
+	ksym_t *sym = NULL;
+
+	sym = ksym_new(name, fn);
+	ksym_set_filter(sym, filter);
+	kplugin_add_syms(plugin, sym);
+}
+
+
 int kplugin_klish_init(kcontext_t *context)
 {
 	kplugin_t *plugin = NULL;
+	ksym_t *sym = NULL;
 
 	assert(context);
 	plugin = kcontext_plugin(context);
@@ -33,6 +57,9 @@ int kplugin_klish_init(kcontext_t *context)
 	kplugin_add_syms(plugin, ksym_new("printl", klish_printl));
 	kplugin_add_syms(plugin, ksym_new_ext("pwd", klish_pwd,
 		KSYM_PERMANENT, KSYM_SYNC));
+	// PTYPE cache lives within session process so symbol must be sync
+	kplugin_add_syms(plugin, ksym_new_ext("ptcache_stats",
+		klish_ptcache_stats, KSYM_USERDEFINED_PERMANENT, KSYM_SYNC));
 	kplugin_add_syms(plugin, ksym_new("prompt", klish_prompt));
 
 	// Log
@@ -42,24 +69,99 @@ int kplugin_klish_init(kcontext_t *context)
 	// Navigation must be permanent (no dry-run) and sync. Because unsync
 	// actions will be fork()-ed so it can't change current path.
 	kplugin_add_syms(plugin, ksym_new_ext("nav", klish_nav,
-		KSYM_PERMANENT, KSYM_SYNC));
+		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC));
 
 	// PTYPEs
-	// These PTYPEs are simple and fast so set SYNC flag
-	kplugin_add_syms(plugin, ksym_new_ext("COMMAND", klish_ptype_COMMAND,
-		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC));
+	// These PTYPEs are simple and fast so set SYNC flag. All of them are
+	// pure (result depends on candidate ENTRY and value only) so klish
+	// engine can cache validation results.
+	// COMMAND and COMMAND_CASE are keywords so klish engine can find
+	// ENTRYs with such PTYPEs by index without symbol execution.
+	sym = ksym_new_ext("COMMAND", klish_ptype_COMMAND,
+		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC);
+	ksym_set_keyword(sym, KSYM_KEYWORD_NOCASE);
+	ksym_set_pure(sym, BOOL_TRUE);
+	kplugin_add_syms(plugin, sym);
 	kplugin_add_syms(plugin, ksym_new_ext("completion_COMMAND", klish_completion_COMMAND,
 		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC));
 	kplugin_add_syms(plugin, ksym_new_ext("help_COMMAND", klish_help_COMMAND,
 		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC));
-	kplugin_add_syms(plugin, ksym_new_ext("COMMAND_CASE", klish_ptype_COMMAND_CASE,
+	sym = ksym_new_ext("COMMAND_CASE", klish_ptype_COMMAND_CASE,
+		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC);
+	ksym_set_keyword(sym, KSYM_KEYWORD_CASE);
+	ksym_set_pure(sym, BOOL_TRUE);
+	kplugin_add_syms(plugin, sym);
+	// INT and UINT have range within script. It's parsed once.
+	sym = ksym_new_ext("INT", klish_ptype_INT,
+		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC);
+	ksym_set_prepare(sym, klish_prepare_INT);
+	ksym_set_pure(sym, BOOL_TRUE);
+	kplugin_add_syms(plugin, sym);
+	sym = ksym_new_ext("UINT", klish_ptype_UINT,
+		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC);
+	ksym_set_prepare(sym, klish_prepare_UINT);
+	ksym_set_pure(sym, BOOL_TRUE);
+	kplugin_add_syms(plugin, sym);
+	sym = ksym_new_ext("STRING", klish_ptype_STRING,
+		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC);
+	ksym_set_pure(sym, BOOL_TRUE);
+	kplugin_add_syms(plugin, sym);
+	// REGEXP pattern is compiled once
+	sym = ksym_new_ext("REGEXP", klish_ptype_REGEXP,
+		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC);
+	ksym_set_prepare(sym, klish_prepare_REGEXP);
+	ksym_set_prepared_free(sym, klish_prepared_free_REGEXP);
+	ksym_set_pure(sym, BOOL_TRUE);
+	kplugin_add_syms(plugin, sym);
+	kplugin_add_syms(plugin, ksym_new_ext("completion_REGEXP", klish_completion_REGEXP,
 		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC));
-	kplugin_add_syms(plugin, ksym_new_ext("INT", klish_ptype_INT,
+	kplugin_add_syms(plugin, ksym_new_ext("help_REGEXP", klish_help_REGEXP,
 		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC));
-	kplugin_add_syms(plugin, ksym_new_ext("UINT", klish_ptype_UINT,
+
+	// Native validators of network and other common types. They don't
+	// allocate memory and print canonical form of value to stdout if
+	// it's necessary. Like other standard PTYPEs they let ACTION decide
+	// if it's permanent.
+	klish_add_native_ptype(plugin, "IPV4", klish_ptype_IPV4, NULL);
+	kplugin_add_syms(plugin, ksym_new_ext("help_IPV4", klish_help_IPV4,
 		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC));
-	kplugin_add_syms(plugin, ksym_new_ext("STRING", klish_ptype_STRING,
+	klish_add_native_ptype(plugin, "IPV4_PREFIX", klish_ptype_IPV4_PREFIX,
+		NULL);
+	kplugin_add_syms(plugin, ksym_new_ext("help_IPV4_PREFIX",
+		klish_help_IPV4_PREFIX, KSYM_USERDEFINED_PERMANENT, KSYM_SYNC));
+	klish_add_native_ptype(plugin, "IPV6", klish_ptype_IPV6, NULL);
+	kplugin_add_syms(plugin, ksym_new_ext("help_IPV6", klish_help_IPV6,
 		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC));
+	klish_add_native_ptype(plugin, "IPV6_PREFIX", klish_ptype_IPV6_PREFIX,
+		NULL);
+	kplugin_add_syms(plugin, ksym_new_ext("help_IPV6_PREFIX",
+		klish_help_IPV6_PREFIX, KSYM_USERDEFINED_PERMANENT, KSYM_SYNC));
+	klish_add_native_ptype(plugin, "MAC", klish_ptype_MAC, NULL);
+	kplugin_add_syms(plugin, ksym_new_ext("help_MAC", klish_help_MAC,
+		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC));
+	klish_add_native_ptype(plugin, "HEX", klish_ptype_HEX, NULL);
+	kplugin_add_syms(plugin, ksym_new_ext("help_HEX", klish_help_HEX,
+		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC));
+	// RANGE_LIST has the same range of numbers within script as UINT
+	klish_add_native_ptype(plugin, "RANGE_LIST", klish_ptype_RANGE_LIST,
+		klish_prepare_UINT);
+	kplugin_add_syms(plugin, ksym_new_ext("help_RANGE_LIST",
+		klish_help_RANGE_LIST, KSYM_USERDEFINED_PERMANENT, KSYM_SYNC));
+	klish_add_native_ptype(plugin, "BOOL", klish_ptype_BOOL, NULL);
+	kplugin_add_syms(plugin, ksym_new_ext("completion_BOOL",
+		klish_completion_BOOL, KSYM_USERDEFINED_PERMANENT, KSYM_SYNC));
+	kplugin_add_syms(plugin, ksym_new_ext("help_BOOL", klish_help_BOOL,
+		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC));
+
+	// Filters
+	// Trailing filters are executed within session process using line
+	// filter functions. Else they are usual async symbols.
+	klish_add_filter(plugin, "include", klish_include,
+		&klish_filter_include);
+	klish_add_filter(plugin, "exclude", klish_exclude,
+		&klish_filter_exclude);
+	klish_add_filter(plugin, "begin", klish_begin, &klish_filter_begin);
+	klish_add_filter(plugin, "count", klish_count, &klish_filter_count);
 
 	return 0;
 }
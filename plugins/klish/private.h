@@ -6,7 +6,9 @@
 #define _plugins_klish_h
 
 #include <faux/faux.h>
+#include <faux/error.h>
 #include <klish/kcontext_base.h>
+#include <klish/ksym.h>
 
 
 C_DECL_BEGIN
@@ -17,6 +19,7 @@ int klish_tsym(kcontext_t *context);
 int klish_print(kcontext_t *context);
 int klish_printl(kcontext_t *context);
 int klish_pwd(kcontext_t *context);
+int klish_ptcache_stats(kcontext_t *context);
 int klish_prompt(kcontext_t *context);
 
 // Log
@@ -33,11 +36,47 @@ int klish_help_COMMAND(kcontext_t *context);
 int klish_ptype_COMMAND_CASE(kcontext_t *context);
 
 int klish_ptype_INT(kcontext_t *context);
+void *klish_prepare_INT(const char *script, faux_error_t *error);
 
 int klish_ptype_UINT(kcontext_t *context);
+void *klish_prepare_UINT(const char *script, faux_error_t *error);
 
 int klish_ptype_STRING(kcontext_t *context);
 
+int klish_ptype_REGEXP(kcontext_t *context);
+void *klish_prepare_REGEXP(const char *script, faux_error_t *error);
+void klish_prepared_free_REGEXP(void *prepared);
+int klish_completion_REGEXP(kcontext_t *context);
+int klish_help_REGEXP(kcontext_t *context);
+
+int klish_ptype_IPV4(kcontext_t *context);
+int klish_help_IPV4(kcontext_t *context);
+int klish_ptype_IPV4_PREFIX(kcontext_t *context);
+int klish_help_IPV4_PREFIX(kcontext_t *context);
+int klish_ptype_IPV6(kcontext_t *context);
+int klish_help_IPV6(kcontext_t *context);
+int klish_ptype_IPV6_PREFIX(kcontext_t *context);
+int klish_help_IPV6_PREFIX(kcontext_t *context);
+int klish_ptype_MAC(kcontext_t *context);
+int klish_help_MAC(kcontext_t *context);
+int klish_ptype_HEX(kcontext_t *context);
+int klish_help_HEX(kcontext_t *context);
+int klish_ptype_RANGE_LIST(kcontext_t *context);
+int klish_help_RANGE_LIST(kcontext_t *context);
+int klish_ptype_BOOL(kcontext_t *context);
+int klish_completion_BOOL(kcontext_t *context);
+int klish_help_BOOL(kcontext_t *context);
+
+// Filters
+int klish_include(kcontext_t *context);
+int klish_exclude(kcontext_t *context);
+int klish_begin(kcontext_t *context);
+int klish_count(kcontext_t *context);
+extern const ksym_filter_t klish_filter_include;
+extern const ksym_filter_t klish_filter_exclude;
+extern const ksym_filter_t klish_filter_begin;
+extern const ksym_filter_t klish_filter_count;
+
 
 C_DECL_END
 
@@ -8,6 +8,9 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <ctype.h>
+#include <regex.h>
+#include <arpa/inet.h>
 
 #include <faux/str.h>
 #include <faux/list.h>
@@ -16,6 +19,8 @@
 #include <klish/kcontext.h>
 #include <klish/kentry.h>
 
+#include "private.h"
+
 
 /** @brief PTYPE: Consider ENTRY's name (or "value" field) as a command
  */
@@ -124,6 +129,97 @@ int klish_ptype_COMMAND_CASE(kcontext_t *context)
 }
 
 
+// Range of INT/UINT PTYPEs. It's parsed from ACTION's script once while
+// scheme preparing.
+typedef struct {
+	bool_t valid; // Illegal range. Any value will be declined.
+	bool_t has_min;
+	bool_t has_max;
+	union {
+		long long int i;
+		unsigned long long int u;
+	} min, max;
+} klish_range_t;
+
+
+static bool_t klish_range_parse(const char *script, bool_t is_signed,
+	klish_range_t *range)
+{
+	faux_argv_t *argv = NULL;
+	const char *str = NULL;
+
+	memset(range, 0, sizeof(*range));
+	range->valid = BOOL_TRUE;
+	if (faux_str_is_empty(script))
+		return BOOL_TRUE;
+
+	argv = faux_argv_new();
+	faux_argv_parse(argv, script);
+
+	// Min
+	str = faux_argv_index(argv, 0);
+	if (str) {
+		range->has_min = BOOL_TRUE;
+		if (is_signed ?
+			!faux_conv_atoll(str, &range->min.i, 0) :
+			!faux_conv_atoull(str, &range->min.u, 0))
+			range->valid = BOOL_FALSE;
+	}
+
+	// Max
+	str = faux_argv_index(argv, 1);
+	if (str) {
+		range->has_max = BOOL_TRUE;
+		if (is_signed ?
+			!faux_conv_atoll(str, &range->max.i, 0) :
+			!faux_conv_atoull(str, &range->max.u, 0))
+			range->valid = BOOL_FALSE;
+	}
+
+	faux_argv_free(argv);
+
+	return BOOL_TRUE;
+}
+
+
+static void *klish_range_prepare(const char *script, bool_t is_signed)
+{
+	klish_range_t *range = NULL;
+
+	range = faux_zmalloc(sizeof(*range));
+	assert(range);
+	if (!range)
+		return NULL;
+	klish_range_parse(script, is_signed, range);
+
+	return range;
+}
+
+
+// Get prepared range. If ACTION was not prepared then parse script here.
+static const klish_range_t *klish_range(kcontext_t *context,
+	bool_t is_signed, klish_range_t *tmp)
+{
+	const klish_range_t *range = kcontext_prepared(context);
+
+	if (range)
+		return range;
+	klish_range_parse(kcontext_script(context), is_signed, tmp);
+
+	return tmp;
+}
+
+
+/** @brief PREPARE: Parse range of INT PTYPE
+ */
+void *klish_prepare_INT(const char *script, faux_error_t *error)
+{
+	error = error; // Happy compiler
+
+	return klish_range_prepare(script, BOOL_TRUE);
+}
+
+
 /** @brief PTYPE: Signed int with optional range
  *
  * Use long long int for conversion from text.
@@ -133,46 +229,35 @@ int klish_ptype_COMMAND_CASE(kcontext_t *context)
  */
 int klish_ptype_INT(kcontext_t *context)
 {
-	const char *script = NULL;
 	const char *value_str = NULL;
 	long long int value = 0;
+	const klish_range_t *range = NULL;
+	klish_range_t tmp = {};
 
-	script = kcontext_script(context);
 	value_str = kcontext_candidate_value(context);
 
 	if (!faux_conv_atoll(value_str, &value, 0))
 		return -1;
 
-	// Range is specified
-	if (!faux_str_is_empty(script)) {
-		faux_argv_t *argv = faux_argv_new();
-		const char *str = NULL;
-		faux_argv_parse(argv, script);
+	range = klish_range(context, BOOL_TRUE, &tmp);
+	if (!range->valid)
+		return -1;
+	if (range->has_min && (value < range->min.i))
+		return -1;
+	if (range->has_max && (value > range->max.i))
+		return -1;
 
-		// Min
-		str = faux_argv_index(argv, 0);
-		if (str) {
-			long long int min = 0;
-			if (!faux_conv_atoll(str, &min, 0) || (value < min)) {
-				faux_argv_free(argv);
-				return -1;
-			}
-		}
+	return 0;
+}
 
-		// Max
-		str = faux_argv_index(argv, 1);
-		if (str) {
-			long long int max = 0;
-			if (!faux_conv_atoll(str, &max, 0) || (value > max)) {
-				faux_argv_free(argv);
-				return -1;
-			}
-		}
 
-		faux_argv_free(argv);
-	}
+/** @brief PREPARE: Parse range of UINT PTYPE
+ */
+void *klish_prepare_UINT(const char *script, faux_error_t *error)
+{
+	error = error; // Happy compiler
 
-	return 0;
+	return klish_range_prepare(script, BOOL_FALSE);
 }
 
 
@@ -185,56 +270,770 @@ int klish_ptype_INT(kcontext_t *context)
  */
 int klish_ptype_UINT(kcontext_t *context)
 {
-	const char *script = NULL;
 	const char *value_str = NULL;
 	unsigned long long int value = 0;
+	const klish_range_t *range = NULL;
+	klish_range_t tmp = {};
 
-	script = kcontext_script(context);
 	value_str = kcontext_candidate_value(context);
 
 	if (!faux_conv_atoull(value_str, &value, 0))
 		return -1;
 
-	// Range is specified
-	if (!faux_str_is_empty(script)) {
-		faux_argv_t *argv = faux_argv_new();
-		const char *str = NULL;
-		faux_argv_parse(argv, script);
+	range = klish_range(context, BOOL_FALSE, &tmp);
+	if (!range->valid)
+		return -1;
+	if (range->has_min && (value < range->min.u))
+		return -1;
+	if (range->has_max && (value > range->max.u))
+		return -1;
+
+	return 0;
+}
+
+
+/** @brief PTYPE: Arbitrary string
+ */
+int klish_ptype_STRING(kcontext_t *context)
+{
+	// Really any string is a ... (surprise!) string
+
+	context = context; // Happy compiler
+
+	return 0;
+}
+
+
+// Compiled REGEXP PTYPE. It's prepared from ACTION's script once while
+// scheme preparing.
+typedef struct {
+	regex_t re;
+	char *pattern; // Source pattern for help
+	faux_argv_t *words; // Literal alternatives like "^(up|down)$"
+} klish_regexp_t;
+
+
+// Pattern is ACTION's script without leading and trailing spaces
+static char *klish_regexp_pattern(const char *script)
+{
+	const char *begin = script;
+	const char *end = NULL;
+
+	if (!script)
+		return NULL;
+	while (isspace((unsigned char)*begin))
+		begin++;
+	end = begin + strlen(begin);
+	while ((end > begin) && isspace((unsigned char)*(end - 1)))
+		end--;
+	if (end == begin)
+		return NULL;
+
+	return faux_str_dupn(begin, end - begin);
+}
+
+
+// If pattern is a simple set of literal alternatives (like "^(up|down)$")
+// then these words can be used for completion.
+static faux_argv_t *klish_regexp_words(const char *pattern)
+{
+	const char *begin = pattern;
+	const char *end = pattern + strlen(pattern);
+	const char *p = NULL;
+	faux_argv_t *words = NULL;
+
+	if ('^' == *begin)
+		begin++;
+	if ((end > begin) && ('$' == *(end - 1)))
+		end--;
+	if (((end - begin) >= 2) && ('(' == *begin) && (')' == *(end - 1))) {
+		begin++;
+		end--;
+	}
+	if (end == begin)
+		return NULL;
+	for (p = begin; p < end; p++) {
+		if (!isalnum((unsigned char)*p) && !strchr("_-|", *p))
+			return NULL;
+	}
+
+	words = faux_argv_new();
+	while (begin < end) {
+		p = begin;
+		while ((p < end) && (*p != '|'))
+			p++;
+		if (p > begin) {
+			char *word = faux_str_dupn(begin, p - begin);
+			faux_argv_add(words, word);
+			faux_str_free(word);
+		}
+		begin = p + 1;
+	}
+
+	return words;
+}
+
+
+/** @brief PREPARED_FREE: Free compiled REGEXP
+ */
+void klish_prepared_free_REGEXP(void *prepared)
+{
+	klish_regexp_t *regexp = (klish_regexp_t *)prepared;
+
+	if (!regexp)
+		return;
+
+	regfree(&regexp->re);
+	faux_str_free(regexp->pattern);
+	faux_argv_free(regexp->words);
+	faux_free(regexp);
+}
+
+
+/** @brief PREPARE: Compile REGEXP PTYPE's pattern
+ */
+void *klish_prepare_REGEXP(const char *script, faux_error_t *error)
+{
+	klish_regexp_t *regexp = NULL;
+	char *pattern = NULL;
+	int rc = 0;
+
+	pattern = klish_regexp_pattern(script);
+	if (!pattern) {
+		faux_error_sprintf(error, "Empty regular expression");
+		return NULL;
+	}
+
+	regexp = faux_zmalloc(sizeof(*regexp));
+	assert(regexp);
+	if (!regexp) {
+		faux_str_free(pattern);
+		return NULL;
+	}
+
+	rc = regcomp(&regexp->re, pattern, REG_EXTENDED);
+	if (rc != 0) {
+		char buf[256] = {};
+		regerror(rc, &regexp->re, buf, sizeof(buf));
+		faux_error_sprintf(error, "Illegal regular expression "
+			"\"%s\": %s", pattern, buf);
+		faux_str_free(pattern);
+		faux_free(regexp);
+		return NULL;
+	}
+	regexp->pattern = pattern;
+	regexp->words = klish_regexp_words(pattern);
+
+	return regexp;
+}
+
+
+// Whole value must match regular expression
+static bool_t klish_regexp_match(const regex_t *re, const char *value)
+{
+	regmatch_t match = {};
+
+	if (regexec(re, value, 1, &match, 0) != 0)
+		return BOOL_FALSE;
+	if ((match.rm_so != 0) || ((size_t)match.rm_eo != strlen(value)))
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief PTYPE: Value matches POSIX extended regular expression
+ *
+ * The pattern is compiled once while scheme preparing. The whole value
+ * must match the pattern.
+ *
+ * <ACTION sym="REGEXP">eth[0-9]+(/[0-9]+)?</ACTION>
+ */
+int klish_ptype_REGEXP(kcontext_t *context)
+{
+	const klish_regexp_t *regexp = NULL;
+	const char *value = NULL;
+	int retcode = -1;
+
+	value = kcontext_candidate_value(context);
+	if (!value)
+		return -1;
+
+	regexp = kcontext_prepared(context);
+	// ACTION was not prepared so compile pattern here
+	if (!regexp) {
+		klish_regexp_t *tmp = klish_prepare_REGEXP(
+			kcontext_script(context), NULL);
+		if (!tmp)
+			return -1;
+		retcode = klish_regexp_match(&tmp->re, value) ? 0 : -1;
+		klish_prepared_free_REGEXP(tmp);
+		return retcode;
+	}
+
+	return klish_regexp_match(&regexp->re, value) ? 0 : -1;
+}
+
+
+// Find compiled REGEXP within candidate's PTYPE. It's used by completion
+// and help functions that have their own ACTIONs.
+static const klish_regexp_t *klish_regexp_of_candidate(kcontext_t *context)
+{
+	const kentry_t *ptype = NULL;
+	kentry_actions_node_t *iter = NULL;
+	kaction_t *action = NULL;
+
+	ptype = kentry_nested_by_purpose(kcontext_candidate_entry(context),
+		KENTRY_PURPOSE_PTYPE);
+	if (!ptype)
+		return NULL;
+	iter = kentry_actions_iter(ptype);
+	while ((action = kentry_actions_each(&iter))) {
+		const ksym_t *sym = kaction_sym(action);
+		if (sym && (ksym_function(sym) == klish_ptype_REGEXP))
+			return kaction_prepared(action);
+	}
+
+	return NULL;
+}
+
+
+/** @brief COMPLETION: Literal alternatives of REGEXP
+ *
+ * Only patterns like "^(up|down)$" can generate completions.
+ */
+int klish_completion_REGEXP(kcontext_t *context)
+{
+	const klish_regexp_t *regexp = NULL;
+	faux_argv_node_t *iter = NULL;
+	const char *word = NULL;
+
+	regexp = klish_regexp_of_candidate(context);
+	if (!regexp || !regexp->words)
+		return 0;
+
+	iter = faux_argv_iter(regexp->words);
+	while ((word = faux_argv_each(&iter)))
+		printf("%s\n", word);
+
+	return 0;
+}
+
+
+/** @brief HELP: Pattern of REGEXP and parameter's description
+ *
+ * PTYPE's "help" field is used as pattern description if it's defined.
+ */
+int klish_help_REGEXP(kcontext_t *context)
+{
+	const kentry_t *entry = NULL;
+	const kentry_t *ptype = NULL;
+	const klish_regexp_t *regexp = NULL;
+	const char *prefix = NULL;
+	const char *help_text = NULL;
+
+	entry = kcontext_candidate_entry(context);
+	ptype = kentry_nested_by_purpose(entry, KENTRY_PURPOSE_PTYPE);
+	regexp = klish_regexp_of_candidate(context);
+
+	if (ptype)
+		prefix = kentry_help(ptype);
+	if (!prefix && regexp)
+		prefix = regexp->pattern;
+	if (!prefix)
+		prefix = "<REGEXP>";
+
+	help_text = kentry_help(entry);
+	if (!help_text)
+		help_text = kentry_value(entry);
+	if (!help_text)
+		help_text = kentry_name(entry);
+	assert(help_text);
+
+	printf("%s\n%s\n", prefix, help_text);
+
+	return 0;
+}
+
+
+// Network and other native PTYPEs below don't allocate memory. If value
+// is valid but is not in canonical form then the canonical form is
+// printed to stdout without trailing newline. Engine replaces argument's
+// value with PTYPE's output.
+
+// Print canonical form if it differs from original value
+static void klish_ptype_canonical(const char *value, const char *canonical)
+{
+	if (strcmp(value, canonical) != 0)
+		fputs(canonical, stdout);
+}
+
+
+// Parse prefix length like "/24". Only decimal digits are allowed.
+static bool_t klish_prefix_len(const char *str, unsigned int max,
+	unsigned int *len)
+{
+	unsigned int val = 0;
+	const char *p = str;
+
+	if (!isdigit((unsigned char)*p))
+		return BOOL_FALSE;
+	for (; *p; p++) {
+		if (!isdigit((unsigned char)*p))
+			return BOOL_FALSE;
+		val = val * 10 + (*p - '0');
+		if (val > max)
+			return BOOL_FALSE;
+	}
+	*len = val;
+
+	return BOOL_TRUE;
+}
+
+
+// Validate address with optional prefix length. Canonical address is
+// written to buf.
+static bool_t klish_inet_parse(const char *value, int af, bool_t has_prefix,
+	char *buf, size_t buf_size)
+{
+	char addr_str[INET6_ADDRSTRLEN] = {};
+	unsigned char addr[sizeof(struct in6_addr)] = {};
+	const char *slash = NULL;
+	size_t addr_len = 0;
+	unsigned int max_len = (AF_INET == af) ? 32 : 128;
+	unsigned int len = 0;
+
+	if (!value)
+		return BOOL_FALSE;
+	slash = strchr(value, '/');
+	if (has_prefix != (slash ? BOOL_TRUE : BOOL_FALSE))
+		return BOOL_FALSE;
+	addr_len = slash ? (size_t)(slash - value) : strlen(value);
+	if ((0 == addr_len) || (addr_len >= sizeof(addr_str)))
+		return BOOL_FALSE;
+	memcpy(addr_str, value, addr_len);
+	addr_str[addr_len] = '\0';
+
+	if (inet_pton(af, addr_str, addr) != 1)
+		return BOOL_FALSE;
+	if (has_prefix && !klish_prefix_len(slash + 1, max_len, &len))
+		return BOOL_FALSE;
+	if (!inet_ntop(af, addr, buf, buf_size))
+		return BOOL_FALSE;
+	if (has_prefix) {
+		size_t l = strlen(buf);
+		snprintf(buf + l, buf_size - l, "/%u", len);
+	}
+
+	return BOOL_TRUE;
+}
+
+
+static int klish_ptype_inet(kcontext_t *context, int af, bool_t has_prefix)
+{
+	const char *value = NULL;
+	char buf[INET6_ADDRSTRLEN + 5] = {}; // Address and "/128"
+
+	value = kcontext_candidate_value(context);
+	if (!klish_inet_parse(value, af, has_prefix, buf, sizeof(buf)))
+		return -1;
+	klish_ptype_canonical(value, buf);
+
+	return 0;
+}
+
 
-		// Min
-		str = faux_argv_index(argv, 0);
-		if (str) {
-			unsigned long long int min = 0;
-			if (!faux_conv_atoull(str, &min, 0) || (value < min)) {
-				faux_argv_free(argv);
+/** @brief PTYPE: IPv4 address
+ *
+ * Dotted decimal notation like "192.168.1.1".
+ */
+int klish_ptype_IPV4(kcontext_t *context)
+{
+	return klish_ptype_inet(context, AF_INET, BOOL_FALSE);
+}
+
+
+/** @brief PTYPE: IPv4 prefix
+ *
+ * Address with prefix length like "192.168.1.0/24".
+ */
+int klish_ptype_IPV4_PREFIX(kcontext_t *context)
+{
+	return klish_ptype_inet(context, AF_INET, BOOL_TRUE);
+}
+
+
+/** @brief PTYPE: IPv6 address
+ *
+ * Canonical form is compressed lowercase form (RFC 5952).
+ */
+int klish_ptype_IPV6(kcontext_t *context)
+{
+	return klish_ptype_inet(context, AF_INET6, BOOL_FALSE);
+}
+
+
+/** @brief PTYPE: IPv6 prefix
+ *
+ * Address with prefix length like "2001:db8::/32".
+ */
+int klish_ptype_IPV6_PREFIX(kcontext_t *context)
+{
+	return klish_ptype_inet(context, AF_INET6, BOOL_TRUE);
+}
+
+
+static int klish_hex_digit(char c)
+{
+	if ((c >= '0') && (c <= '9'))
+		return c - '0';
+	if ((c >= 'a') && (c <= 'f'))
+		return c - 'a' + 10;
+	if ((c >= 'A') && (c <= 'F'))
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+
+/** @brief PTYPE: MAC address
+ *
+ * Accepted forms are "aa:bb:cc:dd:ee:ff", "aa-bb-cc-dd-ee-ff",
+ * "aabb.ccdd.eeff" and "aabbccddeeff". Canonical form is
+ * "aa:bb:cc:dd:ee:ff".
+ */
+int klish_ptype_MAC(kcontext_t *context)
+{
+	const char *value = NULL;
+	size_t len = 0;
+	size_t step = 0; // Number of digits between separators
+	char sep = '\0';
+	unsigned char mac[6] = {};
+	size_t digits = 0;
+	size_t i = 0;
+	char buf[18] = {};
+
+	value = kcontext_candidate_value(context);
+	if (!value)
+		return -1;
+	len = strlen(value);
+	if (17 == len) {
+		step = 2;
+		sep = value[2];
+		if ((sep != ':') && (sep != '-'))
+			return -1;
+	} else if (14 == len) {
+		step = 4;
+		sep = '.';
+	} else if (len != 12) {
+		return -1;
+	}
+
+	for (i = 0; i < len; i++) {
+		int d = 0;
+		// Separator position
+		if (step && ((i % (step + 1)) == step)) {
+			if (value[i] != sep)
 				return -1;
-			}
+			continue;
 		}
+		d = klish_hex_digit(value[i]);
+		if (d < 0)
+			return -1;
+		mac[digits / 2] = (mac[digits / 2] << 4) | d;
+		digits++;
+	}
+	if (digits != 12)
+		return -1;
+
+	snprintf(buf, sizeof(buf), "%02x:%02x:%02x:%02x:%02x:%02x",
+		mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+	klish_ptype_canonical(value, buf);
+
+	return 0;
+}
+
+
+/** @brief PTYPE: Hexadecimal string
+ *
+ * Hex digits with optional "0x" prefix. The length is not limited so
+ * it can be used for keys too. Canonical form has lowercase digits.
+ */
+int klish_ptype_HEX(kcontext_t *context)
+{
+	const char *value = NULL;
+	const char *p = NULL;
+	bool_t is_canonical = BOOL_TRUE;
+
+	value = kcontext_candidate_value(context);
+	if (!value)
+		return -1;
+	p = value;
+	if (('0' == p[0]) && (('x' == p[1]) || ('X' == p[1]))) {
+		if ('X' == p[1])
+			is_canonical = BOOL_FALSE;
+		p += 2;
+	}
+	if ('\0' == *p)
+		return -1;
+	for (; *p; p++) {
+		if (klish_hex_digit(*p) < 0)
+			return -1;
+		if ((*p >= 'A') && (*p <= 'F'))
+			is_canonical = BOOL_FALSE;
+	}
+	if (is_canonical)
+		return 0;
+
+	for (p = value; *p; p++)
+		putchar(tolower((unsigned char)*p));
+
+	return 0;
+}
+
+
+// Parse decimal number within RANGE_LIST. Leading zeros make form
+// non-canonical.
+static const char *klish_range_list_num(const char *str,
+	unsigned long long int *num, bool_t *is_canonical)
+{
+	const char *p = str;
+	unsigned long long int val = 0;
+
+	if (!isdigit((unsigned char)*p))
+		return NULL;
+	if (('0' == p[0]) && isdigit((unsigned char)p[1]))
+		*is_canonical = BOOL_FALSE;
+	for (; isdigit((unsigned char)*p); p++) {
+		unsigned int d = *p - '0';
+		if (val > ((~0ULL - d) / 10)) // Overflow
+			return NULL;
+		val = val * 10 + d;
+	}
+	*num = val;
+
+	return p;
+}
+
+
+static bool_t klish_range_list_check(const klish_range_t *range,
+	unsigned long long int num)
+{
+	if (!range->valid)
+		return BOOL_FALSE;
+	if (range->has_min && (num < range->min.u))
+		return BOOL_FALSE;
+	if (range->has_max && (num > range->max.u))
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
 
-		// Max
-		str = faux_argv_index(argv, 1);
-		if (str) {
-			unsigned long long int max = 0;
-			if (!faux_conv_atoull(str, &max, 0) || (value > max)) {
-				faux_argv_free(argv);
+/** @brief PTYPE: List of unsigned numbers and ranges
+ *
+ * Value like "1-5,7,9-12". Optional range of allowed numbers is the
+ * same as UINT has. Canonical form has no leading zeros and single
+ * numbers instead of ranges like "7-7".
+ *
+ * <ACTION sym="RANGE_LIST">1 4094</ACTION>
+ */
+int klish_ptype_RANGE_LIST(kcontext_t *context)
+{
+	const char *value = NULL;
+	const char *p = NULL;
+	const klish_range_t *range = NULL;
+	klish_range_t tmp = {};
+	bool_t is_canonical = BOOL_TRUE;
+	bool_t first = BOOL_TRUE;
+
+	value = kcontext_candidate_value(context);
+	if (!value)
+		return -1;
+	range = klish_range(context, BOOL_FALSE, &tmp);
+
+	// Validate
+	p = value;
+	do {
+		unsigned long long int from = 0;
+		unsigned long long int to = 0;
+		if (!(p = klish_range_list_num(p, &from, &is_canonical)))
+			return -1;
+		to = from;
+		if ('-' == *p) {
+			if (!(p = klish_range_list_num(p + 1, &to, &is_canonical)))
 				return -1;
-			}
+			if (to < from)
+				return -1;
+			if (to == from)
+				is_canonical = BOOL_FALSE;
 		}
+		if (!klish_range_list_check(range, from) ||
+			!klish_range_list_check(range, to))
+			return -1;
+		if ((*p != ',') && (*p != '\0'))
+			return -1;
+	} while (*p && *(++p));
+	// Trailing comma
+	if (p[-1] == ',')
+		return -1;
+	if (is_canonical)
+		return 0;
 
-		faux_argv_free(argv);
+	// Print canonical form
+	p = value;
+	while (*p) {
+		unsigned long long int from = 0;
+		unsigned long long int to = 0;
+		p = klish_range_list_num(p, &from, &is_canonical);
+		to = from;
+		if ('-' == *p)
+			p = klish_range_list_num(p + 1, &to, &is_canonical);
+		printf("%s%llu", first ? "" : ",", from);
+		if (to != from)
+			printf("-%llu", to);
+		first = BOOL_FALSE;
+		if (',' == *p)
+			p++;
 	}
 
 	return 0;
 }
 
 
-/** @brief PTYPE: Arbitrary string
+/** @brief PTYPE: Boolean
+ *
+ * Accepts "true/false", "yes/no", "on/off", "enable/disable" and "1/0"
+ * case insensitive. Canonical form is "true" or "false".
  */
-int klish_ptype_STRING(kcontext_t *context)
+int klish_ptype_BOOL(kcontext_t *context)
 {
-	// Really any string is a ... (surprise!) string
+	const char *value = NULL;
+	const char *true_str[] = {"true", "yes", "on", "enable", "1", NULL};
+	const char *false_str[] = {"false", "no", "off", "disable", "0", NULL};
+	size_t i = 0;
 
+	value = kcontext_candidate_value(context);
+	if (!value)
+		return -1;
+
+	for (i = 0; true_str[i]; i++) {
+		if (faux_str_casecmp(value, true_str[i]) == 0) {
+			klish_ptype_canonical(value, "true");
+			return 0;
+		}
+	}
+	for (i = 0; false_str[i]; i++) {
+		if (faux_str_casecmp(value, false_str[i]) == 0) {
+			klish_ptype_canonical(value, "false");
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+
+/** @brief COMPLETION: Canonical values of BOOL
+ */
+int klish_completion_BOOL(kcontext_t *context)
+{
 	context = context; // Happy compiler
 
+	printf("true\nfalse\n");
+
 	return 0;
 }
+
+
+// Help line for native PTYPEs. The PTYPE's "help" field overrides default
+// description of value format.
+static int klish_help_ptype(kcontext_t *context, const char *format)
+{
+	const kentry_t *entry = NULL;
+	const kentry_t *ptype = NULL;
+	const char *prefix = NULL;
+	const char *help_text = NULL;
+
+	entry = kcontext_candidate_entry(context);
+	ptype = kentry_nested_by_purpose(entry, KENTRY_PURPOSE_PTYPE);
+	if (ptype)
+		prefix = kentry_help(ptype);
+	if (!prefix)
+		prefix = format;
+
+	help_text = kentry_help(entry);
+	if (!help_text)
+		help_text = kentry_value(entry);
+	if (!help_text)
+		help_text = kentry_name(entry);
+	assert(help_text);
+
+	printf("%s\n%s\n", prefix, help_text);
+
+	return 0;
+}
+
+
+/** @brief HELP: IPv4 address
+ */
+int klish_help_IPV4(kcontext_t *context)
+{
+	return klish_help_ptype(context, "A.B.C.D");
+}
+
+
+/** @brief HELP: IPv4 prefix
+ */
+int klish_help_IPV4_PREFIX(kcontext_t *context)
+{
+	return klish_help_ptype(context, "A.B.C.D/M");
+}
+
+
+/** @brief HELP: IPv6 address
+ */
+int klish_help_IPV6(kcontext_t *context)
+{
+	return klish_help_ptype(context, "X:X::X:X");
+}
+
+
+/** @brief HELP: IPv6 prefix
+ */
+int klish_help_IPV6_PREFIX(kcontext_t *context)
+{
+	return klish_help_ptype(context, "X:X::X:X/M");
+}
+
+
+/** @brief HELP: MAC address
+ */
+int klish_help_MAC(kcontext_t *context)
+{
+	return klish_help_ptype(context, "HH:HH:HH:HH:HH:HH");
+}
+
+
+/** @brief HELP: Hexadecimal string
+ */
+int klish_help_HEX(kcontext_t *context)
+{
+	return klish_help_ptype(context, "<HEX>");
+}
+
+
+/** @brief HELP: List of numbers and ranges
+ */
+int klish_help_RANGE_LIST(kcontext_t *context)
+{
+	return klish_help_ptype(context, "<N[-M][,...]>");
+}
+
+
+/** @brief HELP: Boolean
+ */
+int klish_help_BOOL(kcontext_t *context)
+{
+	return klish_help_ptype(context, "true|false");
+}
@@ -20,12 +20,15 @@ const uint8_t kplugin_script_minor = KPLUGIN_MINOR;
 int kplugin_script_init(kcontext_t *context)
 {
 	kplugin_t *plugin = NULL;
+	ksym_t *sym = NULL;
 
 	assert(context);
 	plugin = kcontext_plugin(context);
 	assert(plugin);
 
-	kplugin_add_syms(plugin, ksym_new("script", script_script));
+	sym = ksym_new("script", script_script);
+	ksym_set_spawn(sym, script_spawn);
+	kplugin_add_syms(plugin, sym);
 
 	return 0;
 }
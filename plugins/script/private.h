@@ -7,11 +7,13 @@
 
 #include <faux/faux.h>
 #include <klish/kcontext_base.h>
+#include <klish/kspawn.h>
 
 
 C_DECL_BEGIN
 
 int script_script(kcontext_t *context);
+bool_t script_spawn(kcontext_t *context, kspawn_t *spawn);
 
 C_DECL_END
 
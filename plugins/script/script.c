@@ -12,6 +12,7 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <limits.h>
 #include <syslog.h>
@@ -20,6 +21,7 @@
 #include <faux/list.h>
 #include <klish/kcontext.h>
 #include <klish/ksession.h>
+#include <klish/kspawn.h>
 
 
 const char *kcontext_type_e_str[] = {
@@ -34,7 +36,20 @@ const char *kcontext_type_e_str[] = {
 #define OVERWRITE 1
 
 
-static bool_t populate_env_kpargv(const kpargv_t *pargv, const char *prefix)
+// Sets variable for spawn request or for current process if request is
+// not specified
+static void script_setenv(kspawn_t *spawn, const char *name,
+	const char *value)
+{
+	if (spawn)
+		kspawn_setenv(spawn, name, value);
+	else
+		setenv(name, value, OVERWRITE);
+}
+
+
+static bool_t populate_env_kpargv(kspawn_t *spawn, const kpargv_t *pargv,
+	const char *prefix)
 {
 	const kentry_t *cmd = NULL;
 	faux_list_node_t *iter = NULL;
@@ -47,7 +62,7 @@ static bool_t populate_env_kpargv(const kpargv_t *pargv, const char *prefix)
 	cmd = kpargv_command(pargv);
 	if (cmd) {
 		char *var = faux_str_sprintf("%sCOMMAND", prefix);
-		setenv(var, kentry_name(cmd), OVERWRITE);
+		script_setenv(spawn, var, kentry_name(cmd));
 		faux_str_free(var);
 	}
 
@@ -84,12 +99,12 @@ static bool_t populate_env_kpargv(const kpargv_t *pargv, const char *prefix)
 			if (num == 0) {
 				var = faux_str_sprintf("%sPARAM_%s",
 					prefix, kentry_name(entry));
-				setenv(var, value, OVERWRITE);
+				script_setenv(spawn, var, value);
 				faux_str_free(var);
 			}
 			var = faux_str_sprintf("%sPARAM_%s_%u",
 				prefix, kentry_name(entry), num);
-			setenv(var, value, OVERWRITE);
+			script_setenv(spawn, var, value);
 			faux_str_free(var);
 			num++;
 		}
@@ -99,7 +114,7 @@ static bool_t populate_env_kpargv(const kpargv_t *pargv, const char *prefix)
 }
 
 
-static bool_t populate_env(kcontext_t *context)
+static bool_t populate_env(kspawn_t *spawn, kcontext_t *context)
 {
 	kcontext_type_e type = KCONTEXT_TYPE_NONE;
 	const kentry_t *entry = NULL;
@@ -116,23 +131,23 @@ static bool_t populate_env(kcontext_t *context)
 	type = kcontext_type(context);
 	if (type >= KCONTEXT_TYPE_MAX)
 		type = KCONTEXT_TYPE_NONE;
-	setenv(PREFIX"TYPE", kcontext_type_e_str[type], OVERWRITE);
+	script_setenv(spawn, PREFIX"TYPE", kcontext_type_e_str[type]);
 
 	// Candidate
 	entry = kcontext_candidate_entry(context);
 	if (entry)
-		setenv(PREFIX"CANDIDATE", kentry_name(entry), OVERWRITE);
+		script_setenv(spawn, PREFIX"CANDIDATE", kentry_name(entry));
 
 	// Value
 	str = kcontext_candidate_value(context);
 	if (str)
-		setenv(PREFIX"VALUE", str, OVERWRITE);
+		script_setenv(spawn, PREFIX"VALUE", str);
 
 	// PID
 	pid = ksession_pid(session);
 	if (pid != -1) {
 		char *t = faux_str_sprintf("%lld", (long long int)pid);
-		setenv(PREFIX"PID", t, OVERWRITE);
+		script_setenv(spawn, PREFIX"PID", t);
 		faux_str_free(t);
 	}
 
@@ -140,23 +155,24 @@ static bool_t populate_env(kcontext_t *context)
 	uid = ksession_uid(session);
 	if (uid != -1) {
 		char *t = faux_str_sprintf("%lld", (long long int)uid);
-		setenv(PREFIX"UID", t, OVERWRITE);
+		script_setenv(spawn, PREFIX"UID", t);
 		faux_str_free(t);
 	}
 
 	// User
 	str = ksession_user(session);
 	if (str) {
-		setenv(PREFIX"USER", str, OVERWRITE);
-		setenv("USER", str, OVERWRITE);
-		setenv("LOGNAME", str, OVERWRITE);
+		script_setenv(spawn, PREFIX"USER", str);
+		script_setenv(spawn, "USER", str);
+		script_setenv(spawn, "LOGNAME", str);
 	}
 
 	// Parameters
-	populate_env_kpargv(kcontext_pargv(context), PREFIX);
+	populate_env_kpargv(spawn, kcontext_pargv(context), PREFIX);
 
 	// Parent parameters
-	populate_env_kpargv(kcontext_parent_pargv(context), PREFIX"PARENT_");
+	populate_env_kpargv(spawn, kcontext_parent_pargv(context),
+		PREFIX"PARENT_");
 
 	return BOOL_TRUE;
 }
@@ -247,7 +263,7 @@ int script_script(kcontext_t *context)
 		int ngroups = NGROUPS_MAX;
 		int res;
 
-		populate_env(context);
+		populate_env(NULL, context);
 		setgroups(0, NULL);
 
 		// Get supplementary groups
@@ -292,3 +308,61 @@ int script_script(kcontext_t *context)
 
 	return -1;
 }
+
+
+// Fill spawn request to execute script without forking session process.
+// Script is placed to in-memory file and executed by its /proc path so no
+// temporary file needs to be removed after execution.
+bool_t script_spawn(kcontext_t *context, kspawn_t *spawn)
+{
+	const ksession_t *session = NULL;
+	const char *script = NULL;
+	char *shebang = NULL;
+	char *content = NULL;
+	char *path = NULL;
+	size_t len = 0;
+	int fd = -1;
+
+	assert(context);
+	session = kcontext_session(context);
+	assert(session);
+
+	script = kcontext_script(context);
+	if (faux_str_is_empty(script))
+		return BOOL_FALSE;
+	if (!ksession_user(session))
+		return BOOL_FALSE;
+
+#ifdef MFD_CLOEXEC
+	// Descriptor must be inherited by child. Interpreter opens script by
+	// /proc path.
+	fd = memfd_create("klish-script", 0);
+#endif
+	if (fd < 0)
+		return BOOL_FALSE;
+	kspawn_own_fd(spawn, fd);
+
+	shebang = find_out_shebang(script);
+	content = faux_str_sprintf("#!%s\n%s\n", shebang, script);
+	faux_str_free(shebang);
+	len = strlen(content);
+	if (write(fd, content, len) != (ssize_t)len) {
+		faux_str_free(content);
+		return BOOL_FALSE;
+	}
+	faux_str_free(content);
+
+	path = faux_str_sprintf("/proc/self/fd/%d", fd);
+	kspawn_set_path(spawn, path);
+	kspawn_add_arg(spawn, path);
+	faux_str_free(path);
+	kspawn_add_fd(spawn, fd, fd);
+
+	populate_env(spawn, context);
+	kspawn_set_user(spawn, ksession_user(session),
+		ksession_uid(session), ksession_gid(session));
+	// Script's stderr is redirected to stdout
+	kspawn_add_fd(spawn, kcontext_stdout(context), STDERR_FILENO);
+
+	return BOOL_TRUE;
+}
@@ -0,0 +1,58 @@
+#!/bin/sh
+# Programs executed by ACTIONs must not inherit descriptors of klishd and
+# session: client socket, event loop descriptors, pipes of other stages.
+# Only stdin, stdout, stderr and the script itself can be open. Script is
+# opened by interpreter from in-memory file (memfd) or from /tmp/klish.*
+# temporary file.
+
+. "${top_srcdir:-.}/tests/common.sh"
+
+# Prints descriptors those are not allowed. Input is "ls -l" output.
+leaked_fds()
+{
+	awk '{
+		for (i = 1; i < NF; i++)
+			if ($i == "->")
+				break;
+		if (i >= NF)
+			next;
+		fd = $(i - 1); target = $(i + 1);
+		if (fd == "0" || fd == "1" || fd == "2")
+			next;
+		if (target ~ /klish-script/ || target ~ /^\/tmp\/klish\./)
+			next;
+		print fd " -> " target;
+	}'
+}
+
+check_fds()
+{
+	local cmd="$1"
+	local out=""
+	local leaked=""
+
+	out=$(klish_cmd "${cmd}")
+	if ! echo "${out}" | grep -q ' -> '; then
+		echo "FAIL: ${cmd}: no descriptors listed"
+		echo "${out}"
+		return 1
+	fi
+	leaked=$(echo "${out}" | leaked_fds)
+	if [ -n "${leaked}" ]; then
+		echo "FAIL: ${cmd}: leaked descriptors:"
+		echo "${leaked}"
+		return 1
+	fi
+	echo "OK: ${cmd}"
+
+	return 0
+}
+
+start_klishd
+
+rc=0
+check_fds "fds" || rc=1
+check_fds "fds_sync" || rc=1
+check_fds "fds | include ." || rc=1
+
+exit ${rc}
@@ -0,0 +1,109 @@
+# Common part of klish integration tests. It's sourced by test scripts.
+# Test starts its own klishd and gets output of commands by klish client.
+# The exit codes follow automake convention: 77 - skipped, 99 - hard error.
+
+top_builddir=${top_builddir:-.}
+top_srcdir=${top_srcdir:-.}
+
+KLISHD="${top_builddir}/bin/klishd/klishd"
+KLISH="${top_builddir}/bin/klish/klish"
+LIBS_DIR="${top_builddir}/.libs"
+
+# Plugins and DBs are loaded by dlopen() from build tree
+LD_LIBRARY_PATH="${LIBS_DIR}${LD_LIBRARY_PATH:+:${LD_LIBRARY_PATH}}"
+export LD_LIBRARY_PATH
+
+DB=""
+for db in libxml2 expat roxml; do
+	if [ -e "${LIBS_DIR}/libklish-db-${db}.so" ]; then
+		DB="${db}"
+		break
+	fi
+done
+if [ -z "${DB}" ]; then
+	echo "No XML DB plugin is built"
+	exit 77
+fi
+
+TEST_DIR=$(mktemp -d /tmp/klish-test.XXXXXX) || exit 99
+SOCKET="${TEST_DIR}/klish-unix-socket"
+KLISHD_PID=""
+
+cleanup()
+{
+	if [ -n "${KLISHD_PID}" ]; then
+		kill "${KLISHD_PID}" 2>/dev/null
+		wait "${KLISHD_PID}" 2>/dev/null
+	fi
+	rm -rf "${TEST_DIR}"
+}
+trap cleanup EXIT
+trap 'exit 99' INT TERM
+
+# Scheme directory. Test can set another one before klishd start.
+TEST_XML="${top_srcdir}/tests/xml"
+
+# Writes klishd config. Arguments are additional lines of config.
+klishd_conf()
+{
+	cat > "${TEST_DIR}/klishd.conf" <<CONF
+UnixSocketPath=${SOCKET}
+LockFile=${TEST_DIR}/klish-lock
+DBs=${DB}
+DB.${DB}.XMLPath=${TEST_XML};${top_srcdir}/plugins/klish/xml
+CONF
+	for line in "$@"; do
+		echo "${line}" >> "${TEST_DIR}/klishd.conf"
+	done
+}
+
+# Starts klishd. Arguments are additional lines of klishd config.
+start_klishd()
+{
+	local i=0
+
+	klishd_conf "$@"
+	cat > "${TEST_DIR}/klish.conf" <<CONF
+UnixSocketPath=${SOCKET}
+UsePager=n
+CONF
+
+	"${KLISHD}" -d -f "${TEST_DIR}/klishd.conf" \
+		-p "${TEST_DIR}/klishd.pid" &
+	KLISHD_PID=$!
+	while [ ! -S "${SOCKET}" ]; do
+		i=$((i + 1))
+		if [ ${i} -gt 50 ]; then
+			echo "Can't start klishd"
+			exit 99
+		fi
+		sleep 0.1
+	done
+}
+
+# Executes command by klish client. Output goes to stdout.
+klish_cmd()
+{
+	"${KLISH}" -f "${TEST_DIR}/klish.conf" -c "$1"
+}
+
+# Compares output of command with expected one
+check_output()
+{
+	local cmd="$1"
+	local expected="$2"
+	local out=""
+
+	out=$(klish_cmd "${cmd}")
+	if [ "${out}" != "${expected}" ]; then
+		echo "FAIL: ${cmd}"
+		echo "Expected:"
+		echo "${expected}"
+		echo "Got:"
+		echo "${out}"
+		return 1
+	fi
+	echo "OK: ${cmd}"
+
+	return 0
+}
@@ -0,0 +1,22 @@
+#!/bin/sh
+# Output of filtered command arrives in several small chunks. Coalescing
+# holds filtered output between chunks so held output must not be passed
+# through the filters again. Last line is split between chunks.
+
+. "${top_srcdir:-.}/tests/common.sh"
+
+start_klishd "OutputCoalesceBytes=4096" "OutputCoalesceDelay=1000"
+
+rc=0
+check_output "chunks | include foo" "foo1
+foo2
+foo3
+foo4" || rc=1
+check_output "chunks | exclude bar" "foo1
+foo2
+foo3
+foo4" || rc=1
+check_output "chunks | count" "7" || rc=1
+check_output "chunks | include foo | count" "4" || rc=1
+
+exit ${rc}
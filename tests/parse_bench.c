@@ -0,0 +1,314 @@
+/** @file parse_bench.c
+ *
+ * @brief Stress benchmark of command line parser.
+ *
+ * Scheme has nested SWITCH and SEQUENCE containers. Each SWITCH has many
+ * alternatives. Every alternative is a SEQUENCE that starts with link to
+ * the same group of optional non-keyword parameters and ends with keyword.
+ * So parser tries the same parameters at the same argv position while it
+ * walks through alternatives. Benchmark prints packrat memo hit rate and
+ * parsing time for each line.
+ *
+ * The "klish" plugin is loaded by dlopen() so run it from build tree like
+ * this:
+ * LD_LIBRARY_PATH=.libs tests/parse_bench [iterations] [alternatives]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <faux/str.h>
+#include <faux/argv.h>
+#include <faux/error.h>
+#include <klish/kscheme.h>
+#include <klish/kentry.h>
+#include <klish/kaction.h>
+#include <klish/kplugin.h>
+#include <klish/kcontext.h>
+#include <klish/kpargv.h>
+#include <klish/ksession.h>
+#include <klish/ksession_parse.h>
+
+
+#define OPTS_NUM 8 // Optional UINT parameters within group
+#define DEPTH 3 // Levels of nested SWITCHes
+#define DEFAULT_ITERATIONS 1000
+#define DEFAULT_ALTS 16 // Alternatives within each SWITCH
+
+
+static kentry_t *bench_entry(const char *name, kentry_mode_e mode,
+	bool_t container, size_t min)
+{
+	kentry_t *entry = kentry_new(name);
+
+	kentry_set_mode(entry, mode);
+	kentry_set_container(entry, container);
+	kentry_set_min(entry, min);
+
+	return entry;
+}
+
+
+// Link to ENTRY by its path
+static kentry_t *bench_link(kentry_t *parent, const char *name,
+	const char *ref, kentry_purpose_e purpose)
+{
+	kentry_t *entry = kentry_new(name);
+
+	kentry_set_purpose(entry, purpose);
+	kentry_set_ref_str(entry, ref);
+	kentry_add_entrys(parent, entry);
+
+	return entry;
+}
+
+
+static kentry_t *bench_ptype(const char *name, const char *sym)
+{
+	kentry_t *ptype = bench_entry(name, KENTRY_MODE_SEQUENCE, BOOL_TRUE, 1);
+	kaction_t *action = kaction_new();
+
+	kentry_set_purpose(ptype, KENTRY_PURPOSE_PTYPE);
+	kentry_set_order(ptype, BOOL_TRUE);
+	kaction_set_sym_ref(action, sym);
+	kentry_add_actions(ptype, action);
+
+	return ptype;
+}
+
+
+// Group of optional parameters shared by all alternatives. Parameters
+// are not keywords so parser can't skip them by keyword index.
+static kentry_t *bench_opts(void)
+{
+	kentry_t *opts = bench_entry("OPTS", KENTRY_MODE_SEQUENCE, BOOL_TRUE, 1);
+	size_t i = 0;
+
+	for (i = 0; i < OPTS_NUM; i++) {
+		char *name = faux_str_sprintf("opt%zu", i);
+		kentry_t *param = bench_entry(name, KENTRY_MODE_SEQUENCE,
+			BOOL_FALSE, 0);
+		faux_str_free(name);
+		bench_link(param, "__ptype", "/UINT", KENTRY_PURPOSE_PTYPE);
+		kentry_add_entrys(opts, param);
+	}
+
+	return opts;
+}
+
+
+// Optional link to group of optional parameters. Link must be a container
+// because it has no PTYPE.
+static void bench_opts_link(kentry_t *parent)
+{
+	kentry_t *link = bench_link(parent, "opts", "/OPTS",
+		KENTRY_PURPOSE_COMMON);
+
+	kentry_set_container(link, BOOL_TRUE);
+	kentry_set_min(link, 0);
+}
+
+
+// SWITCH of alternatives. Each alternative is SEQUENCE of shared optional
+// parameters and keyword. Keyword has nested SWITCH on next levels and
+// shared optional parameters on the last level.
+static void bench_switch(kentry_t *parent, size_t alts, size_t depth)
+{
+	kentry_t *sw = bench_entry("alt", KENTRY_MODE_SWITCH, BOOL_TRUE, 1);
+	size_t i = 0;
+
+	for (i = 0; i < alts; i++) {
+		char *name = faux_str_sprintf("seq%zu", i);
+		kentry_t *seq = bench_entry(name, KENTRY_MODE_SEQUENCE,
+			BOOL_TRUE, 1);
+		kentry_t *kw = NULL;
+
+		faux_str_free(name);
+		bench_opts_link(seq);
+		name = faux_str_sprintf("end%zu", i);
+		kw = bench_entry(name, KENTRY_MODE_SEQUENCE, BOOL_FALSE, 1);
+		faux_str_free(name);
+		bench_link(kw, "__ptype", "/COMMAND", KENTRY_PURPOSE_PTYPE);
+		if (depth > 1)
+			bench_switch(kw, alts, depth - 1);
+		else
+			bench_opts_link(kw);
+		kentry_add_entrys(seq, kw);
+		kentry_add_entrys(sw, seq);
+	}
+	kentry_add_entrys(parent, sw);
+}
+
+
+static kscheme_t *bench_scheme(size_t alts, faux_error_t *error)
+{
+	kscheme_t *scheme = kscheme_new();
+	kentry_t *view = NULL;
+	kentry_t *cmd = NULL;
+	kaction_t *action = NULL;
+	kcontext_t *context = NULL;
+	bool_t retcode = BOOL_FALSE;
+
+	kscheme_add_plugins(scheme, kplugin_new("klish"));
+	kscheme_add_entrys(scheme, bench_ptype("COMMAND", "COMMAND@klish"));
+	kscheme_add_entrys(scheme, bench_ptype("UINT", "UINT@klish"));
+	kscheme_add_entrys(scheme, bench_opts());
+
+	view = bench_entry("main", KENTRY_MODE_SWITCH, BOOL_TRUE, 1);
+	cmd = bench_entry("cmd", KENTRY_MODE_SEQUENCE, BOOL_FALSE, 1);
+	bench_link(cmd, "__ptype", "/COMMAND", KENTRY_PURPOSE_PTYPE);
+	action = kaction_new();
+	kaction_set_sym_ref(action, "nop@klish");
+	kentry_add_actions(cmd, action);
+	bench_switch(cmd, alts, DEPTH);
+	kentry_add_entrys(view, cmd);
+	kscheme_add_entrys(scheme, view);
+
+	context = kcontext_new(KCONTEXT_TYPE_PLUGIN_INIT);
+	kcontext_set_scheme(context, scheme);
+	retcode = kscheme_prepare(scheme, context, error);
+	kcontext_free(context);
+	if (!retcode) {
+		kscheme_free(scheme);
+		return NULL;
+	}
+
+	return scheme;
+}
+
+
+static void bench_scheme_free(kscheme_t *scheme)
+{
+	kcontext_t *context = kcontext_new(KCONTEXT_TYPE_PLUGIN_FINI);
+
+	kcontext_set_scheme(context, scheme);
+	kscheme_fini(scheme, context, NULL);
+	kcontext_free(context);
+	kscheme_free(scheme);
+}
+
+
+static const char *bench_status(kpargv_status_e status)
+{
+	switch (status) {
+	case KPARSE_OK:
+		return "OK";
+	case KPARSE_NOTFOUND:
+		return "NOTFOUND";
+	case KPARSE_ERROR:
+		return "ERROR";
+	case KPARSE_NOACTION:
+		return "NOACTION";
+	default:
+		break;
+	}
+
+	return "UNKNOWN";
+}
+
+
+static double bench_now(void)
+{
+	struct timespec ts = {};
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+
+// Parses line many times. Returns BOOL_FALSE if result is unexpected.
+static bool_t bench_line(ksession_t *session, const char *line,
+	kpargv_status_e expected, size_t iterations)
+{
+	faux_argv_t *argv = faux_argv_new();
+	size_t i = 0;
+	size_t hits = 0;
+	size_t misses = 0;
+	size_t stored = 0;
+	kpargv_status_e status = KPARSE_NONE;
+	double start = 0;
+	double elapsed = 0;
+
+	faux_argv_parse(argv, line);
+	start = bench_now();
+	for (i = 0; i < iterations; i++) {
+		kpargv_t *pargv = ksession_parse_line(session, argv,
+			KPURPOSE_EXEC, BOOL_FALSE);
+		status = kpargv_status(pargv);
+		hits = kpargv_memo_hits(pargv);
+		misses = kpargv_memo_misses(pargv);
+		stored = kpargv_memo_len(pargv);
+		kpargv_free(pargv);
+	}
+	elapsed = bench_now() - start;
+	faux_argv_free(argv);
+
+	printf("%-8s %6zu %6zu %6zu %6.1f%% %10.2f  %s\n",
+		bench_status(status), hits, misses, stored,
+		(hits + misses) ? (100.0 * hits / (hits + misses)) : 0.0,
+		elapsed * 1000000.0 / iterations, line);
+
+	return (status == expected) ? BOOL_TRUE : BOOL_FALSE;
+}
+
+
+int main(int argc, char **argv)
+{
+	size_t iterations = DEFAULT_ITERATIONS;
+	size_t alts = DEFAULT_ALTS;
+	faux_error_t *error = faux_error_new();
+	kscheme_t *scheme = NULL;
+	ksession_t *session = NULL;
+	char *last = NULL;
+	char *deep = NULL;
+	char *wrong = NULL;
+	int retval = 0;
+
+	if (argc > 1)
+		iterations = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		alts = strtoul(argv[2], NULL, 0);
+	if ((0 == iterations) || (0 == alts)) {
+		fprintf(stderr, "Usage: %s [iterations] [alternatives]\n",
+			argv[0]);
+		return -1;
+	}
+
+	scheme = bench_scheme(alts, error);
+	if (!scheme) {
+		fprintf(stderr, "Error: Can't prepare scheme\n");
+		faux_error_show(error);
+		faux_error_free(error);
+		return -1;
+	}
+	session = ksession_new(scheme, "main");
+
+	// Last alternative on each level is the worst case
+	last = faux_str_sprintf("end%zu", alts - 1);
+	deep = faux_str_sprintf("cmd %s %s %s 1 2 3", last, last, last);
+	wrong = faux_str_sprintf("cmd %s %s wrong", last, last);
+
+	printf("Alternatives: %zu, depth: %d, iterations: %zu\n",
+		alts, DEPTH, iterations);
+	printf("%-8s %6s %6s %6s %7s %10s  %s\n",
+		"Status", "Hits", "Misses", "Stored", "Rate", "Usec/parse",
+		"Line");
+	if (!bench_line(session, "cmd end0 end0 end0", KPARSE_OK, iterations))
+		retval = -1;
+	if (!bench_line(session, deep, KPARSE_OK, iterations))
+		retval = -1;
+	if (!bench_line(session, wrong, KPARSE_ERROR, iterations))
+		retval = -1;
+
+	faux_str_free(last);
+	faux_str_free(deep);
+	faux_str_free(wrong);
+	ksession_free(session);
+	bench_scheme_free(scheme);
+	faux_error_free(error);
+
+	return retval;
+}
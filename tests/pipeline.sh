@@ -0,0 +1,57 @@
+#!/bin/sh
+# Pipelined commands from file (klish -p). Output of commands must be in
+# order of lines even if the first command is slow and the next ones are
+# already sent. With stop-on-error (-e) the commands after the failed one
+# must be skipped even if they are already queued by server.
+
+. "${top_srcdir:-.}/tests/common.sh"
+
+# Executes commands from file with pipeline depth 4
+klish_file()
+{
+	"${KLISH}" -f "${TEST_DIR}/klish.conf" -q -p 4 "$@" "${TEST_DIR}/cmds"
+}
+
+start_klishd
+
+cat > "${TEST_DIR}/cmds" <<CMDS
+delay one
+say two
+fail three
+say four
+say five
+CMDS
+
+rc=0
+
+out=$(klish_file)
+expected="one
+two
+three
+four
+five"
+if [ "${out}" != "${expected}" ]; then
+	echo "FAIL: pipelined commands"
+	echo "Got:"
+	echo "${out}"
+	rc=1
+else
+	echo "OK: pipelined commands"
+fi
+
+out=$(klish_file -e)
+retcode=$?
+expected="one
+two
+three"
+if [ "${out}" != "${expected}" ] || [ ${retcode} -eq 0 ]; then
+	echo "FAIL: pipelined commands with stop-on-error"
+	echo "Retcode: ${retcode}"
+	echo "Got:"
+	echo "${out}"
+	rc=1
+else
+	echo "OK: pipelined commands with stop-on-error"
+fi
+
+exit ${rc}
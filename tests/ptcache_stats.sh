@@ -0,0 +1,20 @@
+#!/bin/sh
+# Statistics of PTYPE validation cache can be requested by operator.
+# Command line itself is validated before command is executed so cache
+# is not empty.
+
+. "${top_srcdir:-.}/tests/common.sh"
+
+start_klishd
+
+out=$(klish_cmd "ptcache")
+echo "${out}" | grep -qE '^PTYPE cache: [0-9]+ hits, [0-9]+ misses \([0-9]+% hit rate\), [1-9][0-9]* of [0-9]+ slots used$'
+if [ $? -ne 0 ]; then
+	echo "FAIL: ptcache"
+	echo "Got:"
+	echo "${out}"
+	exit 1
+fi
+echo "OK: ptcache"
+
+exit 0
@@ -0,0 +1,112 @@
+#!/bin/sh
+# Scheme reload by SIGHUP. New sessions get new scheme while existing
+# session keeps the old one. It's checked for all kinds of service
+# processes: per-session, pre-forked pool and shared ones.
+
+. "${top_srcdir:-.}/tests/common.sh"
+
+TEST_XML="${TEST_DIR}/xml"
+mkdir "${TEST_XML}" || exit 99
+
+# Writes scheme with "version" command printing given string
+write_scheme()
+{
+	local version="$1"
+
+	cat > "${TEST_XML}/reload.xml" <<XML
+<?xml version="1.0" encoding="UTF-8"?>
+<KLISH
+	xmlns="https://klish.libcode.org/klish3"
+	xmlns:xsi="http://www.w3.org/2001/XMLSchema-instance"
+	xsi:schemaLocation="https://src.libcode.org/pkun/klish/src/master/klish.xsd">
+
+<PLUGIN name="klish"/>
+<PLUGIN name="script"/>
+
+<VIEW name="main">
+
+<COMMAND name="version" help="Print scheme version">
+	<ACTION sym="script">echo ${version}</ACTION>
+</COMMAND>
+
+</VIEW>
+
+</KLISH>
+XML
+}
+
+stop_klishd()
+{
+	kill "${KLISHD_PID}" 2>/dev/null
+	wait "${KLISHD_PID}" 2>/dev/null
+	KLISHD_PID=""
+	rm -f "${SOCKET}"
+}
+
+# Arguments are additional lines of klishd config
+check_reload()
+{
+	local mode="${*:-per-session}"
+	local i=0
+	local res=0
+
+	write_scheme old
+	start_klishd "$@"
+
+	# Existing session
+	rm -f "${TEST_DIR}/fifo" "${TEST_DIR}/out"
+	mkfifo "${TEST_DIR}/fifo" || exit 99
+	"${KLISH}" -f "${TEST_DIR}/klish.conf" -q < "${TEST_DIR}/fifo" \
+		> "${TEST_DIR}/out" &
+	CLIENT_PID=$!
+	exec 3> "${TEST_DIR}/fifo"
+	echo "version" >&3
+	while [ ! -s "${TEST_DIR}/out" ]; do
+		i=$((i + 1))
+		if [ ${i} -gt 50 ]; then
+			echo "Session doesn't answer (${mode})"
+			exit 99
+		fi
+		sleep 0.1
+	done
+
+	write_scheme new
+	i=0
+	kill -HUP "${KLISHD_PID}"
+	while [ "$(klish_cmd version)" != "new" ]; do
+		i=$((i + 1))
+		if [ ${i} -gt 50 ]; then
+			echo "FAIL: new session doesn't get new scheme (${mode})"
+			res=1
+			break
+		fi
+		sleep 0.1
+	done
+	if [ ${i} -le 50 ]; then
+		echo "OK: new session gets new scheme (${mode})"
+	fi
+
+	echo "version" >&3
+	exec 3>&-
+	wait "${CLIENT_PID}"
+	if [ "$(cat "${TEST_DIR}/out")" != "old
+old" ]; then
+		echo "FAIL: existing session doesn't keep old scheme (${mode})"
+		cat "${TEST_DIR}/out"
+		res=1
+	else
+		echo "OK: existing session keeps old scheme (${mode})"
+	fi
+
+	stop_klishd
+
+	return ${res}
+}
+
+rc=0
+
+check_reload || rc=1
+check_reload "ServicePool=2" || rc=1
+check_reload "ServiceProcesses=1" || rc=1
+
+exit ${rc}
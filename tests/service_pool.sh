@@ -0,0 +1,59 @@
+#!/bin/sh
+# Pool of pre-forked service processes (ServicePool). The listen daemon
+# keeps the specified number of idle processes. Process that accepts the
+# connection is replaced by new idle one.
+
+. "${top_srcdir:-.}/tests/common.sh"
+
+if ! command -v pgrep >/dev/null 2>&1; then
+	echo "No pgrep utility"
+	exit 77
+fi
+
+# Waits till listen daemon has specified number of children
+wait_children()
+{
+	local num="$1"
+	local i=0
+
+	while [ "$(pgrep -P "${KLISHD_PID}" | wc -l)" -ne "${num}" ]; do
+		i=$((i + 1))
+		if [ ${i} -gt 50 ]; then
+			echo "FAIL: $2"
+			echo "Expected ${num} service processes, got" \
+				"$(pgrep -P "${KLISHD_PID}" | wc -l)"
+			return 1
+		fi
+		sleep 0.1
+	done
+	echo "OK: $2"
+
+	return 0
+}
+
+start_klishd "ServicePool=2"
+
+rc=0
+wait_children 2 "pool is filled" || rc=1
+
+# Session stays connected while klish reads commands from the fifo
+mkfifo "${TEST_DIR}/fifo" || exit 99
+"${KLISH}" -f "${TEST_DIR}/klish.conf" -q < "${TEST_DIR}/fifo" \
+	> "${TEST_DIR}/out" &
+CLIENT_PID=$!
+exec 3> "${TEST_DIR}/fifo"
+echo "say one" >&3
+wait_children 3 "pool is refilled after connection" || rc=1
+
+check_output "say two" "two" || rc=1
+
+exec 3>&-
+wait "${CLIENT_PID}"
+wait_children 2 "service process exits with session" || rc=1
+if [ "$(cat "${TEST_DIR}/out")" != "one" ]; then
+	echo "FAIL: output of connected session"
+	cat "${TEST_DIR}/out"
+	rc=1
+fi
+
+exit ${rc}
@@ -0,0 +1,75 @@
+#!/bin/sh
+# Shared service processes (ServiceProcesses). Single process serves many
+# sessions. The session must not wait for slow ACTION of another session.
+# Scheme with ACTIONs those block service process is refused.
+
+. "${top_srcdir:-.}/tests/common.sh"
+
+if ! command -v pgrep >/dev/null 2>&1; then
+	echo "No pgrep utility"
+	exit 77
+fi
+
+rc=0
+
+# Test scheme has sync script ACTION
+klishd_conf "ServiceProcesses=1"
+"${KLISHD}" -d -f "${TEST_DIR}/klishd.conf" -p "${TEST_DIR}/klishd.pid" \
+	> /dev/null 2>&1 &
+KLISHD_PID=$!
+i=0
+while kill -0 "${KLISHD_PID}" 2>/dev/null; do
+	i=$((i + 1))
+	if [ ${i} -gt 50 ]; then
+		echo "FAIL: blocking scheme is accepted"
+		rc=1
+		break
+	fi
+	sleep 0.1
+done
+if [ ${i} -le 50 ]; then
+	echo "OK: blocking scheme is refused"
+fi
+kill "${KLISHD_PID}" 2>/dev/null
+wait "${KLISHD_PID}" 2>/dev/null
+KLISHD_PID=""
+
+TEST_XML="${top_srcdir}/tests/xml-shared"
+start_klishd "ServiceProcesses=1"
+
+# The first session executes slow command and stays connected
+mkfifo "${TEST_DIR}/fifo" || exit 99
+"${KLISH}" -f "${TEST_DIR}/klish.conf" -q < "${TEST_DIR}/fifo" \
+	> "${TEST_DIR}/out" &
+CLIENT_PID=$!
+exec 3> "${TEST_DIR}/fifo"
+echo "wait 3 one" >&3
+sleep 0.3
+
+# The second session is served while the first one waits for ACTION
+check_output "say two" "two" || rc=1
+if [ -s "${TEST_DIR}/out" ]; then
+	echo "FAIL: second session waited for the first one"
+	rc=1
+else
+	echo "OK: sessions are concurrent"
+fi
+if [ "$(pgrep -P "${KLISHD_PID}" | wc -l)" -ne 1 ]; then
+	echo "FAIL: sessions are served by different processes"
+	pgrep -l -P "${KLISHD_PID}"
+	rc=1
+else
+	echo "OK: sessions are served by single process"
+fi
+
+exec 3>&-
+wait "${CLIENT_PID}"
+if [ "$(cat "${TEST_DIR}/out")" != "one" ]; then
+	echo "FAIL: output of the first session"
+	cat "${TEST_DIR}/out"
+	rc=1
+else
+	echo "OK: output of the first session"
+fi
+
+exit ${rc}
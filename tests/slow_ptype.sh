@@ -0,0 +1,60 @@
+#!/bin/sh
+# Async PTYPE ACTIONs suspend command parsing instead of blocking the
+# service process. Another session is served while slow PTYPE is executed.
+# Request suspended too many times waits for the rest of PTYPEs but its
+# result must be the same.
+
+. "${top_srcdir:-.}/tests/common.sh"
+
+TEST_XML="${top_srcdir}/tests/xml-shared"
+start_klishd "ServiceProcesses=1"
+
+rc=0
+
+# The first session parses command with slow PTYPE
+mkfifo "${TEST_DIR}/fifo" || exit 99
+"${KLISH}" -f "${TEST_DIR}/klish.conf" -q < "${TEST_DIR}/fifo" \
+	> "${TEST_DIR}/out" &
+CLIENT_PID=$!
+exec 3> "${TEST_DIR}/fifo"
+echo "check one" >&3
+sleep 0.3
+
+# The second session is served by the same process meanwhile
+check_output "say two" "two" || rc=1
+if [ -s "${TEST_DIR}/out" ]; then
+	echo "FAIL: slow PTYPE is finished too early"
+	rc=1
+else
+	echo "OK: slow PTYPE doesn't block service process"
+fi
+
+exec 3>&-
+wait "${CLIENT_PID}"
+if [ "$(cat "${TEST_DIR}/out")" != "one" ]; then
+	echo "FAIL: output of command with slow PTYPE"
+	cat "${TEST_DIR}/out"
+	rc=1
+else
+	echo "OK: output of command with slow PTYPE"
+fi
+
+# Every word is checked by async PTYPE. The number of words is greater
+# than limit of suspensions.
+words=""
+i=0
+while [ ${i} -lt 25 ]; do
+	i=$((i + 1))
+	words="${words} w${i}"
+done
+check_output "words${words}" "25" || rc=1
+
+# PTYPE fails after suspensions
+if klish_cmd "words${words} bad" > /dev/null 2>&1; then
+	echo "FAIL: wrong word is accepted"
+	rc=1
+else
+	echo "OK: wrong word is rejected"
+fi
+
+exit ${rc}